@@ -25,13 +25,32 @@
 #include <unistd.h>
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 #include <inttypes.h>
 
 #include <notes.h>
 #include <props.h>
 
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
+
+#define DEFER_SIZE PORT_SIZE // one control port buffer worth of messages
+
+typedef struct _job_t job_t;
 typedef struct _plughandle_t plughandle_t;
 
+typedef enum _job_type_t {
+	JOB_TYPE_GROW,
+	JOB_TYPE_FREE
+} job_type_t;
+
+struct _job_t {
+	job_type_t type;
+	uint32_t max_size;
+	void *value;
+	void *stash;
+	void *defer;
+};
+
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	LV2_Atom_Forge forge;
@@ -40,21 +59,43 @@ struct _plughandle_t {
 	LV2_Log_Log *log;
 	LV2_Log_Logger logger;
 
+	LV2_Worker_Schedule *sched;
+
 	plugstate_t state;
 	plugstate_t stash;
 
 	const LV2_Atom_Sequence *control;
 	LV2_Atom_Sequence *notify;
 
+	LV2_URID urid_text;
+
+	uint32_t max_size;
+	bool oom;
+	job_t grow;
+
+	struct {
+		uint8_t *buf;
+		uint32_t max_size;
+		uint32_t head;
+		uint32_t tail;
+	} defer; // messages waiting for a grown text buffer, in order of arrival
+	bool replaying;
+	bool stalled;
+
 	PROPS_T(props, MAX_NPROPS);
 };
 
+static int
+_resize_text(void *data, props_impl_t *impl, uint32_t size,
+	const LV2_Atom_Object *obj);
+
 static const props_def_t defs [MAX_NPROPS] = {
 	{
 		.property = NOTES__text,
 		.offset = offsetof(plugstate_t, text),
 		.type = LV2_ATOM__String,
-		.max_size = CODE_SIZE
+		.max_size = TEXT_SIZE,
+		.resize_cb = _resize_text
 	},
 	{
 		.property = NOTES__fontHeight,
@@ -79,6 +120,179 @@ static const props_def_t defs [MAX_NPROPS] = {
 	}
 };
 
+static void
+_text_free(plughandle_t *handle, void *body)
+{
+	// the initial in-place buffers are part of the handle
+	if( (body != handle->state.text) && (body != handle->stash.text) )
+	{
+		free(body);
+	}
+}
+
+static int
+_schedule(plughandle_t *handle, const job_t *job)
+{
+	if(handle->sched->schedule_work(handle->sched->handle, sizeof(job_t), job)
+		!= LV2_WORKER_SUCCESS)
+	{
+		if(handle->log)
+		{
+			lv2_log_error(&handle->logger, "[%s] failed to schedule work\n", __func__);
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+_defer(plughandle_t *handle, const LV2_Atom_Object *obj)
+{
+	const uint32_t obj_sz = lv2_atom_total_size(&obj->atom);
+	const uint32_t sz = lv2_atom_pad_size(obj_sz);
+
+	if(handle->defer.head + sz > handle->defer.max_size)
+	{
+		// move pending messages to front
+		const uint32_t used = handle->defer.head - handle->defer.tail;
+
+		memmove(handle->defer.buf, handle->defer.buf + handle->defer.tail, used);
+		handle->defer.head = used;
+		handle->defer.tail = 0;
+
+		if(used + sz > handle->defer.max_size)
+		{
+			if(handle->log)
+			{
+				lv2_log_error(&handle->logger, "[%s] dropping message\n", __func__);
+			}
+
+			return 1;
+		}
+	}
+
+	memcpy(handle->defer.buf + handle->defer.head, obj, obj_sz);
+	handle->defer.head += sz;
+
+	return 0;
+}
+
+static int
+_resize_text(void *data, props_impl_t *impl __attribute__((unused)),
+	uint32_t size, const LV2_Atom_Object *obj)
+{
+	plughandle_t *handle = data;
+
+	if(!handle->sched || (size > TEXT_SIZE_MAX))
+	{
+		return 0;
+	}
+
+	if(handle->oom)
+	{
+		handle->oom = false;
+
+		return 0;
+	}
+
+	if(size > handle->max_size)
+	{
+		const job_t job = {
+			.type = JOB_TYPE_GROW,
+			.max_size = _text_max_size(size)
+		};
+
+		if(_schedule(handle, &job) != 0)
+		{
+			return 0;
+		}
+
+		handle->max_size = job.max_size;
+	}
+
+	if(!obj)
+	{
+		return 1; // e.g. pending restore, will retry
+	}
+
+	if(handle->replaying)
+	{
+		handle->stalled = true; // keep at head of queue
+
+		return 1;
+	}
+
+	if(_defer(handle, obj) != 0)
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+_adopt(plughandle_t *handle)
+{
+	job_t *grow = &handle->grow;
+
+	if(!grow->stash)
+	{
+		return;
+	}
+
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+
+	if(grow->max_size > impl->stash.max_size)
+	{
+		void *stash = props_stash_swap(&handle->props, handle->urid_text,
+			grow->stash, grow->max_size);
+
+		if(!stash)
+		{
+			return; // stash busy, try again next cycle
+		}
+
+		grow->stash = stash;
+	}
+
+	grow->type = JOB_TYPE_FREE; // free whatever is left over
+	_schedule(handle, grow);
+	memset(grow, 0x0, sizeof(job_t));
+}
+
+static void
+_replay(plughandle_t *handle)
+{
+	handle->replaying = true;
+
+	while(handle->defer.tail != handle->defer.head)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)
+			(handle->defer.buf + handle->defer.tail);
+
+		handle->stalled = false;
+
+		props_advance(&handle->props, &handle->forge, 0, obj, &handle->ref);
+
+		if(handle->stalled)
+		{
+			break; // wait for resized buffers
+		}
+
+		handle->defer.tail += lv2_atom_pad_size(lv2_atom_total_size(&obj->atom));
+	}
+
+	if(handle->defer.tail == handle->defer.head)
+	{
+		handle->defer.head = 0;
+		handle->defer.tail = 0;
+	}
+
+	handle->replaying = false;
+}
+
 static LV2_Handle
 instantiate(const LV2_Descriptor* descriptor,
 	double rate __attribute__((unused)),
@@ -102,6 +316,10 @@ instantiate(const LV2_Descriptor* descriptor,
 		{
 			handle->log = features[i]->data;
 		}
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+		{
+			handle->sched = features[i]->data;
+		}
 	}
 
 	if(!handle->map)
@@ -128,6 +346,39 @@ instantiate(const LV2_Descriptor* descriptor,
 		return NULL;
 	}
 
+	handle->urid_text = props_map(&handle->props, NOTES__text);
+	handle->max_size = TEXT_SIZE;
+
+	if(handle->sched)
+	{
+		handle->defer.buf = malloc(DEFER_SIZE);
+
+		if(!handle->defer.buf)
+		{
+			free(handle);
+			return NULL;
+		}
+
+		handle->defer.max_size = DEFER_SIZE;
+	}
+	else // without worker, text can not grow at run time
+	{
+		void *value = malloc(CODE_SIZE);
+		void *stash = malloc(CODE_SIZE);
+
+		if(value && stash)
+		{
+			props_value_swap(&handle->props, handle->urid_text, value, CODE_SIZE);
+			props_stash_swap(&handle->props, handle->urid_text, stash, CODE_SIZE);
+			handle->max_size = CODE_SIZE;
+		}
+		else
+		{
+			free(value);
+			free(stash);
+		}
+	}
+
 	return handle;
 }
 
@@ -160,13 +411,27 @@ run(LV2_Handle instance, uint32_t nsamples __attribute__((unused)))
 	lv2_atom_forge_set_buffer(&handle->forge, (uint8_t *)handle->notify, capacity);
 	handle->ref = lv2_atom_forge_sequence_head(&handle->forge, &frame, 0);
 
+	_adopt(handle);
+
 	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
 
+	// grown text has been adopted in _work_response already, but replies to
+	// deferred messages need the forge, which is only valid in here
+	_replay(handle);
+
 	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
 	{
 		const int64_t to = ev->time.frames;
 		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 
+		// keep order of messages while some are deferred
+		if(handle->defer.tail != handle->defer.head)
+		{
+			_defer(handle, obj);
+
+			continue;
+		}
+
 		props_advance(&handle->props, &handle->forge, to, obj,
 			&handle->ref);
 	}
@@ -191,6 +456,16 @@ cleanup(LV2_Handle instance)
 {
 	plughandle_t *handle = instance;
 
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+	if(impl)
+	{
+		_text_free(handle, impl->value.body);
+		_text_free(handle, impl->stash.body);
+	}
+
+	_text_free(handle, handle->grow.stash);
+	free(handle->defer.buf);
+
 	munlock(handle, sizeof(plughandle_t));
 	free(handle);
 }
@@ -212,6 +487,30 @@ _state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
 {
 	plughandle_t *handle = instance;
 
+	// make room for text in stash, value will follow via worker
+	size_t size;
+	uint32_t type;
+	uint32_t _flags;
+	const void *body = retrieve(state, handle->urid_text, &size, &type, &_flags);
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+
+	if(  handle->sched && body && impl
+		&& (size > impl->stash.max_size) && (size <= TEXT_SIZE_MAX) )
+	{
+		const uint32_t max_size = _text_max_size(size);
+		void *stash = malloc(max_size);
+		void *old = NULL;
+
+		// spin until rt-thread has released stash
+		while(stash && !(old = props_stash_swap(&handle->props, handle->urid_text,
+			stash, max_size)))
+		{
+			sched_yield();
+		}
+
+		_text_free(handle, old);
+	}
+
 	return props_restore(&handle->props, retrieve, state, flags, features);
 }
 
@@ -220,6 +519,139 @@ static const LV2_State_Interface state_iface = {
 	.restore = _state_restore
 };
 
+// non-rt thread
+static LV2_Worker_Status
+_work(LV2_Handle instance,
+	LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle target,
+	uint32_t size __attribute__((unused)),
+	const void *body)
+{
+	plughandle_t *handle = instance;
+	job_t job;
+
+	memcpy(&job, body, sizeof(job_t));
+
+	switch(job.type)
+	{
+		case JOB_TYPE_GROW:
+		{
+			// deferred messages may carry up to the whole text
+			job.value = malloc(job.max_size);
+			job.stash = malloc(job.max_size);
+			job.defer = malloc(job.max_size + DEFER_SIZE);
+
+			if(!job.value || !job.stash || !job.defer)
+			{
+				free(job.value);
+				free(job.stash);
+				free(job.defer);
+				job.value = NULL;
+				job.stash = NULL;
+				job.defer = NULL;
+			}
+
+			return respond(target, sizeof(job_t), &job);
+		} break;
+		case JOB_TYPE_FREE:
+		{
+			_text_free(handle, job.value);
+			_text_free(handle, job.stash);
+			free(job.defer);
+		} break;
+	}
+
+	return LV2_WORKER_SUCCESS;
+}
+
+// rt-thread
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size __attribute__((unused)),
+	const void *body)
+{
+	plughandle_t *handle = instance;
+	job_t job;
+
+	memcpy(&job, body, sizeof(job_t));
+
+	switch(job.type)
+	{
+		case JOB_TYPE_GROW:
+		{
+			props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+
+			if(!job.value)
+			{
+				if(handle->log)
+				{
+					lv2_log_error(&handle->logger, "[%s] out of memory\n", __func__);
+				}
+
+				handle->oom = true;
+				handle->max_size = impl->value.max_size;
+				break;
+			}
+
+			// adopt value right away, unless a bigger one made it first
+			if(job.max_size > impl->value.max_size)
+			{
+				void *value = props_value_swap(&handle->props, handle->urid_text,
+					job.value, job.max_size);
+
+				if(value)
+				{
+					job.value = value;
+				}
+			}
+
+			// move pending messages over, they are replayed in the next run
+			const uint32_t defer_size = job.max_size + DEFER_SIZE;
+			if(defer_size > handle->defer.max_size)
+			{
+				const uint32_t used = handle->defer.head - handle->defer.tail;
+				uint8_t *defer = handle->defer.buf;
+
+				memcpy(job.defer, defer + handle->defer.tail, used);
+				handle->defer.buf = job.defer;
+				handle->defer.max_size = defer_size;
+				handle->defer.head = used;
+				handle->defer.tail = 0;
+
+				job.defer = defer;
+			}
+
+			// stash may be busy, keep the biggest one pending for _adopt
+			if(job.max_size > handle->grow.max_size)
+			{
+				void *stash = handle->grow.stash;
+
+				handle->grow.stash = job.stash;
+				handle->grow.max_size = job.max_size;
+
+				job.stash = stash;
+			}
+
+			// free whatever is left over
+			job.type = JOB_TYPE_FREE;
+			_schedule(handle, &job);
+
+			_adopt(handle);
+		} break;
+		case JOB_TYPE_FREE:
+		{
+			// never reached
+		} break;
+	}
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
 static const void*
 extension_data(const char* uri)
 {
@@ -227,6 +659,10 @@ extension_data(const char* uri)
 	{
 		return &state_iface;
 	}
+	else if(!strcmp(uri, LV2_WORKER__interface))
+	{
+		return &work_iface;
+	}
 
 	return NULL;
 }
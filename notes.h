@@ -57,7 +57,12 @@
 #define NOTES__textMinimized  NOTES_PREFIX "textMinimized"
 
 #define MAX_NPROPS 5
-#define CODE_SIZE 0x10000 // 64 K
+#define TEXT_SIZE 0x1000 // 4 K, initial in-place capacity
+#define PORT_SIZE 0x40000 // 256 K, rsz:minimumSize of control and notify port
+// whole values still are sent as single atom, e.g. on patch:Get and restore,
+// thus text must fit into a port buffer with room left for the message
+#define TEXT_SIZE_MAX (PORT_SIZE - 0x1000)
+#define CODE_SIZE 0x10000 // 64 K, fixed capacity without worker
 
 typedef struct _plugstate_t plugstate_t;
 
@@ -66,7 +71,20 @@ struct _plugstate_t {
 	int32_t image_minimized;
 	int32_t text_minimized;
 	char image [PATH_MAX];
-	char text [CODE_SIZE];
+	char text [TEXT_SIZE];
 };
 
+static inline uint32_t
+_text_max_size(uint32_t size)
+{
+	uint32_t max_size = TEXT_SIZE;
+
+	while(max_size < size)
+	{
+		max_size <<= 1;
+	}
+
+	return max_size;
+}
+
 #endif // _NOTES_LV2_H
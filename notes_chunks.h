@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2019-2020 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _NOTES_CHUNKS_H
+#define _NOTES_CHUNKS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <d2tk/hash.h>
+
+/*
+ * Content-defined chunking of a text buffer with a gear rolling hash. Chunk
+ * boundaries only depend on the bytes since the start of the chunk. An edit
+ * thus only needs to rechunk from the chunk it touches until the boundaries
+ * fall in line with the previous ones again. Each chunk carries its own hash,
+ * the root hash is calculated over the chunk list (a 2-level Merkle tree).
+ */
+
+#define CHUNKS_MIN 0x100
+#define CHUNKS_MAX 0x2000
+#define CHUNKS_MASK 0x3ff // average chunk size of ~1 K
+
+typedef struct _chunk_t chunk_t;
+typedef struct _chunks_t chunks_t;
+
+struct _chunk_t {
+	uint64_t hash;
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct _chunks_t {
+	uint64_t gear [0x100];
+	uint32_t nchunks;
+	uint32_t max_chunks;
+	chunk_t *chunk;
+	uint64_t root;
+};
+
+static inline void
+_chunks_init(chunks_t *chunks)
+{
+	uint64_t x = 0x4e4f5445534c5632; // fixed seed, chunking must be stable
+
+	memset(chunks, 0x0, sizeof(chunks_t));
+
+	// splitmix64
+	for(unsigned i = 0; i < 0x100; i++)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		chunks->gear[i] = z ^ (z >> 31);
+	}
+}
+
+static inline void
+_chunks_deinit(chunks_t *chunks)
+{
+	free(chunks->chunk);
+	chunks->chunk = NULL;
+	chunks->nchunks = 0;
+	chunks->max_chunks = 0;
+}
+
+static inline uint32_t
+_chunks_next(const chunks_t *chunks, const uint8_t *buf, uint32_t len)
+{
+	const uint32_t max = len < CHUNKS_MAX ? len : CHUNKS_MAX;
+	uint64_t h = 0;
+
+	for(uint32_t i = 0; i < max; i++)
+	{
+		h = (h << 1) + chunks->gear[buf[i]];
+
+		if( (i + 1 >= CHUNKS_MIN) && !(h & CHUNKS_MASK) )
+		{
+			return i + 1;
+		}
+	}
+
+	return max;
+}
+
+static inline int
+_chunks_reserve(chunks_t *chunks, uint32_t nchunks)
+{
+	if(nchunks <= chunks->max_chunks)
+	{
+		return 0;
+	}
+
+	uint32_t max_chunks = chunks->max_chunks ? chunks->max_chunks : 0x40;
+
+	while(max_chunks < nchunks)
+	{
+		max_chunks <<= 1;
+	}
+
+	chunk_t *chunk = realloc(chunks->chunk, max_chunks*sizeof(chunk_t));
+	if(!chunk)
+	{
+		return 1;
+	}
+
+	chunks->chunk = chunk;
+	chunks->max_chunks = max_chunks;
+
+	return 0;
+}
+
+static inline uint32_t
+_chunks_find(const chunks_t *chunks, uint32_t offset)
+{
+	uint32_t lo = 0;
+	uint32_t hi = chunks->nchunks;
+
+	// first chunk ending after offset
+	while(lo < hi)
+	{
+		const uint32_t mid = (lo + hi) / 2;
+		const chunk_t *chunk = &chunks->chunk[mid];
+
+		if(chunk->offset + chunk->size <= offset)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/*
+ * Update chunks after 'length' bytes at 'offset' have been replaced with
+ * 'size' bytes, 'buf' and 'len' refer to the updated buffer. Returns the new
+ * root hash.
+ */
+static inline uint64_t
+_chunks_update(chunks_t *chunks, const void *buf, uint32_t len,
+	uint32_t offset, uint32_t length, uint32_t size)
+{
+	const uint8_t *src = buf;
+	const int64_t delta = (int64_t)size - length;
+
+	// list must be allocated even for empty text, it is moved and hashed below
+	if(_chunks_reserve(chunks, 1))
+	{
+		chunks->nchunks = 0; // out-of-memory, hash as a whole
+		chunks->root = d2tk_hash(buf, len);
+
+		return chunks->root;
+	}
+
+	// the last chunk ends with the buffer, so appending touches it, too
+	uint32_t first = _chunks_find(chunks, offset);
+	if( (first == chunks->nchunks) && (first > 0) )
+	{
+		first--;
+	}
+
+	// old chunks from here on are untouched by the edit, if shifted by delta
+	uint32_t last = _chunks_find(chunks, offset + length);
+	if( (last < chunks->nchunks) && (chunks->chunk[last].offset < offset + length) )
+	{
+		last++;
+	}
+
+	uint32_t pos = first < chunks->nchunks ? chunks->chunk[first].offset : 0;
+	const uint32_t end = offset + size; // end of edit in new buffer
+
+	// collect new chunks in spare space at end of list
+	uint32_t nnew = 0;
+
+	while(pos < len)
+	{
+		// resynchronize with an old chunk boundary behind the edit
+		while( (last < chunks->nchunks)
+			&& (chunks->chunk[last].offset + delta < pos) )
+		{
+			last++;
+		}
+
+		if( (pos >= end) && (last < chunks->nchunks)
+			&& (chunks->chunk[last].offset + delta == pos) )
+		{
+			break;
+		}
+
+		if(_chunks_reserve(chunks, chunks->nchunks + nnew + 1))
+		{
+			chunks->nchunks = 0; // out-of-memory, hash as a whole
+			chunks->root = d2tk_hash(buf, len);
+
+			return chunks->root;
+		}
+
+		const uint32_t sz = _chunks_next(chunks, &src[pos], len - pos);
+		chunk_t *chunk = &chunks->chunk[chunks->nchunks + nnew++];
+
+		chunk->offset = pos;
+		chunk->size = sz;
+		chunk->hash = d2tk_hash(&src[pos], sz);
+
+		pos += sz;
+	}
+
+	if(pos >= len)
+	{
+		last = chunks->nchunks; // no resynchronization, all old chunks are gone
+	}
+
+	// shift untouched tail and move in new chunks
+	const uint32_t ntail = chunks->nchunks - last;
+
+	for(uint32_t i = last; i < chunks->nchunks; i++)
+	{
+		chunks->chunk[i].offset += delta;
+	}
+
+	chunk_t *fresh = &chunks->chunk[chunks->nchunks];
+	chunk_t *tail = &chunks->chunk[last];
+	chunk_t *dst = &chunks->chunk[first];
+
+	if(nnew <= last - first) // shrinks or keeps size, e.g. in-place
+	{
+		memmove(dst, fresh, nnew*sizeof(chunk_t));
+		memmove(&dst[nnew], tail, ntail*sizeof(chunk_t));
+	}
+	else // grows, make room first
+	{
+		if(_chunks_reserve(chunks, first + nnew + ntail + nnew))
+		{
+			chunks->nchunks = 0; // out-of-memory, hash as a whole
+			chunks->root = d2tk_hash(buf, len);
+
+			return chunks->root;
+		}
+
+		// pointers may have been invalidated by reserve
+		fresh = &chunks->chunk[chunks->nchunks];
+		tail = &chunks->chunk[last];
+		dst = &chunks->chunk[first];
+
+		chunk_t *spare = &chunks->chunk[first + nnew + ntail];
+
+		memmove(spare, fresh, nnew*sizeof(chunk_t));
+		memmove(&dst[nnew], tail, ntail*sizeof(chunk_t));
+		memmove(dst, spare, nnew*sizeof(chunk_t));
+	}
+
+	chunks->nchunks = first + nnew + ntail;
+	chunks->root = d2tk_hash(chunks->chunk, chunks->nchunks*sizeof(chunk_t));
+
+	return chunks->root;
+}
+
+static inline uint64_t
+_chunks_reset(chunks_t *chunks, const void *buf, uint32_t len)
+{
+	chunks->nchunks = 0;
+
+	return _chunks_update(chunks, buf, len, 0, 0, len);
+}
+
+#endif // _NOTES_CHUNKS_H
@@ -0,0 +1,637 @@
+/*
+ * Copyright (c) 2019-2020 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _NOTES_MD_H
+#define _NOTES_MD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <d2tk/hash.h>
+
+/*
+ * Line-oriented subset of Markdown for a read-only preview: headings, rules,
+ * block quotes, (un)ordered list items, fenced code and inline links. The
+ * text is split into blocks at blank lines and code fences. Blocks are keyed
+ * by their hash, an update keeps the unchanged leading and trailing blocks and
+ * only reparses the ones in between. Each source line maps to exactly one
+ * display row, rows are not wrapped.
+ */
+
+#define MD_BLOCK_LINES 32 // split long paragraphs to keep reparsing local
+
+typedef enum _md_kind_t {
+	MD_TEXT,
+	MD_HEADING,
+	MD_RULE,
+	MD_QUOTE,
+	MD_ITEM,
+	MD_CODE
+} md_kind_t;
+
+typedef struct _md_row_t md_row_t;
+typedef struct _md_block_t md_block_t;
+typedef struct _md_span_t md_span_t;
+typedef struct _md_t md_t;
+
+struct _md_row_t {
+	uint8_t kind; // md_kind_t
+	uint8_t level; // heading level or list nesting depth
+	uint32_t offset; // display text within block
+	uint32_t size;
+	uint32_t url_offset; // first link target within block
+	uint32_t url_size;
+};
+
+struct _md_block_t {
+	uint64_t hash;
+	uint32_t row0; // index of first row in whole document
+	uint32_t nrows;
+	md_row_t *row;
+	char *text; // display text of all rows
+};
+
+struct _md_span_t {
+	uint64_t hash;
+	uint32_t offset;
+	uint32_t size;
+	bool code;
+};
+
+struct _md_t {
+	uint32_t nblocks;
+	md_block_t *block;
+	uint32_t nspans;
+	uint32_t max_spans;
+	md_span_t *span;
+	uint32_t nrows;
+};
+
+static inline void
+_md_init(md_t *md)
+{
+	memset(md, 0x0, sizeof(md_t));
+}
+
+static inline void
+_md_block_free(md_block_t *block)
+{
+	free(block->row);
+	free(block->text);
+}
+
+static inline void
+_md_deinit(md_t *md)
+{
+	for(uint32_t i = 0; i < md->nblocks; i++)
+	{
+		_md_block_free(&md->block[i]);
+	}
+
+	free(md->block);
+	free(md->span);
+	memset(md, 0x0, sizeof(md_t));
+}
+
+static inline const char *
+_md_eol(const char *ptr, const char *end)
+{
+	const char *eol = memchr(ptr, '\n', end - ptr);
+
+	return eol ? eol : end;
+}
+
+static inline bool
+_md_is_blank(const char *ptr, const char *end)
+{
+	for( ; ptr < end; ptr++)
+	{
+		if( (*ptr != ' ') && (*ptr != '\t') && (*ptr != '\r') )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static inline bool
+_md_is_fence(const char *ptr, const char *end)
+{
+	while( (ptr < end) && (*ptr == ' ') )
+	{
+		ptr++;
+	}
+
+	return (end - ptr >= 3)
+		&& ( !strncmp(ptr, "```", 3) || !strncmp(ptr, "~~~", 3) );
+}
+
+static inline int
+_md_span_push(md_t *md, const char *txt, const char *from, const char *to,
+	bool code)
+{
+	if(from == to)
+	{
+		return 0;
+	}
+
+	if(md->nspans == md->max_spans)
+	{
+		const uint32_t max_spans = md->max_spans ? md->max_spans * 2 : 64;
+		md_span_t *span = realloc(md->span, max_spans * sizeof(md_span_t));
+		if(!span)
+		{
+			return 1;
+		}
+
+		md->span = span;
+		md->max_spans = max_spans;
+	}
+
+	md_span_t *span = &md->span[md->nspans++];
+
+	span->offset = from - txt;
+	span->size = to - from;
+	span->code = code;
+
+	const d2tk_hash_dict_t dict [] = {
+		{ from, span->size },
+		{ &span->code, sizeof(bool) },
+		{ NULL, 0 }
+	};
+	span->hash = d2tk_hash_dict(dict);
+
+	return 0;
+}
+
+static inline int
+_md_split(md_t *md, const char *txt, size_t txt_len)
+{
+	const char *end = txt + txt_len;
+	const char *from = txt;
+	unsigned nlines = 0;
+	bool code = false;
+
+	md->nspans = 0;
+
+	for(const char *ptr = txt; ptr < end; )
+	{
+		const char *eol = _md_eol(ptr, end);
+		const char *nxt = (eol < end) ? eol + 1 : end;
+
+		if(_md_is_fence(ptr, eol))
+		{
+			if(!code) // fence opens a new block
+			{
+				if(_md_span_push(md, txt, from, ptr, false))
+				{
+					return 1;
+				}
+
+				from = ptr;
+				nlines = 0;
+			}
+			else // fence closes current block
+			{
+				if(_md_span_push(md, txt, from, nxt, true))
+				{
+					return 1;
+				}
+
+				from = nxt;
+				nlines = 0;
+			}
+
+			code = !code;
+		}
+		else if( (!code && _md_is_blank(ptr, eol))
+			|| (++nlines == MD_BLOCK_LINES) )
+		{
+			if(_md_span_push(md, txt, from, nxt, code))
+			{
+				return 1;
+			}
+
+			from = nxt;
+			nlines = 0;
+		}
+
+		ptr = nxt;
+	}
+
+	// an unterminated fence extends to the end
+	return _md_span_push(md, txt, from, end, code);
+}
+
+typedef struct _md_link_t md_link_t;
+
+struct _md_link_t {
+	const char *url; // first link target in source
+	size_t url_len;
+};
+
+static inline void
+_md_link_set(md_link_t *link, const char *url, size_t url_len)
+{
+	if(!link->url)
+	{
+		link->url = url;
+		link->url_len = url_len;
+	}
+}
+
+static inline size_t
+_md_inline(char *dst, const char *ptr, const char *end, md_link_t *link)
+{
+	char *out = dst;
+
+	while(ptr < end)
+	{
+		// [label](url) and ![alt](url)
+		const char *lbl = (*ptr == '[') ? ptr + 1
+			: ( (*ptr == '!') && (ptr + 1 < end) && (ptr[1] == '[') ) ? ptr + 2
+			: NULL;
+
+		if(lbl)
+		{
+			const char *rbr = memchr(lbl, ']', end - lbl);
+			const char *url = rbr ? rbr + 2 : NULL;
+			const char *rpa = (rbr && (rbr + 1 < end) && (rbr[1] == '(') )
+				? memchr(url, ')', end - url)
+				: NULL;
+
+			if(rpa)
+			{
+				_md_link_set(link, url, rpa - url);
+				memcpy(out, lbl, rbr - lbl);
+				out += rbr - lbl;
+				ptr = rpa + 1;
+				continue;
+			}
+		}
+
+		// <scheme:autolink>
+		if(*ptr == '<')
+		{
+			const char *url = ptr + 1;
+			const char *rab = memchr(url, '>', end - url);
+
+			if(rab && memchr(url, ':', rab - url) && !memchr(url, ' ', rab - url) )
+			{
+				_md_link_set(link, url, rab - url);
+				memcpy(out, url, rab - url);
+				out += rab - url;
+				ptr = rab + 1;
+				continue;
+			}
+		}
+
+		// drop strong emphasis and code span markers
+		if(*ptr == '`')
+		{
+			ptr++;
+			continue;
+		}
+
+		if( (ptr + 1 < end) && ( (*ptr == '*') || (*ptr == '_') )
+			&& (ptr[1] == *ptr) )
+		{
+			ptr += 2;
+			continue;
+		}
+
+		*out++ = *ptr++;
+	}
+
+	return out - dst;
+}
+
+static inline const char *
+_md_skip_space(const char *ptr, const char *end)
+{
+	while( (ptr < end) && (*ptr == ' ') )
+	{
+		ptr++;
+	}
+
+	return ptr;
+}
+
+static inline unsigned
+_md_heading(const char *ptr, const char *end)
+{
+	const char *hsh = ptr;
+
+	while( (hsh < end) && (*hsh == '#') )
+	{
+		hsh++;
+	}
+
+	const unsigned level = hsh - ptr;
+
+	return ( (level <= 6) && ( (hsh == end) || (*hsh == ' ') ) ) ? level : 0;
+}
+
+static inline bool
+_md_is_rule(const char *ptr, const char *end)
+{
+	if( (ptr == end) || !memchr("-*_", *ptr, 3) )
+	{
+		return false;
+	}
+
+	const char mark = *ptr;
+	unsigned n = 0;
+
+	for( ; ptr < end; ptr++)
+	{
+		if(*ptr == mark)
+		{
+			n++;
+		}
+		else if(*ptr != ' ')
+		{
+			return false;
+		}
+	}
+
+	return n >= 3;
+}
+
+static inline size_t
+_md_item(const char *ptr, const char *end)
+{
+	// - item, * item, + item
+	if( (ptr + 1 < end) && memchr("-*+", *ptr, 3) && (ptr[1] == ' ') )
+	{
+		return 2;
+	}
+
+	// 1. item, 1) item
+	const char *num = ptr;
+
+	while( (num < end) && (*num >= '0') && (*num <= '9') )
+	{
+		num++;
+	}
+
+	if( (num > ptr) && (num + 1 < end) && ( (*num == '.') || (*num == ')') )
+		&& (num[1] == ' ') )
+	{
+		return num + 2 - ptr;
+	}
+
+	return 0;
+}
+
+static inline size_t
+_md_parse_line(char *dst, const char *ptr, const char *end, bool code,
+	md_row_t *row, md_link_t *link)
+{
+	static const char bullet [] = "\xe2\x80\xa2 "; // U+2022
+	const char *txt = ptr;
+	unsigned indent = 0;
+	unsigned level;
+	size_t skip;
+	size_t len;
+
+	if( (end > ptr) && (end[-1] == '\r') )
+	{
+		end--;
+	}
+
+	if(code)
+	{
+		row->kind = MD_CODE;
+
+		if(_md_is_fence(ptr, end))
+		{
+			return 0; // fences themselves are rendered empty
+		}
+
+		memcpy(dst, ptr, end - ptr);
+		return end - ptr;
+	}
+
+	while( (ptr < end) && ( (*ptr == ' ') || (*ptr == '\t') ) )
+	{
+		indent += (*ptr++ == '\t') ? 4 : 1;
+	}
+
+	if( (level = _md_heading(ptr, end)) )
+	{
+		row->kind = MD_HEADING;
+		row->level = level;
+
+		// trim optional closing sequence
+		while( (end > ptr + level) && ( (end[-1] == '#') || (end[-1] == ' ') ) )
+		{
+			end--;
+		}
+
+		return _md_inline(dst, _md_skip_space(ptr + level, end), end, link);
+	}
+
+	if(_md_is_rule(ptr, end))
+	{
+		row->kind = MD_RULE;
+		return 0;
+	}
+
+	if( (ptr < end) && (*ptr == '>') )
+	{
+		row->kind = MD_QUOTE;
+		return _md_inline(dst, _md_skip_space(ptr + 1, end), end, link);
+	}
+
+	if( (skip = _md_item(ptr, end)) )
+	{
+		row->kind = MD_ITEM;
+		row->level = indent / 2;
+
+		if(skip == 2) // unordered
+		{
+			memcpy(dst, bullet, sizeof(bullet) - 1);
+			len = sizeof(bullet) - 1;
+		}
+		else // ordered
+		{
+			memcpy(dst, ptr, skip);
+			len = skip;
+		}
+
+		return len + _md_inline(&dst[len], ptr + skip, end, link);
+	}
+
+	// plain text keeps its indentation
+	row->kind = MD_TEXT;
+	return _md_inline(dst, txt, end, link);
+}
+
+static inline int
+_md_parse(md_block_t *block, const char *txt, const md_span_t *span)
+{
+	const char *ptr = txt + span->offset;
+	const char *end = ptr + span->size;
+	uint32_t nrows = 0;
+
+	for(const char *eol = ptr; eol < end; nrows++)
+	{
+		eol = _md_eol(eol, end);
+		eol = (eol < end) ? eol + 1 : end;
+	}
+
+	block->hash = span->hash;
+	block->nrows = nrows;
+	// worst case per row of n source bytes: n + 2 bytes of display text, as a
+	// 4-byte bullet replaces the 2-byte item marker, plus a link target of < n
+	block->text = malloc(span->size * 2 + nrows * 2 + 1);
+	block->row = calloc(nrows, sizeof(md_row_t));
+
+	if(!block->text || !block->row)
+	{
+		_md_block_free(block);
+		memset(block, 0x0, sizeof(md_block_t));
+		return 1;
+	}
+
+	uint32_t offset = 0;
+
+	for(md_row_t *row = block->row; ptr < end; row++)
+	{
+		const char *eol = _md_eol(ptr, end);
+		md_link_t link = {
+			.url = NULL,
+			.url_len = 0
+		};
+
+		row->offset = offset;
+		row->size = _md_parse_line(&block->text[offset], ptr, eol, span->code,
+			row, &link);
+		offset += row->size;
+
+		row->url_offset = offset;
+		row->url_size = link.url_len;
+		if(link.url)
+		{
+			memcpy(&block->text[offset], link.url, link.url_len);
+			offset += link.url_len;
+		}
+
+		ptr = (eol < end) ? eol + 1 : end;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns number of reparsed blocks, or -1 on failure.
+ */
+static inline int
+_md_update(md_t *md, const char *txt, size_t txt_len)
+{
+	if(_md_split(md, txt, txt_len))
+	{
+		return -1;
+	}
+
+	const uint32_t nold = md->nblocks;
+	const uint32_t nnew = md->nspans;
+	const uint32_t nmin = (nold < nnew) ? nold : nnew;
+
+	uint32_t head = 0;
+	while( (head < nmin) && (md->block[head].hash == md->span[head].hash) )
+	{
+		head++;
+	}
+
+	uint32_t tail = 0;
+	while( (tail < nmin - head)
+		&& (md->block[nold - 1 - tail].hash == md->span[nnew - 1 - tail].hash) )
+	{
+		tail++;
+	}
+
+	md_block_t *block = calloc(nnew ? nnew : 1, sizeof(md_block_t));
+	if(!block)
+	{
+		return -1;
+	}
+
+	// keep unchanged blocks
+	for(uint32_t i = 0; i < head; i++)
+	{
+		block[i] = md->block[i];
+	}
+
+	for(uint32_t i = 0; i < tail; i++)
+	{
+		block[nnew - 1 - i] = md->block[nold - 1 - i];
+	}
+
+	for(uint32_t i = head; i < nold - tail; i++)
+	{
+		_md_block_free(&md->block[i]);
+	}
+
+	int failed = 0;
+	for(uint32_t i = head; i < nnew - tail; i++)
+	{
+		failed |= _md_parse(&block[i], txt, &md->span[i]);
+	}
+
+	free(md->block);
+	md->block = block;
+	md->nblocks = nnew;
+	md->nrows = 0;
+
+	for(uint32_t i = 0; i < nnew; i++)
+	{
+		block[i].row0 = md->nrows;
+		md->nrows += block[i].nrows;
+	}
+
+	return failed ? -1 : (int)(nnew - tail - head);
+}
+
+static inline uint32_t
+_md_find(const md_t *md, uint32_t row)
+{
+	uint32_t lo = 0;
+	uint32_t hi = md->nblocks;
+
+	while(hi - lo > 1)
+	{
+		const uint32_t mid = (lo + hi) / 2;
+
+		if(md->block[mid].row0 <= row)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+#endif // _NOTES_MD_H
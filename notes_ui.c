@@ -23,12 +23,21 @@
 #include <errno.h>
 #include <ctype.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
-#include <utime.h>
 #include <wordexp.h>
+#if defined(__linux__)
+#	include <limits.h>
+#	include <poll.h>
+#	include <sys/inotify.h>
+#	include <sys/vfs.h>
+#	include <linux/magic.h>
+#endif
 
 #include <notes.h>
+#include <notes_chunks.h>
+#include <notes_md.h>
 #include <props.h>
 
 #define SER_ATOM_IMPLEMENTATION
@@ -38,8 +47,19 @@
 #include <d2tk/util.h>
 #include <d2tk/frontend_pugl.h>
 
+#define TEMPLATE_NAME "notes.md"
+#define DEBOUNCE_MS 50
+#define DEBOUNCE_MAX_MS 1000
+
+typedef struct _reload_t reload_t;
 typedef struct _plughandle_t plughandle_t;
 
+struct _reload_t {
+	const char *editor;
+	const char *arg; // argument needed to run in terminal, if any
+	const char *keys;
+};
+
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	LV2_Atom_Forge forge;
@@ -63,6 +83,7 @@ struct _plughandle_t {
 	plugstate_t state;
 	plugstate_t stash;
 
+	chunks_t chunks;
 	uint64_t hash;
 
 	LV2_URID atom_eventTransfer;
@@ -74,9 +95,23 @@ struct _plughandle_t {
 	LV2_URID urid_textMinimized;
 
 	bool reinit;
-	char template [24];
-	int fd;
+	const char *reload_keys;
+	char reload_buf [64];
+	bool builtin;
+	bool preview;
+	md_t md;
+	bool md_dirty;
+	bool dirty;
+	uint64_t dirty_first;
+	uint64_t dirty_last;
+	uint64_t debounce;
+	bool volatile_fs;
+	char dir [24];
+	char template [40];
+	char img_dir [PATH_MAX];
 	time_t modtime;
+	int ifd;
+	unsigned renames; // own renames not yet seen by inotify
 
 	float scale;
 	d2tk_coord_t header_height;
@@ -98,69 +133,139 @@ _update_font_height(plughandle_t *handle)
 	handle->font_height = handle->state.font_height * handle->scale;
 }
 
-static void
-_intercept_text(void *data, int64_t frames __attribute__((unused)),
-	props_impl_t *impl)
+static uint64_t
+_now_ms()
 {
-	plughandle_t *handle = data;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	ssize_t txt_len = impl->value.size;
-	const char *txt = handle->state.text;
+	return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
 
-	const uint64_t hash = d2tk_hash(txt, txt_len);
+static void
+_file_flush(plughandle_t *handle, bool force)
+{
+	if(!handle->dirty)
+	{
+		return;
+	}
 
-	if(handle->hash == hash)
+	const uint64_t now = _now_ms();
+
+	// wait for burst of updates to settle, but not forever
+	if(!force
+		&& (now - handle->dirty_last < handle->debounce)
+		&& (now - handle->dirty_first < DEBOUNCE_MAX_MS) )
 	{
 		return;
 	}
 
-	handle->hash = hash;
+	handle->dirty = false;
+
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+	const char *txt = impl->value.body;
+	const size_t txt_len = strnlen(txt, impl->value.size);
 
-	// save txt to file
-	if(lseek(handle->fd, 0, SEEK_SET) == -1)
+	// write to sibling and rename over, so editors never see a partial file
+	char tmp_path [sizeof(handle->template) + 8];
+	snprintf(tmp_path, sizeof(tmp_path), "%s/.%s.XXXXXX", handle->dir,
+		TEMPLATE_NAME);
+
+	const int fd = mkstemp(tmp_path);
+	if(fd == -1)
 	{
-		lv2_log_error(&handle->logger, "lseek: %s\n", strerror(errno));
+		lv2_log_error(&handle->logger, "mkstemp: %s\n", strerror(errno));
+		return;
 	}
-	if(ftruncate(handle->fd, 0) == -1)
+
+	bool failed = false;
+
+	if( (txt_len > 0) && (write(fd, txt, txt_len) != (ssize_t)txt_len) )
 	{
-		lv2_log_error(&handle->logger, "ftruncate: %s\n", strerror(errno));
+		lv2_log_error(&handle->logger, "write: %s\n", strerror(errno));
+		failed = true;
 	}
-	if(fsync(handle->fd) == -1)
+
+	// on tmpfs, there is nothing to sync to
+	if(!failed && !handle->volatile_fs && (fsync(fd) == -1) )
 	{
 		lv2_log_error(&handle->logger, "fsync: %s\n", strerror(errno));
+		failed = true;
 	}
-	if(txt_len > 0)
+
+	// remember own modification for stat-based fall-back
+	struct stat st;
+	if(fstat(fd, &st) == 0)
+	{
+		handle->modtime = st.st_mtime;
+	}
+
+	close(fd);
+
+	if(failed || (rename(tmp_path, handle->template) == -1) )
 	{
-		if(write(handle->fd, txt, txt_len - 1) == -1)
+		if(!failed)
 		{
-			lv2_log_error(&handle->logger, "write: %s\n", strerror(errno));
+			lv2_log_error(&handle->logger, "rename: %s\n", strerror(errno));
 		}
+
+		unlink(tmp_path);
+		return;
 	}
-	if(fsync(handle->fd) == -1)
+
+	if(handle->ifd != -1)
 	{
-		lv2_log_error(&handle->logger, "fsync: %s\n", strerror(errno));
+		handle->renames++;
 	}
 
-	// change modification timestamp of file
-	struct stat st;
-	if(stat(handle->template, &st) == -1)
+	// have editor reread or respawn with updated file
+	handle->reinit = true;
+	d2tk_frontend_redisplay(handle->dpugl);
+}
+
+static bool
+_text_changed(plughandle_t *handle, props_impl_t *impl)
+{
+	// only rehash the chunks touched by the last change
+	const uint64_t hash = _chunks_update(&handle->chunks, impl->value.body,
+		impl->value.size, impl->change.offset, impl->change.length,
+		impl->change.size);
+
+	if(handle->hash == hash)
 	{
-		lv2_log_error(&handle->logger, "stat: %s\n", strerror(errno));
+		return false;
 	}
 
-	handle->modtime = time(NULL);
+	handle->hash = hash;
+	handle->md_dirty = true;
 
-	const struct utimbuf btime = {
-	 .actime = st.st_atime,
-	 .modtime = handle->modtime
-	};
+	return true;
+}
 
-	if(utime(handle->template, &btime) == -1)
+static void
+_file_dirty(plughandle_t *handle)
+{
+	// coalesce consecutive updates, file is written out in _idle
+	handle->dirty_last = _now_ms();
+	if(!handle->dirty)
 	{
-		lv2_log_error(&handle->logger, "utime: %s\n", strerror(errno));
+		handle->dirty_first = handle->dirty_last;
+		handle->dirty = true;
 	}
+}
 
-	handle->reinit = true;
+static void
+_intercept_text(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	if(!_text_changed(handle, impl))
+	{
+		return;
+	}
+
+	_file_dirty(handle);
 }
 
 static void
@@ -172,13 +277,56 @@ _intercept_font_height(void *data, int64_t frames __attribute__((unused)),
 	_update_font_height(handle);
 }
 
+static void
+_text_free(plughandle_t *handle, void *body)
+{
+	// the initial in-place buffers are part of the handle
+	if( (body != handle->state.text) && (body != handle->stash.text) )
+	{
+		free(body);
+	}
+}
+
+static int
+_resize_text(void *data, props_impl_t *impl, uint32_t size,
+	const LV2_Atom_Object *obj __attribute__((unused)))
+{
+	plughandle_t *handle = data;
+
+	if(size > TEXT_SIZE_MAX)
+	{
+		return 0;
+	}
+
+	const uint32_t max_size = _text_max_size(size);
+	void *value = malloc(max_size);
+	void *stash = malloc(max_size);
+
+	if(!value || !stash)
+	{
+		free(value);
+		free(stash);
+
+		return 0;
+	}
+
+	// UI is single-threaded, thus we can swap in-place
+	_text_free(handle, props_value_swap(&handle->props, impl->property,
+		value, max_size));
+	_text_free(handle, props_stash_swap(&handle->props, impl->property,
+		stash, max_size));
+
+	return 1;
+}
+
 static const props_def_t defs [MAX_NPROPS] = {
 	{
 		.property = NOTES__text,
 		.offset = offsetof(plugstate_t, text),
 		.type = LV2_ATOM__String,
 		.event_cb = _intercept_text,
-		.max_size = CODE_SIZE
+		.resize_cb = _resize_text,
+		.max_size = TEXT_SIZE
 	},
 	{
 		.property = NOTES__fontHeight,
@@ -229,6 +377,32 @@ _message_set_key(plughandle_t *handle, LV2_URID key)
 	ser_atom_deinit(&ser);
 }
 
+static bool
+_message_splice(plughandle_t *handle, LV2_URID key, uint32_t offset,
+	uint32_t length, uint32_t size, const void *body)
+{
+	ser_atom_t ser;
+	ser_atom_init(&ser);
+	ser_atom_reset(&ser, &handle->forge);
+
+	LV2_Atom_Forge_Ref ref = 1;
+
+	const bool spliced = props_splice(&handle->props, &handle->forge, 0, key,
+		offset, length, size, body, &ref);
+
+	if(spliced)
+	{
+		const LV2_Atom_Event *ev = (const LV2_Atom_Event *)ser_atom_get(&ser);
+		const LV2_Atom *atom = &ev->body;
+		handle->writer(handle->controller, 0, lv2_atom_total_size(atom),
+			handle->atom_eventTransfer, atom);
+	}
+
+	ser_atom_deinit(&ser);
+
+	return spliced;
+}
+
 static void
 _message_get(plughandle_t *handle, LV2_URID key)
 {
@@ -495,6 +669,157 @@ _expose_image_copy(plughandle_t *handle, const d2tk_rect_t *rect)
 	}
 }
 
+static int
+_image_equal(int fd, const void *buf, size_t len)
+{
+	struct stat st;
+
+	// only ever reuse own regular files
+	if(  (fstat(fd, &st) == -1) || !S_ISREG(st.st_mode)
+		|| (st.st_uid != getuid()) || ((size_t)st.st_size != len) )
+	{
+		return 0;
+	}
+
+	void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	const int equal = !memcmp(map, buf, len);
+
+	munmap(map, len);
+
+	return equal;
+}
+
+// private per-user directory for images, must outlive this instance
+static int
+_image_dir(plughandle_t *handle)
+{
+	if(handle->img_dir[0])
+	{
+		return 0;
+	}
+
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	if(runtime && (runtime[0] == '/'))
+	{
+		snprintf(handle->img_dir, sizeof(handle->img_dir), "%s/notes.lv2", runtime);
+	}
+	else
+	{
+		snprintf(handle->img_dir, sizeof(handle->img_dir), "/tmp/notes-%u",
+			(unsigned)getuid());
+	}
+
+	if( (mkdir(handle->img_dir, 0700) == 0) || (errno == EEXIST) )
+	{
+		struct stat st;
+
+		if(  (lstat(handle->img_dir, &st) == 0) && S_ISDIR(st.st_mode)
+			&& (st.st_uid == getuid()) && !(st.st_mode & (S_IRWXG | S_IRWXO)) )
+		{
+			return 0;
+		}
+	}
+
+	lv2_log_note(&handle->logger, "[%s] %s is not private, using a temporary one",
+		__func__, handle->img_dir);
+
+	snprintf(handle->img_dir, sizeof(handle->img_dir), "/tmp/notes-XXXXXX");
+	if(!mkdtemp(handle->img_dir))
+	{
+		lv2_log_error(&handle->logger, "[%s] mkdtemp failed: %s", __func__,
+			strerror(errno));
+
+		handle->img_dir[0] = '\0';
+
+		return 1;
+	}
+
+	return 0;
+}
+
+// store image content-addressed, identical pastes end up in the same file,
+// the store is scratch space and props_save copies referenced images into the
+// session, so files here are not reference counted
+static int
+_image_store(plughandle_t *handle, const void *buf, size_t len,
+	const char *suffix, char *img, size_t img_len)
+{
+	if(_image_dir(handle) != 0)
+	{
+		return 1;
+	}
+
+	const uint64_t hash = d2tk_hash(buf, len);
+
+	snprintf(img, img_len, "%s/%016"PRIx64".%s", handle->img_dir, hash, suffix);
+
+	const int fd = open(img, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd != -1)
+	{
+		const int equal = _image_equal(fd, buf, len);
+
+		close(fd);
+
+		if(equal)
+		{
+			return 0; // already in store
+		}
+
+		lv2_log_note(&handle->logger, "[%s] hash collision for %s", __func__, img);
+	}
+
+	char template [PATH_MAX];
+	snprintf(template, sizeof(template), "%s/.XXXXXX.%s", handle->img_dir, suffix);
+
+	const int tmp = mkstemps(template, strlen(suffix) + 1);
+	if(tmp == -1)
+	{
+		lv2_log_error(&handle->logger, "[%s] mkstemps failed: %s", __func__,
+			strerror(errno));
+
+		return 1;
+	}
+
+	if(write(tmp, buf, len) != (ssize_t)len)
+	{
+		lv2_log_error(&handle->logger, "[%s] write failed %s", __func__,
+			strerror(errno));
+
+		close(tmp);
+		unlink(template);
+
+		return 1;
+	}
+
+	close(tmp);
+
+	if(fd != -1)
+	{
+		// keep colliding file as is, use unique temporary file instead
+		snprintf(img, img_len, "%s", template);
+
+		return 0;
+	}
+
+	// publish atomically, other instances may store the same image concurrently
+	if(rename(template, img) == -1)
+	{
+		lv2_log_error(&handle->logger, "[%s] rename failed %s", __func__,
+			strerror(errno));
+
+		unlink(template);
+
+		return 1;
+	}
+
+	return 0;
+}
+
 static void
 _expose_image_paste(plughandle_t *handle, const d2tk_rect_t *rect)
 {
@@ -518,31 +843,14 @@ _expose_image_paste(plughandle_t *handle, const d2tk_rect_t *rect)
 			const char *suffix = strchr(mime, '/');
 			suffix += 1;
 
-			char template [24];
-			snprintf(template, sizeof(template), "/tmp/XXXXXX.%s", suffix);
+			char img [PATH_MAX];
 
-			const int fd = mkstemps(template, strlen(suffix) + 1);
-			if(fd == -1)
+			if(_image_store(handle, txt, txt_len, suffix, img, sizeof(img)) == 0)
 			{
-				lv2_log_error(&handle->logger, "[%s] mkstemps failed: %s", __func__,
-					strerror(errno));
-			}
-			else
-			{
-				if(write(fd, txt, txt_len) == -1)
-				{
-					lv2_log_error(&handle->logger, "[%s] write failed %s", __func__,
-						strerror(errno));
-				}
-				else
-				{
-					_update_image(handle, template, strlen(template) + 1);
-
-					lv2_log_note(&handle->logger, "[%s] paste saved as %s", __func__,
-						template);
-				}
+				_update_image(handle, img, strlen(img) + 1);
 
-				close(fd);
+				lv2_log_note(&handle->logger, "[%s] paste saved as %s", __func__,
+					img);
 			}
 		}
 		else
@@ -600,16 +908,323 @@ _expose_image_body(plughandle_t *handle, const d2tk_rect_t *rect)
  * sublime3      (needs to be started with -w)
  */
 
+/* key sequences making console editors reread the file in place, thus
+ * keeping their undo history and sparing a respawn, unsaved changes in the
+ * editor are never discarded */
+static const reload_t reloads [] = {
+	{ .editor = "vi",    .keys = "\033:e\r" }, // refused when modified
+	{ .editor = "vim",   .keys = "\034\016:if !&modified | edit | endif\r" }, // CTRL-\ CTRL-N from any mode
+	{ .editor = "nvim",  .keys = "\034\016:if !&modified | edit | endif\r" },
+	{ .editor = "kak",   .keys = "\033:evaluate-commands %sh{ [ $kak_modified = false ] && echo edit! }\r" },
+	{ .editor = "emacs", .arg = "-nw", .keys = "\007\033:(unless (buffer-modified-p) (revert-buffer t t t))\r" }, // no prompt
+	{ .editor = NULL } // sentinel
+};
+
+static void
+_unescape(char *dst, size_t len, const char *src)
+{
+	char *end = dst + len - 1;
+
+	for( ; *src && (dst < end); src++)
+	{
+		if( (src[0] != '\\') || !src[1])
+		{
+			*dst++ = *src;
+			continue;
+		}
+
+		switch(*++src)
+		{
+			case 'e':
+			{
+				*dst++ = '\033';
+			} break;
+			case 'r':
+			{
+				*dst++ = '\r';
+			} break;
+			case 'n':
+			{
+				*dst++ = '\n';
+			} break;
+			case 't':
+			{
+				*dst++ = '\t';
+			} break;
+			default:
+			{
+				*dst++ = *src;
+			} break;
+		}
+	}
+
+	*dst = '\0';
+}
+
+static const char *
+_reload_keys(plughandle_t *handle)
+{
+	const char *keys = getenv("NOTES_RELOAD");
+
+	if(keys)
+	{
+		if(!*keys)
+		{
+			return NULL; // always respawn
+		}
+
+		_unescape(handle->reload_buf, sizeof(handle->reload_buf), keys);
+
+		return handle->reload_buf;
+	}
+
+	char **argv = handle->wordexp.we_wordv;
+	const char *slash = strrchr(argv[0], '/');
+	const char *name = slash ? slash + 1 : argv[0];
+
+	for(const reload_t *reload = reloads; reload->editor; reload++)
+	{
+		if(strcmp(name, reload->editor) != 0)
+		{
+			continue;
+		}
+
+		if(!reload->arg)
+		{
+			return reload->keys;
+		}
+
+		for(char **arg = &argv[1]; *arg; arg++)
+		{
+			if(strcmp(*arg, reload->arg) == 0)
+			{
+				return reload->keys;
+			}
+		}
+	}
+
+	return NULL; // unsupported, fall back to respawning
+}
+
+static void
+_update_text(plughandle_t *handle, const char *txt, size_t txt_len);
+
+static void
+_expose_text_builtin(plughandle_t *handle, const d2tk_rect_t *rect)
+{
+	d2tk_frontend_t *dpugl = handle->dpugl;
+	d2tk_base_t *base = d2tk_frontend_get_base(dpugl);
+
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+	const char *txt = impl->value.size ? impl->value.body : "";
+	size_t txt_len = impl->value.size;
+
+	d2tk_flag_t flag = D2TK_FLAG_NONE;
+	if(handle->reinit)
+	{
+		flag |= D2TK_FLAG_TEXTEDIT_RELOAD;
+	}
+
+	if(d2tk_base_textedit_is_changed(base, D2TK_ID, &txt_len, &txt,
+		handle->font_height, rect, flag))
+	{
+		_update_text(handle, txt, txt_len);
+	}
+
+	handle->reinit = false;
+}
+
+static void
+_expose_preview_link(plughandle_t *handle, d2tk_id_t id, const md_block_t *block,
+	const md_row_t *row, float mul, const d2tk_rect_t *rect)
+{
+	d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+
+	char url [PATH_MAX];
+	snprintf(url, sizeof(url), "%.*s", (int)row->url_size,
+		&block->text[row->url_offset]);
+
+	const d2tk_state_t state = d2tk_base_link(base, id, row->size,
+		&block->text[row->offset], mul, rect, D2TK_ALIGN_MIDDLE | D2TK_ALIGN_LEFT);
+
+	if(d2tk_state_is_changed(state))
+	{
+		char *argv [] = {
+			"xdg-open",
+			url,
+			NULL
+		};
+
+		d2tk_util_kill(&handle->kid);
+		handle->kid = d2tk_util_spawn(argv);
+		if(handle->kid <= 0)
+		{
+			lv2_log_error(&handle->logger, "[%s] failed to spawn: %s '%s'", __func__,
+				argv[0], argv[1]);
+		}
+	}
+	if(d2tk_state_is_over(state))
+	{
+		d2tk_base_set_tooltip(base, -1, url, handle->tip_height);
+	}
+}
+
+static void
+_expose_preview_row(plughandle_t *handle, d2tk_id_t id, const md_block_t *block,
+	const md_row_t *row, const d2tk_rect_t *rect)
+{
+	d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+
+	const d2tk_style_t *old_style = d2tk_base_get_style(base);
+	d2tk_style_t style = *old_style;
+	d2tk_rect_t bnd = *rect;
+	float mul = 0.8f;
+
+	switch( (md_kind_t)row->kind)
+	{
+		case MD_HEADING:
+		{
+			static const float muls [7] = {
+				1.f, 1.f, .95f, .9f, .85f, .8f, .8f
+			};
+
+			style.font_face = "FiraSans:bold";
+			style.text_stroke_color[D2TK_TRIPLE_NONE] = 0xffcf00ff;
+			mul = muls[row->level];
+		} break;
+		case MD_RULE:
+		{
+			d2tk_base_separator(base, rect, D2TK_FLAG_SEPARATOR_Y);
+		} return;
+		case MD_QUOTE:
+		{
+			style.font_face = "FiraCode:light";
+			style.text_stroke_color[D2TK_TRIPLE_NONE] = 0xbbbbbbff;
+			bnd.x += rect->h;
+			bnd.w -= rect->h;
+		} break;
+		case MD_ITEM:
+		{
+			style.font_face = "FiraCode:regular";
+			bnd.x += row->level * rect->h;
+			bnd.w -= row->level * rect->h;
+		} break;
+		case MD_CODE:
+		{
+			style.font_face = "FiraCode:regular";
+			style.text_fill_color[D2TK_TRIPLE_NONE] = 0x111111ff;
+		} break;
+		case MD_TEXT:
+			// fall-through
+		default:
+		{
+			style.font_face = "FiraCode:regular";
+		} break;
+	}
+
+	if(bnd.w <= 0)
+	{
+		return;
+	}
+
+	if(row->url_size)
+	{
+		style.text_stroke_color[D2TK_TRIPLE_NONE] = 0x7fbfffff;
+	}
+
+	d2tk_base_set_style(base, &style);
+
+	if(row->url_size)
+	{
+		_expose_preview_link(handle, id, block, row, mul, &bnd);
+	}
+	else
+	{
+		d2tk_base_label(base, row->size, &block->text[row->offset], mul, &bnd,
+			D2TK_ALIGN_MIDDLE | D2TK_ALIGN_LEFT);
+	}
+
+	d2tk_base_set_style(base, old_style);
+}
+
+static void
+_expose_text_preview(plughandle_t *handle, const d2tk_rect_t *rect)
+{
+	d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+	md_t *md = &handle->md;
+
+	// only reparse blocks touched since last frame
+	if(handle->md_dirty)
+	{
+		props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+		const char *txt = impl->value.size ? impl->value.body : "";
+
+		if(_md_update(md, txt, strnlen(txt, impl->value.size)) < 0)
+		{
+			lv2_log_error(&handle->logger, "[%s] failed to parse text", __func__);
+		}
+
+		handle->md_dirty = false;
+	}
+
+	const uint32_t nrows = (rect->h > handle->font_height)
+		? rect->h / handle->font_height
+		: 1;
+	const uint32_t max [2] = { 0, md->nrows };
+	const uint32_t num [2] = { 0, nrows };
+	D2TK_BASE_SCROLLBAR(base, rect, D2TK_ID, D2TK_FLAG_SCROLL_Y, max, num, vscroll)
+	{
+		const uint32_t offset = d2tk_scrollbar_get_offset_y(vscroll);
+		const d2tk_rect_t *sub = d2tk_scrollbar_get_rect(vscroll);
+		uint32_t b = _md_find(md, offset);
+
+		// only lay out rows within viewport
+		D2TK_BASE_TABLE(sub, 1, nrows, D2TK_FLAG_TABLE_REL, tab)
+		{
+			const uint32_t k = d2tk_table_get_index(tab) + offset;
+			const d2tk_rect_t *bnd = d2tk_table_get_rect(tab);
+
+			if(k >= md->nrows)
+			{
+				break;
+			}
+
+			while(k >= md->block[b].row0 + md->block[b].nrows)
+			{
+				b++;
+			}
+
+			const md_block_t *block = &md->block[b];
+
+			_expose_preview_row(handle, D2TK_ID_IDX(k), block,
+				&block->row[k - block->row0], bnd);
+		}
+	}
+}
+
 static void
 _expose_text_body(plughandle_t *handle, const d2tk_rect_t *rect)
 {
 	d2tk_frontend_t *dpugl = handle->dpugl;
 	d2tk_base_t *base = d2tk_frontend_get_base(dpugl);
 
+	if(handle->preview)
+	{
+		_expose_text_preview(handle, rect);
+		return;
+	}
+
+	if(handle->builtin)
+	{
+		_expose_text_builtin(handle, rect);
+		return;
+	}
+
 	char **args = handle->wordexp.we_wordv;
+	const char *keys = handle->reload_keys;
 
 	d2tk_flag_t flag = D2TK_FLAG_NONE;
-	if(handle->reinit)
+	if(handle->reinit && !keys)
 	{
 		flag |= D2TK_FLAG_PTY_REINIT;
 	}
@@ -617,6 +1232,11 @@ _expose_text_body(plughandle_t *handle, const d2tk_rect_t *rect)
 	D2TK_BASE_PTY(base, D2TK_ID, NULL, args, handle->font_height, rect, flag, pty)
 	{
 		const d2tk_state_t state = d2tk_pty_get_state(pty);
+
+		if(handle->reinit && keys)
+		{
+			d2tk_pty_send(pty, keys, strlen(keys));
+		}
 		const uint32_t max_red = d2tk_pty_get_max_red(pty);
 
 		if(max_red != handle->max_red)
@@ -681,6 +1301,46 @@ _expose_text_load(plughandle_t *handle, const d2tk_rect_t *rect)
 static void
 _update_text(plughandle_t *handle, const char *txt, size_t txt_len)
 {
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+
+	txt_len = strnlen(txt, txt_len);
+
+	// only send the changed range to the plugin, if we have a base to diff
+	if(impl->value.size > 0)
+	{
+		const char *old = impl->value.body;
+		const size_t old_len = impl->value.size - 1; // without zero-terminator
+		const size_t min_len = (old_len < txt_len) ? old_len : txt_len;
+
+		size_t head = 0;
+		while( (head < min_len) && (old[head] == txt[head]) )
+		{
+			head++;
+		}
+
+		size_t tail = 0;
+		while( (tail < min_len - head)
+			&& (old[old_len - 1 - tail] == txt[txt_len - 1 - tail]) )
+		{
+			tail++;
+		}
+
+		const size_t length = old_len - head - tail;
+		const size_t size = txt_len - head - tail;
+
+		if( (length == 0) && (size == 0) )
+		{
+			return; // nothing changed
+		}
+
+		if(_message_splice(handle, handle->urid_text, head, length, size,
+			&txt[head]))
+		{
+			_text_changed(handle, impl);
+			return;
+		}
+	}
+
 	ser_atom_t ser;
 	ser_atom_init(&ser);
 	ser_atom_reset(&ser, &handle->forge);
@@ -689,9 +1349,9 @@ _update_text(plughandle_t *handle, const char *txt, size_t txt_len)
 
 	const LV2_Atom *atom = ser_atom_get(&ser);
 
-	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
 	_props_impl_set(&handle->props, impl, atom->type, atom->size,
 		LV2_ATOM_BODY_CONST(atom));
+	_text_changed(handle, impl);
 
 	ser_atom_deinit(&ser);
 
@@ -714,6 +1374,7 @@ _expose_text_clear(plughandle_t *handle, const d2tk_rect_t *rect)
 	if(d2tk_state_is_changed(state))
 	{
 		_update_text(handle, none, sizeof(none) - 1);
+		_file_dirty(handle); // echo is detected as unchanged
 	}
 	if(d2tk_state_is_over(state))
 	{
@@ -735,8 +1396,11 @@ _expose_text_copy(plughandle_t *handle, const d2tk_rect_t *rect)
 
 	if(d2tk_state_is_changed(state))
 	{
+		props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+		const char *txt = impl->value.size ? impl->value.body : "";
+
 		d2tk_frontend_set_clipboard(dpugl, "UTF8_STRING",
-			handle->state.text, strlen(handle->state.text) + 1);
+			txt, strlen(txt) + 1);
 	}
 	if(d2tk_state_is_over(state))
 	{
@@ -765,6 +1429,7 @@ _expose_text_paste(plughandle_t *handle, const d2tk_rect_t *rect)
 		if(txt && txt_len && mime && !strcmp(mime, "UTF8_STRING"))
 		{
 			_update_text(handle, txt, txt_len);
+			_file_dirty(handle); // echo is detected as unchanged
 		}
 		else
 		{
@@ -805,6 +1470,9 @@ _expose_text_link(plughandle_t *handle, const d2tk_rect_t *rect)
 			NULL
 		};
 
+		// external application must not see a debounced, stale file
+		_file_flush(handle, true);
+
 		d2tk_util_kill(&handle->kid);
 		handle->kid = d2tk_util_spawn(argv);
 		if(handle->kid <= 0)
@@ -821,6 +1489,46 @@ _expose_text_link(plughandle_t *handle, const d2tk_rect_t *rect)
 	d2tk_util_wait(&handle->kid);
 }
 
+static void
+_expose_text_builtin_toggle(plughandle_t *handle, const d2tk_rect_t *rect)
+{
+	d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+
+	static const char lbl [] = "Aa";
+	static const char *tip [2] = { "use built-in editor", "use external editor" };
+
+	const d2tk_state_t state = d2tk_base_toggle_label(base, D2TK_ID,
+		-1, lbl, D2TK_ALIGN_CENTERED, rect, &handle->builtin);
+
+	if(d2tk_state_is_changed(state))
+	{
+		// built-in edits are not written out, bring file up to date for editor
+		_file_dirty(handle);
+		_file_flush(handle, true);
+	}
+	if(d2tk_state_is_over(state))
+	{
+		d2tk_base_set_tooltip(base, -1, tip[handle->builtin], handle->tip_height);
+	}
+}
+
+static void
+_expose_text_preview_toggle(plughandle_t *handle, const d2tk_rect_t *rect)
+{
+	d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+
+	static const char lbl [] = "md";
+	static const char *tip [2] = { "show preview", "show editor" };
+
+	const d2tk_state_t state = d2tk_base_toggle_label(base, D2TK_ID,
+		-1, lbl, D2TK_ALIGN_CENTERED, rect, &handle->preview);
+
+	if(d2tk_state_is_over(state))
+	{
+		d2tk_base_set_tooltip(base, -1, tip[handle->preview], handle->tip_height);
+	}
+}
+
 static void
 _expose_text_minimize(plughandle_t *handle, const d2tk_rect_t *rect)
 {
@@ -847,10 +1555,10 @@ _expose_text_minimize(plughandle_t *handle, const d2tk_rect_t *rect)
 static void
 _expose_text_footer(plughandle_t *handle, const d2tk_rect_t *rect)
 {
-	const d2tk_coord_t frac [7] = {
-		0, 0, rect->h, rect->h, rect->h, rect->h, rect->h
+	const d2tk_coord_t frac [9] = {
+		0, 0, rect->h, rect->h, rect->h, rect->h, rect->h, rect->h, rect->h
 	};
-	D2TK_BASE_LAYOUT(rect, 7, frac, D2TK_FLAG_LAYOUT_X_ABS, lay)
+	D2TK_BASE_LAYOUT(rect, 9, frac, D2TK_FLAG_LAYOUT_X_ABS, lay)
 	{
 		const unsigned k = d2tk_layout_get_index(lay);
 		const d2tk_rect_t *lrect = d2tk_layout_get_rect(lay);
@@ -884,6 +1592,14 @@ _expose_text_footer(plughandle_t *handle, const d2tk_rect_t *rect)
 #endif
 			} break;
 			case 6:
+			{
+				_expose_text_builtin_toggle(handle, lrect);
+			} break;
+			case 7:
+			{
+				_expose_text_preview_toggle(handle, lrect);
+			} break;
+			case 8:
 			{
 				_expose_text_minimize(handle, lrect);
 			} break;
@@ -1189,16 +1905,42 @@ instantiate(const LV2UI_Descriptor *descriptor,
 		return NULL;
 	}
 
-	strncpy(handle->template, "/tmp/XXXXXX.md", sizeof(handle->template));
-	handle->fd = mkstemps(handle->template, 3);
-	if(handle->fd == -1)
+	// private directory, so it can be watched without noise from others
+	_chunks_init(&handle->chunks);
+	_md_init(&handle->md);
+
+	strncpy(handle->dir, "/tmp/notes-XXXXXX", sizeof(handle->dir));
+	if(!mkdtemp(handle->dir))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	snprintf(handle->template, sizeof(handle->template), "%s/%s",
+		handle->dir, TEMPLATE_NAME);
+	const int fd = open(handle->template, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd == -1)
 	{
+		rmdir(handle->dir);
 		free(handle);
 		return NULL;
 	}
+	close(fd);
 
 	lv2_log_note(&handle->logger, "template: %s\n", handle->template);
 
+#if defined(__linux__)
+	struct statfs sfs;
+	if( (statfs(handle->dir, &sfs) == 0) && (sfs.f_type == TMPFS_MAGIC) )
+	{
+		handle->volatile_fs = true;
+	}
+#endif
+
+	// debounce interval of text updates before writing to disk
+	const char *debounce = getenv("NOTES_DEBOUNCE_MS");
+	handle->debounce = debounce ? strtoul(debounce, NULL, 10) : DEBOUNCE_MS;
+
 	static const char *fallback= "vi";
 	const char *editor = getenv("EDITOR");
 	char cmdline [PATH_MAX];
@@ -1212,6 +1954,12 @@ instantiate(const LV2UI_Descriptor *descriptor,
 		return NULL;
 	}
 
+	handle->reload_keys = _reload_keys(handle);
+
+	// use built-in editor instead of spawning one
+	const char *builtin = getenv("NOTES_BUILTIN_EDITOR");
+	handle->builtin = builtin && (atoi(builtin) != 0);
+
 	handle->controller = controller;
 	handle->writer = write_function;
 
@@ -1256,6 +2004,29 @@ instantiate(const LV2UI_Descriptor *descriptor,
 		handle->scale = d2tk_frontend_get_scale(handle->dpugl);
 	}
 
+	handle->ifd = -1;
+#if defined(__linux__)
+	// get notified about editor saves instead of polling modification time
+	handle->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(handle->ifd == -1)
+	{
+		lv2_log_error(&handle->logger, "inotify_init1: %s\n", strerror(errno));
+	}
+	else if(inotify_add_watch(handle->ifd, handle->dir,
+		IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+	{
+		lv2_log_error(&handle->logger, "inotify_add_watch: %s\n", strerror(errno));
+		close(handle->ifd);
+		handle->ifd = -1;
+	}
+	else
+	{
+		d2tk_base_t *base = d2tk_frontend_get_base(handle->dpugl);
+
+		d2tk_base_add_file_descriptor(base, handle->ifd);
+	}
+#endif
+
 	handle->header_height = 32 * handle->scale;
 	handle->footer_height = 32 * handle->scale;
 	handle->tip_height = 20 * handle->scale;
@@ -1289,8 +2060,24 @@ cleanup(LV2UI_Handle instance)
 
 	wordfree(&handle->wordexp);
 
+	if(handle->ifd != -1)
+	{
+		close(handle->ifd);
+	}
+
 	unlink(handle->template);
-	close(handle->fd);
+	rmdir(handle->dir);
+
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->urid_text);
+	if(impl)
+	{
+		_text_free(handle, impl->value.body);
+		_text_free(handle, impl->stash.body);
+	}
+
+	_chunks_deinit(&handle->chunks);
+	_md_deinit(&handle->md);
+
 	free(handle);
 }
 
@@ -1321,41 +2108,115 @@ port_event(LV2UI_Handle instance, uint32_t index __attribute__((unused)),
 static void
 _file_read(plughandle_t *handle)
 {
-	lseek(handle->fd, 0, SEEK_SET);
-	const size_t txt_len = lseek(handle->fd, 0, SEEK_END);
+	const int fd = open(handle->template, O_RDONLY);
+	if(fd == -1)
+	{
+		lv2_log_error(&handle->logger, "open: %s\n", strerror(errno));
+		return;
+	}
 
-	lseek(handle->fd, 0, SEEK_SET);
+	const size_t txt_len = lseek(fd, 0, SEEK_END);
+	lseek(fd, 0, SEEK_SET);
 
-	char *txt = alloca(txt_len + 1);
+	char *txt = malloc(txt_len + 1);
 	if(!txt)
 	{
+		close(fd);
 		return;
 	}
 
-	read(handle->fd, txt, txt_len);
-	txt[txt_len] = '\0';
+	const ssize_t len = read(fd, txt, txt_len);
+	close(fd);
 
-	handle->hash = d2tk_hash(txt, txt_len);
+	txt[len > 0 ? len : 0] = '\0';
 
-	_update_text(handle, txt, txt_len);
+	// our own writes are detected as unchanged
+	_update_text(handle, txt, strlen(txt));
+
+	free(txt);
 }
 
+#if defined(__linux__)
+static bool
+_file_changed(plughandle_t *handle)
+{
+	uint8_t buf [sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds = {
+		.fd = handle->ifd,
+		.events = POLLIN
+	};
+	bool changed = false;
+	ssize_t len;
+
+	if(poll(&fds, 1, 0) != 1)
+	{
+		return false; // nothing pending
+	}
+
+	// drain all pending events
+	while( (len = read(handle->ifd, buf, sizeof(buf))) > 0)
+	{
+		for(const uint8_t *ptr = buf; ptr < buf + len; )
+		{
+			const struct inotify_event *ev = (const struct inotify_event *)ptr;
+
+			if(ev->mask & IN_Q_OVERFLOW)
+			{
+				// events got lost, thus reread anyway
+				handle->renames = 0;
+				changed = true;
+			}
+			else if(!ev->len || strcmp(ev->name, TEMPLATE_NAME))
+			{
+				// not our file
+			}
+			else if( (ev->mask & IN_MOVED_TO) && handle->renames)
+			{
+				handle->renames--; // caused by _file_flush
+			}
+			else
+			{
+				changed = true;
+			}
+
+			ptr += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+
+	return changed;
+}
+#endif
+
 static int
 _idle(LV2UI_Handle instance)
 {
 	plughandle_t *handle = instance;
 
-	struct stat st;
-	if(stat(handle->template, &st) == -1)
+	_file_flush(handle, false);
+
+#if defined(__linux__)
+	if(handle->ifd != -1)
 	{
-		lv2_log_error(&handle->logger, "stat: %s\n", strerror(errno));
+		if(_file_changed(handle))
+		{
+			_file_read(handle);
+		}
 	}
-
-	if( (st.st_mtime > handle->modtime) && (handle->modtime > 0) )
+	else
+#endif
 	{
-		_file_read(handle);
+		struct stat st;
+		if(stat(handle->template, &st) == -1)
+		{
+			lv2_log_error(&handle->logger, "stat: %s\n", strerror(errno));
+		}
+		else if( (st.st_mtime > handle->modtime) && (handle->modtime > 0) )
+		{
+			_file_read(handle);
 
-		handle->modtime = st.st_mtime;
+			handle->modtime = st.st_mtime;
+		}
 	}
 
 	if(d2tk_frontend_step(handle->dpugl))
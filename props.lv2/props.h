@@ -25,6 +25,21 @@ extern "C" {
 #include <stdlib.h>
 #include <stdatomic.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#	include <sys/ioctl.h>
+#	include <sys/sendfile.h>
+#	include <linux/fs.h>
+#endif
+
+#if !defined(O_BINARY)
+#	define O_BINARY 0
+#endif
 
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/ext/urid/urid.h>
@@ -37,6 +52,19 @@ extern "C" {
  * API START
  *****************************************************************************/
 
+#define LV2_PROPS_URI    "http://open-music-kontrollers.ch/lv2/props"
+#define LV2_PROPS_PREFIX LV2_PROPS_URI "#"
+
+#define LV2_PROPS__Splice LV2_PROPS_PREFIX "Splice"
+#define LV2_PROPS__offset LV2_PROPS_PREFIX "offset"
+#define LV2_PROPS__length LV2_PROPS_PREFIX "length"
+#define LV2_PROPS__size   LV2_PROPS_PREFIX "size"
+#define LV2_PROPS__hash   LV2_PROPS_PREFIX "hash"
+#define LV2_PROPS__origin LV2_PROPS_PREFIX "origin"
+
+#define PROPS_SPLICE_CONTEXT 16 // bytes around a splice covered by its base hash
+#define PROPS_PENDING_MAX    64 // maximal number of unacknowledged splices
+
 // structures
 typedef struct _props_def_t props_def_t;
 typedef struct _props_impl_t props_impl_t;
@@ -55,6 +83,12 @@ typedef void (*props_event_cb_t)(
 	int64_t frames,
 	props_impl_t *impl);
 
+typedef int (*props_resize_cb_t)(
+	void *data,
+	props_impl_t *impl,
+	uint32_t size,
+	const LV2_Atom_Object *obj);
+
 typedef void (*props_dyn_prop_cb_t)(
 	void *data,
 	props_dyn_ev_t ev,
@@ -71,6 +105,7 @@ struct _props_def_t {
 
 	uint32_t max_size;
 	props_event_cb_t event_cb;
+	props_resize_cb_t resize_cb;
 };
 
 struct _props_impl_t {
@@ -80,13 +115,21 @@ struct _props_impl_t {
 
 	struct {
 		uint32_t size;
+		uint32_t max_size;
 		void *body;
 	} value;
 	struct {
 		uint32_t size;
+		uint32_t max_size;
 		void *body;
 	} stash;
 
+	struct {
+		uint32_t offset;
+		uint32_t length;
+		uint32_t size;
+	} change; // extent of last value change, e.g. for incremental updates in event_cb
+
 	const props_def_t *def;
 
 	atomic_int state;
@@ -129,8 +172,16 @@ struct _props_t {
 		LV2_URID atom_vector;
 		LV2_URID atom_object;
 		LV2_URID atom_sequence;
+		LV2_URID atom_chunk;
 
 		LV2_URID state_StateChanged;
+
+		LV2_URID props_splice;
+		LV2_URID props_offset;
+		LV2_URID props_length;
+		LV2_URID props_size;
+		LV2_URID props_hash;
+		LV2_URID props_origin;
 	} urid;
 
 	void *data;
@@ -140,6 +191,11 @@ struct _props_t {
 
 	uint32_t max_size;
 
+	int32_t origin; // random tag of own splices
+	int32_t sequence_num;
+	unsigned npending;
+	int32_t pending [PROPS_PENDING_MAX]; // own splices in flight, oldest first
+
 	const props_dyn_t *dyn;
 
 	unsigned nimpls;
@@ -176,6 +232,12 @@ static inline void
 props_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	LV2_URID property, LV2_Atom_Forge_Ref *ref);
 
+// rt-safe
+static inline int
+props_splice(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t offset, uint32_t length,
+	uint32_t size, const void *body, LV2_Atom_Forge_Ref *ref);
+
 // rt-safe
 static inline void
 props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
@@ -185,6 +247,16 @@ props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 static inline void
 props_stash(props_t *props, LV2_URID property);
 
+// rt-safe, only from the thread owning the values (e.g. run)
+static inline void *
+props_value_swap(props_t *props, LV2_URID property, void *body,
+	uint32_t max_size);
+
+// rt-safe, fails if stash is busy
+static inline void *
+props_stash_swap(props_t *props, LV2_URID property, void *body,
+	uint32_t max_size);
+
 // rt-safe
 static inline LV2_URID
 props_map(props_t *props, const char *property);
@@ -355,6 +427,89 @@ _props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	return ref;
 }
 
+static inline LV2_Atom_Forge_Ref
+_props_patch_splice(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	props_impl_t *impl, uint32_t offset, uint32_t length, uint32_t size,
+	uint64_t hash, int32_t sequence_num, int32_t origin)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.props_splice);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(origin) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.props_origin);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, origin);
+		}
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, impl->property);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.props_offset);
+		if(ref)
+			ref = lv2_atom_forge_int(forge, offset);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.props_length);
+		if(ref)
+			ref = lv2_atom_forge_int(forge, length);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.props_size);
+		if(ref)
+			ref = lv2_atom_forge_int(forge, impl->value.size);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.props_hash);
+		if(ref)
+			ref = lv2_atom_forge_long(forge, hash);
+
+		// only the replacement bytes go over the wire
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(ref)
+			ref = lv2_atom_forge_atom(forge, size, props->urid.atom_chunk);
+		if(ref)
+			ref = lv2_atom_forge_write(forge, (const uint8_t *)impl->value.body + offset,
+				size);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.state_StateChanged);
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
 static inline LV2_Atom_Forge_Ref
 _props_patch_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	props_impl_t *impl, int32_t sequence_num)
@@ -395,7 +550,7 @@ _props_patch_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 
 static inline LV2_Atom_Forge_Ref
 _props_patch_error(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	int32_t sequence_num)
+	int32_t sequence_num, int32_t origin)
 {
 	LV2_Atom_Forge_Frame obj_frame;
 
@@ -408,6 +563,14 @@ _props_patch_error(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
 		if(ref)
 			ref = lv2_atom_forge_int(forge, sequence_num);
+
+		if(origin) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.props_origin);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, origin);
+		}
 	}
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
@@ -417,7 +580,7 @@ _props_patch_error(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 
 static inline LV2_Atom_Forge_Ref
 _props_patch_ack(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	int32_t sequence_num)
+	int32_t sequence_num, int32_t origin)
 {
 	LV2_Atom_Forge_Frame obj_frame;
 
@@ -430,6 +593,14 @@ _props_patch_ack(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
 		if(ref)
 			ref = lv2_atom_forge_int(forge, sequence_num);
+
+		if(origin) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.props_origin);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, origin);
+		}
 	}
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
@@ -437,10 +608,20 @@ _props_patch_ack(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	return ref;
 }
 
+static inline void
+_props_impl_change(props_impl_t *impl, uint32_t offset, uint32_t length,
+	uint32_t size)
+{
+	impl->change.offset = offset;
+	impl->change.length = length;
+	impl->change.size = size;
+}
+
 static inline void
 _props_impl_stash(props_t *props, props_impl_t *impl)
 {
-	if(_props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
+	if(  ( (impl->stash.max_size == 0) || (impl->value.size <= impl->stash.max_size) )
+		&& _props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
 	{
 		impl->stashing = false;
 		impl->stash.size = impl->value.size;
@@ -455,13 +636,58 @@ _props_impl_stash(props_t *props, props_impl_t *impl)
 	}
 }
 
+// apply a splice to an up-to-date stash instead of copying the whole value
+static inline void
+_props_impl_stash_splice(props_t *props, props_impl_t *impl, uint32_t offset,
+	uint32_t length, uint32_t size, uint32_t prev)
+{
+	if(  !impl->stashing && (impl->stash.size == prev)
+		&& ( (impl->stash.max_size == 0) || (impl->value.size <= impl->stash.max_size) )
+		&& _props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
+	{
+		uint8_t *dst = impl->stash.body;
+		const uint8_t *src = impl->value.body;
+
+		memmove(&dst[offset + size], &dst[offset + length], prev - offset - length);
+		memcpy(&dst[offset], &src[offset], size);
+		impl->stash.size = impl->value.size;
+
+		_props_impl_unlock(impl, PROP_STATE_NONE);
+	}
+	else
+	{
+		_props_impl_stash(props, impl); // stash is behind, copy whole value
+	}
+}
+
 static inline void
 _props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	props_impl_t *impl, LV2_Atom_Forge_Ref *ref)
 {
 	if(_props_impl_try_lock(impl, PROP_STATE_RESTORE, PROP_STATE_LOCK))
 	{
+		if(  impl->value.max_size
+			&& (impl->stash.size > impl->value.max_size) )
+		{
+			const uint32_t size = impl->stash.size;
+
+			_props_impl_unlock(impl, PROP_STATE_RESTORE);
+
+			const props_def_t *def = impl->def;
+			if(def->resize_cb && def->resize_cb(props->data, impl, size, NULL))
+			{
+				_props_restoring_set(props); // try again later
+			}
+			else
+			{
+				_props_impl_spin_lock(impl, PROP_STATE_RESTORE, PROP_STATE_NONE);
+			}
+
+			return;
+		}
+
 		impl->stashing = false; // makes no sense to stash a recently restored value
+		_props_impl_change(impl, 0, impl->value.size, impl->stash.size);
 		impl->value.size = impl->stash.size;
 		memcpy(impl->value.body, impl->stash.body, impl->stash.size);
 
@@ -476,13 +702,34 @@ _props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	}
 }
 
+static inline int
+_props_impl_reserve(props_t *props, props_impl_t *impl, uint32_t size,
+	const LV2_Atom_Object *obj)
+{
+	if( (impl->value.max_size == 0) || (size <= impl->value.max_size) )
+	{
+		return 1; // fits
+	}
+
+	const props_def_t *def = impl->def;
+	if(def->resize_cb && def->resize_cb(props->data, impl, size, obj))
+	{
+		return (size <= impl->value.max_size)
+			? 1 // has been resized in-place
+			: -1; // resize is pending
+	}
+
+	return 0; // does not fit
+}
+
 static inline void
 _props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
 	uint32_t size, const void *body)
 {
 	if(  (impl->type == type)
-		&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size)) )
+		&& (_props_impl_reserve(props, impl, size, NULL) == 1) )
 	{
+		_props_impl_change(impl, 0, impl->value.size, size);
 		impl->value.size = size;
 		memcpy(impl->value.body, body, size);
 
@@ -490,6 +737,127 @@ _props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
 	}
 }
 
+// FNV-1a over the base bytes around a splice, mixed with the base size
+static inline uint64_t
+_props_splice_hash(const uint8_t *base, uint32_t base_size, uint32_t offset,
+	uint32_t length)
+{
+	const uint32_t from = offset > PROPS_SPLICE_CONTEXT
+		? offset - PROPS_SPLICE_CONTEXT
+		: 0;
+	const uint64_t end = (uint64_t)offset + length + PROPS_SPLICE_CONTEXT;
+	const uint32_t to = end < base_size
+		? end
+		: base_size;
+
+	uint64_t hash = UINT64_C(0xcbf29ce484222325) ^ base_size;
+
+	for(uint32_t i = from; i < to; i++)
+	{
+		hash ^= base[i];
+		hash *= UINT64_C(0x100000001b3);
+	}
+
+	return hash;
+}
+
+static inline int
+_props_impl_splice(props_t *props, props_impl_t *impl, uint32_t offset,
+	uint32_t length, uint32_t total, uint32_t size, const void *body, uint64_t hash)
+{
+	const uint32_t max_size = impl->value.max_size;
+	uint8_t *dst = impl->value.body;
+
+	// only variable-sized properties can be spliced
+	if(!max_size || (total > max_size) || (size > total) || (offset > total - size))
+		return 0;
+
+	const uint64_t prev = (uint64_t)total - size + length;
+
+	// splice must have been made against the current value
+	if(  (prev != impl->value.size)
+		|| ((uint64_t)offset + length > prev)
+		|| (_props_splice_hash(dst, prev, offset, length) != hash) )
+		return 0;
+
+	memmove(&dst[offset + size], &dst[offset + length], prev - offset - length);
+	memcpy(&dst[offset], body, size);
+	impl->value.size = total;
+	_props_impl_change(impl, offset, length, size);
+
+	_props_impl_stash_splice(props, impl, offset, length, size, prev);
+
+	return 1;
+}
+
+// forget given own splice
+static inline int
+_props_pending_pop(props_t *props, int32_t origin, int32_t sequence_num)
+{
+	if(origin != props->origin)
+		return 0; // from another instance
+
+	for(unsigned i = 0; i < props->npending; i++)
+	{
+		if(props->pending[i] != sequence_num)
+			continue;
+
+		props->npending -= 1;
+		memmove(&props->pending[i], &props->pending[i + 1],
+			(props->npending - i) * sizeof(int32_t));
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static inline int32_t
+_props_pending_push(props_t *props)
+{
+	if(++props->sequence_num <= 0) // zero means no sequence number
+		props->sequence_num = 1;
+
+	if(props->npending == PROPS_PENDING_MAX) // drop oldest
+	{
+		props->npending -= 1;
+		memmove(props->pending, &props->pending[1],
+			props->npending * sizeof(int32_t));
+	}
+
+	props->pending[props->npending++] = props->sequence_num;
+
+	return props->sequence_num;
+}
+
+// random per-instance tag of own splices, echoes and acks of splices are
+// broadcast to all UIs, which may well use the same sequence numbers
+static inline int32_t
+_props_origin(const props_t *props)
+{
+	uint64_t x = (uintptr_t)props ^ ((uint64_t)time(NULL) << 32) ^ clock();
+
+	const int fd = open("/dev/urandom", O_RDONLY | O_BINARY);
+	if(fd != -1)
+	{
+		uint64_t r;
+
+		if(read(fd, &r, sizeof(r)) == sizeof(r))
+			x ^= r;
+
+		close(fd);
+	}
+
+	// splitmix64 finalizer
+	x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+	x ^= x >> 31;
+
+	const int32_t origin = (int32_t)(uint32_t)x;
+
+	return origin ? origin : 1; // zero means no origin
+}
+
 static inline int
 _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
 	void *value_base, void *stash_base, LV2_URID_Map *map)
@@ -548,7 +916,9 @@ _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
 
 	impl->type = type;
 	impl->value.size = size;
+	impl->value.max_size = def->max_size;
 	impl->stash.size = size;
+	impl->stash.max_size = def->max_size;
 
 	atomic_init(&impl->state, PROP_STATE_NONE);
 
@@ -607,9 +977,21 @@ props_init(props_t *props, const char *subject,
 	props->urid.atom_vector = map->map(map->handle, LV2_ATOM__Vector);
 	props->urid.atom_object = map->map(map->handle, LV2_ATOM__Object);
 	props->urid.atom_sequence = map->map(map->handle, LV2_ATOM__Sequence);
+	props->urid.atom_chunk = map->map(map->handle, LV2_ATOM__Chunk);
 
 	props->urid.state_StateChanged = map->map(map->handle, LV2_STATE__StateChanged);
 
+	props->urid.props_splice = map->map(map->handle, LV2_PROPS__Splice);
+	props->urid.props_offset = map->map(map->handle, LV2_PROPS__offset);
+	props->urid.props_length = map->map(map->handle, LV2_PROPS__length);
+	props->urid.props_size = map->map(map->handle, LV2_PROPS__size);
+	props->urid.props_hash = map->map(map->handle, LV2_PROPS__hash);
+	props->urid.props_origin = map->map(map->handle, LV2_PROPS__origin);
+
+	props->origin = _props_origin(props);
+	props->sequence_num = 0;
+	props->npending = 0;
+
 	atomic_init(&props->restoring, false);
 
 	int status = 1;
@@ -721,13 +1103,13 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			else if(sequence_num)
 			{
 				if(*ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
+					*ref = _props_patch_error(props, forge, frames, sequence_num, 0);
 			}
 		}
 		else if(sequence_num)
 		{
 			if(*ref)
-				*ref = _props_patch_error(props, forge, frames, sequence_num);
+				*ref = _props_patch_error(props, forge, frames, sequence_num, 0);
 		}
 	}
 	else if(obj->body.otype == props->urid.patch_set)
@@ -763,7 +1145,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			if(sequence_num)
 			{
 				if(ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
+					*ref = _props_patch_error(props, forge, frames, sequence_num, 0);
 			}
 
 			return 0;
@@ -772,6 +1154,11 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 		props_impl_t *impl = _props_impl_get(props, property->body);
 		if(impl)
 		{
+			if(_props_impl_reserve(props, impl, value->size, obj) == -1)
+			{
+				return 1; // message has been deferred until resized
+			}
+
 			_props_impl_set(props, impl, value->type, value->size,
 				LV2_ATOM_BODY_CONST(value));
 
@@ -786,7 +1173,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			if(sequence_num)
 			{
 				if(*ref)
-					*ref = _props_patch_ack(props, forge, frames, sequence_num);
+					*ref = _props_patch_ack(props, forge, frames, sequence_num, 0);
 			}
 
 			return 1;
@@ -802,8 +1189,122 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 		else if(sequence_num)
 		{
 			if(*ref)
-				*ref = _props_patch_error(props, forge, frames, sequence_num);
+				*ref = _props_patch_error(props, forge, frames, sequence_num, 0);
+		}
+	}
+	else if(obj->body.otype == props->urid.props_splice)
+	{
+		const LV2_Atom_URID *subject = NULL;
+		const LV2_Atom_URID *property = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom_Int *origin = NULL;
+		const LV2_Atom_Int *offset = NULL;
+		const LV2_Atom_Int *length = NULL;
+		const LV2_Atom_Int *size = NULL;
+		const LV2_Atom_Long *hash = NULL;
+		const LV2_Atom *value = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_subject, &subject,
+			props->urid.patch_property, &property,
+			props->urid.patch_sequence, &sequence,
+			props->urid.props_origin, &origin,
+			props->urid.props_offset, &offset,
+			props->urid.props_length, &length,
+			props->urid.props_size, &size,
+			props->urid.props_hash, &hash,
+			props->urid.patch_value, &value,
+			0);
+
+		// check for a matching optional subject
+		if(  (subject && props->urid.subject)
+			&& ( (subject->atom.type != props->urid.atom_urid)
+				|| (subject->body != props->urid.subject) ) )
+		{
+			return 0;
+		}
+
+		int32_t sequence_num = 0;
+		if(sequence && (sequence->atom.type == props->urid.atom_int))
+		{
+			sequence_num = sequence->body;
+		}
+
+		int32_t origin_num = 0;
+		if(origin && (origin->atom.type == props->urid.atom_int))
+		{
+			origin_num = origin->body;
+		}
+
+		props_impl_t *impl = NULL;
+		if(  property && (property->atom.type == props->urid.atom_urid)
+			&& offset && (offset->atom.type == props->urid.atom_int) && (offset->body >= 0)
+			&& length && (length->atom.type == props->urid.atom_int) && (length->body >= 0)
+			&& size && (size->atom.type == props->urid.atom_int) && (size->body >= 0)
+			&& hash && (hash->atom.type == props->urid.atom_long)
+			&& value && (value->type == props->urid.atom_chunk) )
+		{
+			impl = _props_impl_get(props, property->body);
+		}
+
+		if(!impl)
+		{
+			if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num,
+						origin_num);
+			}
+
+			return 0;
+		}
+
+		// echo of an own splice, which has been applied already
+		if(sequence_num && _props_pending_pop(props, origin_num, sequence_num))
+		{
+			_props_impl_change(impl, offset->body, 0, 0);
+			return 1;
+		}
+
+		if(_props_impl_reserve(props, impl, size->body, obj) == -1)
+		{
+			return 1; // message has been deferred until resized
+		}
+
+		if(!_props_impl_splice(props, impl, offset->body, length->body, size->body,
+			value->size, LV2_ATOM_BODY_CONST(value), hash->body))
+		{
+			// out of sync, resend whole value (e.g. to UI)
+			if(*ref && !impl->def->hidden)
+				*ref = _props_patch_set(props, forge, frames, impl, 0);
+
+			if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num,
+						origin_num);
+			}
+
+			return 0;
+		}
+
+		// send on (e.g. to UI)
+		if(*ref && !impl->def->hidden)
+			*ref = _props_patch_splice(props, forge, frames, impl, offset->body,
+				length->body, value->size, hash->body, sequence_num, origin_num);
+
+		const props_def_t *def = impl->def;
+		if(def->event_cb)
+			def->event_cb(props->data, frames, impl);
+
+		if(sequence_num)
+		{
+			if(*ref)
+				*ref = _props_patch_ack(props, forge, frames, sequence_num,
+					origin_num);
 		}
+
+		return 1;
 	}
 	else if(obj->body.otype == props->urid.patch_put)
 	{
@@ -836,7 +1337,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			if(sequence_num)
 			{
 				if(*ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
+					*ref = _props_patch_error(props, forge, frames, sequence_num, 0);
 			}
 
 			return 0;
@@ -850,6 +1351,11 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			props_impl_t *impl = _props_impl_get(props, property);
 			if(impl)
 			{
+				if(_props_impl_reserve(props, impl, value->size, obj) == -1)
+				{
+					return 1; // whole message has been deferred until resized
+				}
+
 				_props_impl_set(props, impl, value->type, value->size,
 					LV2_ATOM_BODY_CONST(value));
 
@@ -874,7 +1380,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 		if(sequence_num)
 		{
 			if(*ref)
-				*ref = _props_patch_ack(props, forge, frames, sequence_num);
+				*ref = _props_patch_ack(props, forge, frames, sequence_num, 0);
 		}
 
 		return 1;
@@ -935,11 +1441,31 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 
 		if(sequence_num && *ref)
 		{
-			*ref = _props_patch_ack(props, forge, frames, sequence_num);
+			*ref = _props_patch_ack(props, forge, frames, sequence_num, 0);
 		}
 
 		return 1;
 	}
+	else if( (obj->body.otype == props->urid.patch_ack)
+		|| (obj->body.otype == props->urid.patch_error) )
+	{
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom_Int *origin = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_sequence, &sequence,
+			props->urid.props_origin, &origin,
+			0);
+
+		// own splice has been handled (or rejected) by the other side
+		if(  sequence && (sequence->atom.type == props->urid.atom_int) && sequence->body
+			&& origin && (origin->atom.type == props->urid.atom_int) )
+		{
+			return _props_pending_pop(props, origin->body, sequence->body);
+		}
+
+		return 0;
+	}
 
 	return 0; // did not handle a patch event
 }
@@ -959,6 +1485,36 @@ props_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	}
 }
 
+static inline int
+props_splice(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t offset, uint32_t length,
+	uint32_t size, const void *body, LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || (length > impl->value.size))
+		return 0;
+
+	const uint64_t total = (uint64_t)impl->value.size - length + size;
+
+	if(  (total > UINT32_MAX)
+		|| (offset > impl->value.size - length)
+		|| (_props_impl_reserve(props, impl, total, NULL) != 1) )
+		return 0;
+
+	const uint64_t hash = _props_splice_hash(impl->value.body, impl->value.size,
+		offset, length);
+
+	if(!_props_impl_splice(props, impl, offset, length, total, size, body, hash))
+		return 0;
+
+	if(*ref && !impl->def->hidden)
+		*ref = _props_patch_splice(props, forge, frames, impl, offset, length, size,
+			hash, _props_pending_push(props), props->origin);
+
+	return 1;
+}
+
 static inline void
 props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	LV2_URID property, LV2_Atom_Forge_Ref *ref)
@@ -981,6 +1537,58 @@ props_stash(props_t *props, LV2_URID property)
 		_props_impl_stash(props, impl);
 }
 
+static inline void *
+props_value_swap(props_t *props, LV2_URID property, void *body,
+	uint32_t max_size)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || !impl->value.max_size || (impl->value.size > max_size))
+		return NULL;
+
+	void *old = impl->value.body;
+
+	memcpy(body, old, impl->value.size);
+	impl->value.body = body;
+	impl->value.max_size = max_size;
+
+	return old;
+}
+
+static inline void *
+props_stash_swap(props_t *props, LV2_URID property, void *body,
+	uint32_t max_size)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || !impl->stash.max_size)
+		return NULL;
+
+	// keep a pending restore pending
+	int state = PROP_STATE_NONE;
+	if(!_props_impl_try_lock(impl, state, PROP_STATE_LOCK))
+	{
+		state = PROP_STATE_RESTORE;
+		if(!_props_impl_try_lock(impl, state, PROP_STATE_LOCK))
+			return NULL;
+	}
+
+	void *old = NULL;
+
+	if(impl->stash.size <= max_size)
+	{
+		old = impl->stash.body;
+
+		memcpy(body, old, impl->stash.size);
+		impl->stash.body = body;
+		impl->stash.max_size = max_size;
+	}
+
+	_props_impl_unlock(impl, state);
+
+	return old;
+}
+
 static inline LV2_URID
 props_map(props_t *props, const char *uri)
 {
@@ -1006,36 +1614,213 @@ props_unmap(props_t *props, LV2_URID property)
 	return NULL;
 }
 
+#define PROPS_COPY_CHUNK 0x100000 // 1 M
+
+static inline int
+_file_equal(int dst, int src, off_t size)
+{
+	if(size == 0)
+	{
+		return 1;
+	}
+
+	uint8_t *buf = malloc(2*PROPS_COPY_CHUNK);
+	if(!buf)
+	{
+		return 0;
+	}
+
+	uint8_t *a = buf;
+	uint8_t *b = buf + PROPS_COPY_CHUNK;
+	int equal = 1;
+
+	if(  (lseek(dst, 0, SEEK_SET) == -1)
+		|| (lseek(src, 0, SEEK_SET) == -1) )
+	{
+		equal = 0;
+	}
+
+	for(off_t offset = 0; equal && (offset < size); )
+	{
+		const size_t len = (size - offset > PROPS_COPY_CHUNK)
+			? PROPS_COPY_CHUNK
+			: (size_t)(size - offset);
+
+		if(  (read(dst, a, len) != (ssize_t)len)
+			|| (read(src, b, len) != (ssize_t)len)
+			|| memcmp(a, b, len) )
+		{
+			equal = 0;
+		}
+
+		offset += len;
+	}
+
+	lseek(src, 0, SEEK_SET);
+
+	free(buf);
+
+	return equal;
+}
+
+static inline int
+_copy_fd(int dst, int src, off_t size)
+{
+	off_t offset = 0;
+
+#if defined(__linux__)
+	// share extents on copy-on-write filesystems
+	if(ioctl(dst, FICLONE, src) == 0)
+	{
+		return 0;
+	}
+
+	// in-kernel copy
+	while(offset < size)
+	{
+		const ssize_t n = copy_file_range(src, NULL, dst, NULL, size - offset, 0);
+
+		if(n <= 0)
+		{
+			break;
+		}
+
+		offset += n;
+	}
+
+	while(offset < size)
+	{
+		const ssize_t n = sendfile(dst, src, NULL, size - offset);
+
+		if(n <= 0)
+		{
+			break;
+		}
+
+		offset += n;
+	}
+
+	if(offset == size)
+	{
+		return 0;
+	}
+#endif
+
+	// user-space copy with large buffer
+	uint8_t *buf = malloc(PROPS_COPY_CHUNK);
+	if(!buf)
+	{
+		return 1;
+	}
+
+	if(  (lseek(src, offset, SEEK_SET) == -1)
+		|| (lseek(dst, offset, SEEK_SET) == -1) )
+	{
+		free(buf);
+
+		return 1;
+	}
+
+	ssize_t n;
+	while( (n = read(src, buf, PROPS_COPY_CHUNK)) > 0)
+	{
+		for(ssize_t written = 0; written < n; )
+		{
+			const ssize_t m = write(dst, buf + written, n - written);
+
+			if(m == -1)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+
+				free(buf);
+
+				return 1;
+			}
+
+			written += m;
+		}
+	}
+
+	free(buf);
+
+	return (n == -1) ? 1 : 0;
+}
+
 static inline int
 _copy_file(const char *to, const char *from)
 {
-	FILE *dst = NULL;
-	FILE *src = NULL;
-	int ch;
+	struct stat src_st;
+	struct stat dst_st;
 
-	dst = fopen(to, "wb");
-	if(!dst)
+	const int src = open(from, O_RDONLY | O_BINARY);
+	if(src == -1)
 	{
 		return 1;
 	}
 
-	src = fopen(from, "rb");
-	if(!src)
+	if(fstat(src, &src_st) == -1)
 	{
-		fclose(dst);
+		close(src);
 
 		return 1;
 	}
 
-	while( (ch = fgetc(src)) != EOF)
+	// skip copy if an identical file already is there
+	if(  (stat(to, &dst_st) == 0)
+		&& (dst_st.st_size == src_st.st_size) )
 	{
-		fputc(ch, dst);
+		if( (dst_st.st_dev == src_st.st_dev) && (dst_st.st_ino == src_st.st_ino) )
+		{
+			close(src);
+
+			return 0; // same file
+		}
+
+		const int dst = open(to, O_RDONLY | O_BINARY);
+		if(dst != -1)
+		{
+			const int equal = _file_equal(dst, src, src_st.st_size);
+
+			close(dst);
+
+			if(equal)
+			{
+				close(src);
+
+				return 0;
+			}
+		}
 	}
 
-	fclose(dst);
-	fclose(src);
+	unlink(to);
 
-	return 0;
+#if !defined(_WIN32)
+	// try to hard-link on same filesystem
+	if(link(from, to) == 0)
+	{
+		close(src);
+
+		return 0;
+	}
+#endif
+
+	const int dst = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if(dst == -1)
+	{
+		close(src);
+
+		return 1;
+	}
+
+	const int status = _copy_fd(dst, src, src_st.st_size);
+
+	close(dst);
+	close(src);
+
+	return status;
 }
 
 static inline void
@@ -1051,6 +1836,22 @@ _free_path(const LV2_State_Free_Path *free_path, char *path)
 	}
 }
 
+// files in /tmp or the per-user runtime directory do not outlive the session
+static inline bool
+_props_path_volatile(const char *path)
+{
+	if(strstr(path, "/tmp") == path)
+	{
+		return true;
+	}
+
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	const size_t len = runtime ? strlen(runtime) : 0;
+
+	return (len > 1) && (runtime[0] == '/')
+		&& !strncmp(path, runtime, len) && (path[len] == '/');
+}
+
 static inline LV2_State_Status
 props_save(props_t *props, LV2_State_Store_Function store,
 	LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features)
@@ -1078,71 +1879,65 @@ props_save(props_t *props, LV2_State_Store_Function store,
 		}
 	}
 
-	void *body = malloc(props->max_size); // create memory to store widest value
-	if(body)
+	for(unsigned i = 0; i < props->nimpls; i++)
 	{
-		for(unsigned i = 0; i < props->nimpls; i++)
-		{
-			props_impl_t *impl = &props->impls[i];
+		props_impl_t *impl = &props->impls[i];
 
-			if(impl->access == props->urid.patch_readable)
-				continue; // skip read-only, as it makes no sense to restore them
+		if(impl->access == props->urid.patch_readable)
+			continue; // skip read-only, as it makes no sense to restore them
 
-			// always clear memory
-			memset(body, 0x0, props->max_size);
+		// store() directly from the frozen stash, this may well be blocking, but
+		// rt-thread only ever tries to lock the stash and retries later
+		_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
 
-			_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
+		const uint32_t size = impl->stash.size;
+		const void *body = impl->stash.body;
 
-			// create temporary copy of value, store() may well be blocking
-			const uint32_t size = impl->stash.size;
-			memcpy(body, impl->stash.body, size);
+		if(  map_path && map_path->abstract_path
+			&& (impl->type == props->urid.atom_path) )
+		{
+			const char *path = (size == 0)
+				? ""
+				: strstr(body, "file://") == body
+					? (const char *)body + 7 // skip "file://"
+					: (const char *)body;
 
-			_props_impl_unlock(impl, PROP_STATE_NONE);
+			char *abstract = NULL;
 
-			if(  map_path && map_path->abstract_path
-				&& (impl->type == props->urid.atom_path) )
+			if(  make_path && make_path->path
+				&& _props_path_volatile(path) )
 			{
-				const char *path = strstr(body, "file://") == body
-					? (char *)body + 7 // skip "file://"
-					: (char *)body;
+				char *absolute = make_path->path(make_path->handle, basename(path));
 
-				char *abstract = NULL;
-
-				if(  make_path && make_path->path
-					&& (strstr(path, "/tmp") == path) )
+				if(absolute)
 				{
-					char *absolute = make_path->path(make_path->handle, basename(path));
-
-					if(absolute)
+					if(_copy_file(absolute, path) == 0)
 					{
-						if(_copy_file(absolute, path) == 0)
-						{
-							abstract = map_path->abstract_path(map_path->handle, absolute);
-						}
-
-						_free_path(free_path, absolute);
+						abstract = map_path->abstract_path(map_path->handle, absolute);
 					}
-				}
-				else
-				{
-					abstract = map_path->abstract_path(map_path->handle, path);
-				}
 
-				if(abstract)
-				{
-					const uint32_t sz = strlen(abstract) + 1;
-					store(state, impl->property, abstract, sz, impl->type, flags);
-
-					_free_path(free_path, abstract);
+					_free_path(free_path, absolute);
 				}
 			}
-			else // !Path
+			else
 			{
-				store(state, impl->property, body, size, impl->type, flags);
+				abstract = map_path->abstract_path(map_path->handle, path);
 			}
+
+			if(abstract)
+			{
+				const uint32_t sz = strlen(abstract) + 1;
+				store(state, impl->property, abstract, sz, impl->type, flags);
+
+				_free_path(free_path, abstract);
+			}
+		}
+		else // !Path
+		{
+			store(state, impl->property, body, size, impl->type, flags);
 		}
 
-		free(body);
+		_props_impl_unlock(impl, PROP_STATE_NONE);
 	}
 
 	return LV2_STATE_SUCCESS;
@@ -1182,23 +1977,28 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 
 		if(  body
 			&& (type == impl->type)
-			&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size) ) )
+			&& ( (impl->stash.max_size == 0) || (size <= impl->stash.max_size) ) )
 		{
 			if(  map_path && map_path->absolute_path
 				&& (type == props->urid.atom_path) )
 			{
 				char *absolute = map_path->absolute_path(map_path->handle, body);
-				if(absolute)
-				{
-					const uint32_t sz = strlen(absolute) + 1;
+				const uint32_t sz = absolute ? strlen(absolute) + 1 : 0;
 
+				if(  absolute
+					&& ( (impl->stash.max_size == 0) || (sz <= impl->stash.max_size) ) )
+				{
 					_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
 
+					// write directly into stash, rt-thread picks it up in props_idle
 					impl->stash.size = sz;
 					memcpy(impl->stash.body, absolute, sz);
 
 					_props_impl_unlock(impl, PROP_STATE_RESTORE);
+				}
 
+				if(absolute)
+				{
 					_free_path(free_path, absolute);
 				}
 			}
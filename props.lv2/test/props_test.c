@@ -16,6 +16,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 
 #include <props.h>
 
@@ -23,6 +24,7 @@
 #define STR_SIZE 32
 #define CHUNK_SIZE 16
 #define VEC_SIZE 13
+#define PATH_SIZE PATH_MAX
 
 #define PROPS_PREFIX		"http://open-music-kontrollers.ch/lv2/props#"
 #define PROPS_TEST_URI	PROPS_PREFIX"test"
@@ -45,7 +47,7 @@ struct _plugstate_t {
 	uint32_t urid;
 	char str [STR_SIZE];
 	char uri [STR_SIZE];
-	char path [STR_SIZE];
+	char path [PATH_SIZE];
 	uint8_t chunk [CHUNK_SIZE];
 	LV2_Atom_Literal_Body lit;
 		char lit_body [STR_SIZE];
@@ -309,7 +311,7 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = PROPS_PREFIX"path",
 		.offset = offsetof(plugstate_t, path),
 		.type = LV2_ATOM__Path,
-		.max_size = STR_SIZE
+		.max_size = PATH_SIZE
 	},
 	[PROP_chunk] = {
 		.property = PROPS_PREFIX"chunk",
@@ -614,9 +616,506 @@ _test_2(handle_t *handle)
 	assert(ser_atom_deinit(&ser) == 0);
 }
 
+static void
+_test_3(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	LV2_URID_Map *map = &handle->map;
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	ser_atom_t ser;
+
+	lv2_atom_forge_init(&forge, map);
+	assert(ser_atom_init(&ser) == 0);
+
+	lv2_atom_forge_set_sink(&forge, _ser_atom_sink, _ser_atom_deref, &ser);
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+
+	const LV2_URID property = props_map(props, defs[PROP_str].property);
+	assert(property);
+
+	props_impl_t *impl = _props_impl_get(props, property);
+	assert(impl);
+
+	static const char hello [] = "hello world";
+	_props_impl_set(props, impl, forge.String, sizeof(hello), hello);
+	assert(impl->value.size == sizeof(hello));
+	assert(impl->change.size == sizeof(hello));
+
+	// "hello world" -> "hello there world"
+	assert(props_splice(props, &forge, 1, property, 6, 0, 6, "there ", &ref) == 1);
+	assert(ref);
+	assert(impl->value.size == sizeof("hello there world"));
+	assert(strcmp(state->str, "hello there world") == 0);
+	assert(strcmp(stash->str, "hello there world") == 0);
+	assert(impl->change.offset == 6);
+	assert(impl->change.length == 0);
+	assert(impl->change.size == 6);
+
+	// out of bounds
+	assert(props_splice(props, &forge, 1, property, 16, 4, 0, NULL, &ref) == 0);
+	assert(strcmp(state->str, "hello there world") == 0);
+
+	lv2_atom_forge_pop(&forge, &frame);
+
+	// rewind to remote side, which knows nothing about own splices
+	static const char bye [] = "hello world";
+	_props_impl_set(props, impl, forge.String, sizeof(bye), bye);
+	props->npending = 0;
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)ser_atom_get(&ser);
+	assert(seq);
+
+	unsigned nevs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype == props->urid.state_StateChanged)
+		{
+			continue;
+		}
+
+		assert(obj->body.otype == props->urid.props_splice);
+
+		const LV2_Atom *value = NULL;
+		lv2_atom_object_get(obj, props->urid.patch_value, &value, 0);
+		assert(value);
+		assert(value->type == forge.Chunk);
+		assert(value->size == 6);
+
+		// apply twice, second time does not match the base anymore
+		LV2_Atom_Forge_Ref nil = 0;
+		assert(props_advance(props, &forge, ev->time.frames, obj, &nil) == 1);
+		assert(strcmp(state->str, "hello there world") == 0);
+		assert(impl->change.offset == 6);
+		assert(impl->change.length == 0);
+		assert(impl->change.size == 6);
+		assert(props_advance(props, &forge, ev->time.frames, obj, &nil) == 0);
+		assert(strcmp(state->str, "hello there world") == 0);
+		assert(impl->value.size == sizeof("hello there world"));
+
+		nevs++;
+	}
+	assert(nevs == 1);
+
+	assert(ser_atom_deinit(&ser) == 0);
+}
+
+static void
+_test_4(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	LV2_URID_Map *map = &handle->map;
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	ser_atom_t ser;
+
+	lv2_atom_forge_init(&forge, map);
+	assert(ser_atom_init(&ser) == 0);
+
+	lv2_atom_forge_set_sink(&forge, _ser_atom_sink, _ser_atom_deref, &ser);
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+
+	const LV2_URID property = props_map(props, defs[PROP_str].property);
+	assert(property);
+
+	props_impl_t *impl = _props_impl_get(props, property);
+	assert(impl);
+
+	static const char ab [] = "ab";
+	_props_impl_set(props, impl, forge.String, sizeof(ab), ab);
+	props->npending = 0;
+
+	// quick successive edits: "ab" -> "xab" -> "xa"
+	assert(props_splice(props, &forge, 1, property, 0, 0, 1, "x", &ref) == 1);
+	assert(props_splice(props, &forge, 2, property, 2, 1, 0, NULL, &ref) == 1);
+	assert(ref);
+	assert(strcmp(state->str, "xa") == 0);
+	assert(props->npending == 2);
+
+	// stash has been spliced alike
+	assert(impl->stash.size == impl->value.size);
+	assert(strcmp(handle->stash.str, "xa") == 0);
+
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)ser_atom_get(&ser);
+	assert(seq);
+
+	const LV2_Atom_Object *splices [2];
+	unsigned nevs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype == props->urid.state_StateChanged)
+		{
+			continue;
+		}
+
+		assert(obj->body.otype == props->urid.props_splice);
+		assert(nevs < 2);
+		splices[nevs++] = obj;
+	}
+	assert(nevs == 2);
+
+	// echoes of own splices are skipped
+	LV2_Atom_Forge_Ref nil = 0;
+	for(unsigned i = 0; i < nevs; i++)
+	{
+		assert(props_advance(props, &forge, 0, splices[i], &nil) == 1);
+		assert(strcmp(state->str, "xa") == 0);
+		assert(impl->change.length == 0);
+		assert(impl->change.size == 0);
+	}
+	assert(props->npending == 0);
+
+	// foreign splice against a base of equal size but other content
+	assert(props_advance(props, &forge, 0, splices[0], &nil) == 0);
+	assert(strcmp(state->str, "xa") == 0);
+
+	// pure deletion against a base of equal size but other content
+	static const char xcb [] = "xcb";
+	_props_impl_set(props, impl, forge.String, sizeof(xcb), xcb);
+	assert(props_advance(props, &forge, 0, splices[1], &nil) == 0);
+	assert(strcmp(state->str, "xcb") == 0);
+
+	assert(ser_atom_deinit(&ser) == 0);
+
+	// rejected own splice is forgotten on patch:Error
+	uint8_t buf [512];
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_splice(props, &forge, 0, property, 0, 1, 0, NULL, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(props->npending == 1);
+
+	uint8_t msg [128];
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	assert(_props_patch_error(props, &forge, 0, props->pending[0],
+		props->origin));
+
+	const LV2_Atom_Event *ev = (const LV2_Atom_Event *)msg;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)&ev->body,
+		&nil) == 1);
+	assert(props->npending == 0);
+}
+
+typedef struct _session_t session_t;
+
+struct _session_t {
+	char dir [PATH_SIZE];
+	LV2_URID key;
+	char value [PATH_SIZE];
+	uint32_t type;
+};
+
+static char *
+_abstract_path(LV2_State_Map_Path_Handle instance, const char *absolute)
+{
+	session_t *session = instance;
+	const size_t len = strlen(session->dir);
+
+	if(!strncmp(absolute, session->dir, len) && (absolute[len] == '/') )
+	{
+		return strdup(&absolute[len + 1]);
+	}
+
+	return strdup(absolute);
+}
+
+static char *
+_absolute_path(LV2_State_Map_Path_Handle instance, const char *abstract)
+{
+	session_t *session = instance;
+	char *absolute = NULL;
+
+	if(abstract[0] == '/')
+	{
+		return strdup(abstract);
+	}
+
+	assert(asprintf(&absolute, "%s/%s", session->dir, abstract) != -1);
+
+	return absolute;
+}
+
+static char *
+_make_path(LV2_State_Make_Path_Handle instance, const char *path)
+{
+	return _absolute_path(instance, path);
+}
+
+static LV2_State_Status
+_store(LV2_State_Handle instance, uint32_t key, const void *value, size_t size,
+	uint32_t type, uint32_t flags __attribute__((unused)))
+{
+	session_t *session = instance;
+
+	if(type == session->type)
+	{
+		assert(size <= sizeof(session->value));
+
+		session->key = key;
+		memcpy(session->value, value, size);
+	}
+
+	return LV2_STATE_SUCCESS;
+}
+
+static const void *
+_retrieve(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	session_t *session = instance;
+
+	if(key != session->key)
+	{
+		return NULL;
+	}
+
+	*size = strlen(session->value) + 1;
+	*type = session->type;
+	*flags = LV2_STATE_IS_POD;
+
+	return session->value;
+}
+
+static void
+_write_file(const char *path, const char *str)
+{
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	assert(fwrite(str, strlen(str), 1, f) == 1);
+	assert(fclose(f) == 0);
+}
+
+static void
+_read_file(const char *path, const char *str)
+{
+	char buf [32] = "";
+	FILE *f = fopen(path, "rb");
+	assert(f);
+	assert(fread(buf, 1, sizeof(buf) - 1, f) == strlen(str));
+	assert(fclose(f) == 0);
+	assert(!strcmp(buf, str));
+}
+
+static void
+_save(handle_t *handle, session_t *session, const LV2_Feature *const *features,
+	const char *path)
+{
+	props_t *props = &handle->props;
+	props_impl_t *impl = _props_impl_get(props,
+		props_map(props, defs[PROP_path].property));
+	assert(impl);
+
+	impl->stash.size = strlen(path) + 1;
+	memcpy(impl->stash.body, path, impl->stash.size);
+
+	session->key = 0;
+	assert(props_save(props, _store, session, 0, features) == LV2_STATE_SUCCESS);
+	assert(session->key == impl->property);
+}
+
+static void
+_test_5(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *stash = &handle->stash;
+
+	static session_t session;
+	char tmp [] = "props_test_XXXXXX";
+	char base [PATH_SIZE];
+	char run [PATH_SIZE];
+	char img [PATH_SIZE];
+	const char *keep = "/usr/share/props/keep.png";
+	char copy [PATH_SIZE];
+
+	assert(mkdtemp(tmp));
+	assert(realpath(tmp, base));
+
+	// runtime directory, e.g. /run/user/<uid>
+	assert(snprintf(run, sizeof(run), "%s/run", base)
+		< (int)sizeof(run));
+	assert(snprintf(session.dir, sizeof(session.dir), "%s/session", base)
+		< (int)sizeof(session.dir));
+	assert(mkdir(run, 0700) == 0);
+	assert(mkdir(session.dir, 0700) == 0);
+	assert(setenv("XDG_RUNTIME_DIR", run, 1) == 0);
+
+	assert(snprintf(img, sizeof(img), "%s/0123456789abcdef.png", run)
+		< (int)sizeof(img));
+	assert(snprintf(copy, sizeof(copy), "%s/0123456789abcdef.png", session.dir)
+		< (int)sizeof(copy));
+	_write_file(img, "image");
+
+	session.type = props->urid.atom_path;
+
+	LV2_State_Map_Path map_path = {
+		.handle = &session,
+		.abstract_path = _abstract_path,
+		.absolute_path = _absolute_path
+	};
+	LV2_State_Make_Path make_path = {
+		.handle = &session,
+		.path = _make_path
+	};
+	const LV2_Feature feature_map_path = {
+		.URI = LV2_STATE__mapPath,
+		.data = &map_path
+	};
+	const LV2_Feature feature_make_path = {
+		.URI = LV2_STATE__makePath,
+		.data = &make_path
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map_path,
+		&feature_make_path,
+		NULL
+	};
+
+	// persistent path is referenced as is
+	_save(handle, &session, features, keep);
+	assert(!strcmp(session.value, keep));
+
+	// path in runtime directory is copied into session
+	_save(handle, &session, features, img);
+	assert(!strcmp(session.value, "0123456789abcdef.png"));
+	_read_file(copy, "image");
+
+	// runtime directory is gone after logout, restored path still is valid
+	assert(unlink(img) == 0);
+	assert(rmdir(run) == 0);
+
+	memset(stash->path, 0x0, sizeof(stash->path));
+	assert(props_restore(props, _retrieve, &session, 0, features)
+		== LV2_STATE_SUCCESS);
+	assert(!strcmp(stash->path, copy));
+	_read_file(stash->path, "image");
+
+	assert(unsetenv("XDG_RUNTIME_DIR") == 0);
+	assert(unlink(copy) == 0);
+	assert(rmdir(session.dir) == 0);
+	assert(rmdir(base) == 0);
+}
+
+// splices of another instance are applied, even with equal sequence numbers
+static void
+_test_6(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	LV2_URID_Map *map = &handle->map;
+
+	static handle_t other;
+	assert(props_init(&other.props, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		&other.state, &other.stash, map, NULL) == 1);
+	assert(other.props.origin != props->origin);
+
+	const LV2_URID property = props_map(props, defs[PROP_str].property);
+	props_impl_t *impl = _props_impl_get(props, property);
+	props_impl_t *other_impl = _props_impl_get(&other.props, property);
+	assert(impl && other_impl);
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	LV2_Atom_Forge_Ref nil = 0;
+	uint8_t buf [2048];
+
+	lv2_atom_forge_init(&forge, map);
+
+	static const char ab [] = "ab";
+	_props_impl_set(props, impl, forge.String, sizeof(ab), ab);
+	_props_impl_set(&other.props, other_impl, forge.String, sizeof(ab), ab);
+
+	// other instance has an own splice in flight with the same number
+	other.props.sequence_num = props->sequence_num;
+	const int32_t sequence_num = _props_pending_push(&other.props);
+
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_splice(props, &forge, 0, property, 0, 0, 1, "x", &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(props->pending[0] == sequence_num);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	const LV2_Atom_Event *ev = lv2_atom_sequence_begin(&seq->body);
+	const LV2_Atom_Object *splice = (const LV2_Atom_Object *)&ev->body;
+	assert(splice->body.otype == props->urid.props_splice);
+
+	assert(props_advance(&other.props, &forge, 0, splice, &nil) == 1);
+	assert(strcmp(other.state.str, "xab") == 0);
+	assert(other.props.npending == 1);
+
+	// acknowledgement is for the sending instance only
+	uint8_t msg [128];
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	assert(_props_patch_ack(props, &forge, 0, sequence_num, props->origin));
+	ev = (const LV2_Atom_Event *)msg;
+
+	assert(props_advance(&other.props, &forge, 0,
+		(const LV2_Atom_Object *)&ev->body, &nil) == 0);
+	assert(other.props.npending == 1);
+	assert(props_advance(props, &forge, 0,
+		(const LV2_Atom_Object *)&ev->body, &nil) == 1);
+	assert(props->npending == 0);
+
+	// acknowledgement in the middle keeps older ones in flight
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	for(unsigned i = 0; i < 3; i++)
+	{
+		assert(props_splice(props, &forge, 0, property, 0, 0, 1, "y", &ref) == 1);
+	}
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(strcmp(state->str, "yyyxab") == 0);
+	assert(props->npending == 3);
+
+	const int32_t first = props->pending[0];
+	const int32_t last = props->pending[2];
+
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	assert(_props_patch_ack(props, &forge, 0, props->pending[1], props->origin));
+	assert(props_advance(props, &forge, 0,
+		(const LV2_Atom_Object *)&ev->body, &nil) == 1);
+	assert(props->npending == 2);
+	assert(props->pending[0] == first);
+	assert(props->pending[1] == last);
+}
+
 static const test_t tests [] = {
 	_test_1,
 	_test_2,
+	_test_3,
+	_test_4,
+	_test_5,
+	_test_6,
 	NULL
 };
 
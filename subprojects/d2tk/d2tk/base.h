@@ -166,7 +166,8 @@ typedef enum _d2tk_flag_t {
 	D2TK_FLAG_SEPARATOR_X   = (1 << 11),
 	D2TK_FLAG_SEPARATOR_Y   = (1 << 12),
 	D2TK_FLAG_PTY_REINIT    = (1 << 13),
-	D2TK_FLAG_PTY_NOMOUSE   = (1 << 14)
+	D2TK_FLAG_PTY_NOMOUSE   = (1 << 14),
+	D2TK_FLAG_TEXTEDIT_RELOAD = (1 << 15)
 } d2tk_flag_t;
 
 #define D2TK_ID_IDX(IDX) ( ((d2tk_id_t)__LINE__ << 16) | (IDX) )
@@ -513,6 +514,9 @@ d2tk_pty_next(d2tk_pty_t *pty);
 D2TK_API d2tk_state_t
 d2tk_pty_get_state(d2tk_pty_t *pty);
 
+D2TK_API int
+d2tk_pty_send(d2tk_pty_t *pty, const char *buf, size_t len);
+
 D2TK_API uint32_t
 d2tk_pty_get_max_red(d2tk_pty_t *pty);
 
@@ -536,6 +540,14 @@ d2tk_base_lineedit(d2tk_base_t *base, d2tk_id_t id, size_t line_len,
 #define d2tk_base_lineedit_is_changed(...) \
 	d2tk_state_is_changed(d2tk_base_lineedit(__VA_ARGS__))
 
+D2TK_API d2tk_state_t
+d2tk_base_textedit(d2tk_base_t *base, d2tk_id_t id, size_t *text_len,
+	const char **text, d2tk_coord_t height, const d2tk_rect_t *rect,
+	d2tk_flag_t flags);
+
+#define d2tk_base_textedit_is_changed(...) \
+	d2tk_state_is_changed(d2tk_base_textedit(__VA_ARGS__))
+
 #if D2TK_EVDEV
 D2TK_API d2tk_state_t
 d2tk_base_vkb(d2tk_base_t *base, d2tk_id_t id, const d2tk_rect_t *rect);
@@ -772,6 +784,12 @@ d2tk_base_probe(d2tk_base_t *base);
 D2TK_API int
 d2tk_base_get_file_descriptors(d2tk_base_t *base, int *fds, int numfds);
 
+D2TK_API int
+d2tk_base_add_file_descriptor(d2tk_base_t *base, int fd);
+
+D2TK_API int
+d2tk_base_remove_file_descriptor(d2tk_base_t *base, int fd);
+
 D2TK_API bool
 d2tk_base_set_again(d2tk_base_t *base);
 
@@ -35,6 +35,7 @@ typedef struct _d2tk_widget_t d2tk_widget_t;
 typedef struct _d2tk_point_t d2tk_point_t;
 typedef struct _d2tk_core_t d2tk_core_t;
 typedef struct _d2tk_core_driver_t d2tk_core_driver_t;
+typedef struct _d2tk_cell_t d2tk_cell_t;
 typedef void (*d2tk_core_custom_t)(void *ctx, const d2tk_rect_t *rect,
 	const void *data);
 
@@ -50,6 +51,20 @@ typedef enum _d2tk_align_t {
 
 #define D2TK_ALIGN_CENTERED (D2TK_ALIGN_CENTER | D2TK_ALIGN_MIDDLE)
 
+typedef enum _d2tk_cell_attr_t {
+	D2TK_CELL_NONE					= 0,
+	D2TK_CELL_BOLD					= (1 << 0),
+	D2TK_CELL_ITALIC				= (1 << 1),
+	D2TK_CELL_REVERSE				= (1 << 2)
+} d2tk_cell_attr_t;
+
+struct _d2tk_cell_t {
+	uint32_t code; // unicode codepoint, 0 for blank
+	uint32_t attr; // d2tk_cell_attr_t
+	uint32_t fg;
+	uint32_t bg;
+};
+
 struct _d2tk_rect_t {
 	d2tk_coord_t x;
 	d2tk_coord_t y;
@@ -185,6 +200,11 @@ D2TK_API void
 d2tk_core_custom(d2tk_core_t *core, const d2tk_rect_t *rect, uint64_t dhash,
 	const void *data, d2tk_core_custom_t custom);
 
+D2TK_API void
+d2tk_core_grid(d2tk_core_t *core, const d2tk_rect_t *rect, uint32_t ncols,
+	uint32_t nrows, const d2tk_cell_t *cells, uint64_t dhash,
+	const char *regular, const char *bold, const char *italic);
+
 D2TK_API void
 d2tk_core_stroke_width(d2tk_core_t *core, d2tk_coord_t width);
 
@@ -212,6 +232,9 @@ d2tk_core_get_dimensions(d2tk_core_t *core, d2tk_coord_t *w, d2tk_coord_t *h);
 D2TK_API void
 d2tk_core_set_full_refresh(d2tk_core_t *core);
 
+D2TK_API bool
+d2tk_core_get_again(d2tk_core_t *core);
+
 D2TK_API int
 d2tk_core_text_extent(d2tk_core_t *core, size_t len, const char *buf,
 	d2tk_coord_t h);
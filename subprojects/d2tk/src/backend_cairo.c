@@ -34,6 +34,8 @@
 #pragma GCC diagnostic pop
 
 #include "core_internal.h"
+#include "loader_internal.h"
+#include "font_internal.h"
 #include <d2tk/backend.h>
 #include <d2tk/hash.h>
 
@@ -54,6 +56,13 @@ struct _d2tk_backend_cairo_t {
 	d2tk_coord_t w;
 	d2tk_coord_t h;
 	cairo_surface_t *surf;
+	d2tk_loader_t *loader;
+	const d2tk_clip_t *damage;
+	unsigned ndamage;
+	uint8_t *marks;
+	size_t nmarks;
+	cairo_glyph_t *glyphs;
+	size_t nglyphs;
 };
 
 static void
@@ -61,6 +70,8 @@ d2tk_cairo_free(void *data)
 {
 	d2tk_backend_cairo_t *backend = data;
 
+	d2tk_loader_free(backend->loader);
+
 	if(backend->surf)
 	{
 		cairo_surface_destroy(backend->surf);
@@ -72,10 +83,32 @@ d2tk_cairo_free(void *data)
 	}
 
 	FT_Done_FreeType(backend->library);
+	free(backend->marks);
+	free(backend->glyphs);
 	free(backend->bundle_path);
 	free(backend);
 }
 
+static void
+_d2tk_cairo_img_convert(uint8_t *pixels, int W, int H)
+{
+	// bitswap and premultiply pixel data
+	for(unsigned i = 0; i < W*H*sizeof(uint32_t); i += sizeof(uint32_t))
+	{
+		// get alpha channel
+		const uint8_t a = pixels[i+3];
+
+		// premultiply with alpha channel
+		const uint8_t r = ( (uint16_t)pixels[i+0] * a ) >> 8;
+		const uint8_t g = ( (uint16_t)pixels[i+1] * a ) >> 8;
+		const uint8_t b = ( (uint16_t)pixels[i+2] * a ) >> 8;
+
+		// merge and byteswap to correct endianness
+		uint32_t *pix = (uint32_t *)&pixels[i];
+		*pix = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+}
+
 static void *
 d2tk_cairo_new(const char *bundle_path)
 {
@@ -89,9 +122,34 @@ d2tk_cairo_new(const char *bundle_path)
 	backend->bundle_path = strdup(bundle_path);
 	FT_Init_FreeType(&backend->library);
 
+	// decode images off-thread, falls back to synchronous loading upon failure
+	backend->loader = d2tk_loader_new(_d2tk_cairo_img_convert);
+	if(!backend->loader)
+	{
+		fprintf(stderr, "d2tk_loader_new failed\n");
+	}
+
 	return backend;
 }
 
+static bool
+d2tk_cairo_again(void *data)
+{
+	d2tk_backend_cairo_t *backend = data;
+
+	return backend->loader && d2tk_loader_get_ready(backend->loader);
+}
+
+static void
+d2tk_cairo_damage(void *data, d2tk_core_t *core __attribute__((unused)),
+	const d2tk_clip_t *rects, unsigned nrects)
+{
+	d2tk_backend_cairo_t *backend = data;
+
+	backend->damage = rects;
+	backend->ndamage = nrects;
+}
+
 static int
 d2tk_cairo_context(void *data, void *pctx)
 {
@@ -148,14 +206,19 @@ d2tk_cairo_pre(void *data, d2tk_core_t *core __attribute((unused)),
 	cairo_save(ctx);
 
 	{
-		d2tk_rect_t rect;
-		uint32_t *pixels = d2tk_core_get_pixels(core, &rect);
+		uint32_t *pixels = d2tk_core_get_pixels(core, NULL);
 
 		cairo_surface_t *surf = cairo_image_surface_create_for_data(
 			(uint8_t *)pixels, CAIRO_FORMAT_ARGB32, w, h, w*sizeof(uint32_t));
 		//FIXME reuse/update surfaces
 
-		cairo_rectangle(ctx, rect.x, rect.y, rect.w, rect.h);
+		// clip whole 2nd pass to damaged rectangles
+		for(unsigned i = 0; i < backend->ndamage; i++)
+		{
+			const d2tk_clip_t *damage = &backend->damage[i];
+
+			cairo_rectangle(ctx, damage->x0, damage->y0, damage->w, damage->h);
+		}
 		cairo_clip(ctx);
 
 		cairo_new_sub_path(ctx);
@@ -306,12 +369,21 @@ d2tk_cairo_text_extent(void *data, size_t len, const char *buf, d2tk_coord_t h)
 	return extents.width;
 }
 
+typedef struct _d2tk_cairo_font_t d2tk_cairo_font_t;
+
+struct _d2tk_cairo_font_t {
+	FT_Face face;
+	d2tk_font_t *font;
+};
+
 static inline void
 _d2tk_cairo_free_font_face(void *data)
 {
-	FT_Face face = data;
+	d2tk_cairo_font_t *cfont = data;
 
-	FT_Done_Face(face);
+	FT_Done_Face(cfont->face);
+	d2tk_font_unref(cfont->font);
+	free(cfont);
 }
 
 static inline void
@@ -404,6 +476,235 @@ _absolute_path(d2tk_backend_cairo_t *backend, const char *rel)
 	return abs;
 }
 
+static inline cairo_font_face_t *
+_d2tk_cairo_font_face(d2tk_backend_cairo_t *backend, d2tk_core_t *core,
+	const char *name)
+{
+	const uint64_t hash = d2tk_hash(name, strlen(name));
+	uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_FONT);
+	assert(sprite);
+
+	if(!*sprite)
+	{
+		char ft_path [1024];
+		if(d2tk_core_get_font_path(core, backend->bundle_path, name,
+			sizeof(ft_path), ft_path))
+		{
+			fprintf(stderr, "d2tk_core_get_font_path failed on '%s'\n", name);
+			return NULL;
+		}
+
+		d2tk_cairo_font_t *cfont = calloc(1, sizeof(d2tk_cairo_font_t));
+		if(!cfont)
+		{
+			return NULL;
+		}
+
+		// font data is loaded once and shared among all instances
+		cfont->font = d2tk_font_ref(ft_path);
+		if(!cfont->font)
+		{
+			fprintf(stderr, "d2tk_font_ref failed on '%s'\n", ft_path);
+			free(cfont);
+			return NULL;
+		}
+
+		size_t size;
+		const uint8_t *data = d2tk_font_data(cfont->font, &size);
+
+		FT_New_Memory_Face(backend->library, data, size, 0, &cfont->face);
+		if(cfont->face == NULL)
+		{
+			fprintf(stderr, "FT_New_Memory_Face failed on '%s'\n", ft_path);
+			d2tk_font_unref(cfont->font);
+			free(cfont);
+			return NULL;
+		}
+
+		cairo_font_face_t *face = cairo_ft_font_face_create_for_ft_face(cfont->face, 0);
+		const cairo_user_data_key_t key = { 0 };
+		cairo_font_face_set_user_data(face, &key, cfont, _d2tk_cairo_free_font_face);
+
+		*sprite = (uintptr_t)face;
+	}
+
+	cairo_font_face_t *face = (cairo_font_face_t *)*sprite;
+	assert(face);
+
+	return face;
+}
+
+static inline void
+_d2tk_cairo_color(cairo_t *ctx, uint32_t rgba)
+{
+	const float r = ( (rgba >> 24) & 0xff) * 0x1p-8;
+	const float g = ( (rgba >> 16) & 0xff) * 0x1p-8;
+	const float b = ( (rgba >>  8) & 0xff) * 0x1p-8;
+	const float a = ( (rgba >>  0) & 0xff) * 0x1p-8;
+
+	cairo_set_source_rgba(ctx, r, g, b, a);
+}
+
+static inline uint32_t
+_d2tk_cairo_cell_fg(const d2tk_cell_t *cell)
+{
+	return (cell->attr & D2TK_CELL_REVERSE) ? cell->bg : cell->fg;
+}
+
+static inline uint32_t
+_d2tk_cairo_cell_bg(const d2tk_cell_t *cell)
+{
+	return (cell->attr & D2TK_CELL_REVERSE) ? cell->fg : cell->bg;
+}
+
+static inline void
+_d2tk_cairo_grid(d2tk_backend_cairo_t *backend, d2tk_core_t *core,
+	const d2tk_body_grid_t *body, d2tk_coord_t xo, d2tk_coord_t yo)
+{
+	cairo_t *ctx = backend->ctx;
+	const d2tk_cell_t *cells = body->cells;
+	const uint32_t ncols = body->ncols;
+	const uint32_t ncells = body->ncols * body->nrows;
+
+	if(ncells == 0)
+	{
+		return;
+	}
+
+	// per-cell done flags and glyphs of at most the whole grid
+	if(ncells > backend->nmarks)
+	{
+		uint8_t *marks = realloc(backend->marks, ncells);
+		if(!marks)
+		{
+			return;
+		}
+
+		backend->marks = marks;
+		backend->nmarks = ncells;
+	}
+
+	if(ncells > backend->nglyphs)
+	{
+		cairo_glyph_t *glyphs = realloc(backend->glyphs,
+			ncells * sizeof(cairo_glyph_t));
+		if(!glyphs)
+		{
+			return;
+		}
+
+		backend->glyphs = glyphs;
+		backend->nglyphs = ncells;
+	}
+
+	uint8_t *marks = backend->marks;
+	cairo_glyph_t *glyphs = backend->glyphs;
+	const d2tk_coord_t w = body->w / body->ncols;
+	const d2tk_coord_t h = body->h / body->nrows;
+	const d2tk_coord_t x0 = body->x + xo;
+	const d2tk_coord_t y0 = body->y + yo;
+
+	cairo_save(ctx);
+	cairo_rectangle(ctx, x0, y0, body->w, body->h);
+	cairo_clip(ctx);
+
+	// one path and one fill per background color
+	memset(marks, 0x0, ncells);
+
+	for(uint32_t i = 0; i < ncells; i++)
+	{
+		const uint32_t bg = _d2tk_cairo_cell_bg(&cells[i]);
+
+		if(marks[i] || !bg)
+		{
+			continue;
+		}
+
+		cairo_new_path(ctx);
+
+		for(uint32_t j = i; j < ncells; )
+		{
+			if(_d2tk_cairo_cell_bg(&cells[j]) != bg)
+			{
+				j++;
+				continue;
+			}
+
+			const uint32_t y = j / ncols;
+			const uint32_t x = j % ncols;
+			const uint32_t end = (y + 1) * ncols;
+			const uint32_t from = j;
+
+			while( (j < end) && (_d2tk_cairo_cell_bg(&cells[j]) == bg) )
+			{
+				marks[j++] = 1;
+			}
+
+			cairo_rectangle(ctx, x0 + x*w, y0 + y*h, (j - from)*w, h);
+		}
+
+		_d2tk_cairo_color(ctx, bg);
+		cairo_fill(ctx);
+	}
+
+	// one glyph blit per glyph style from the scaled font's glyph cache
+	memset(marks, 0x0, ncells);
+
+	cairo_set_font_size(ctx, h);
+
+	for(uint32_t i = 0; i < ncells; i++)
+	{
+		if(marks[i] || !cells[i].code)
+		{
+			continue;
+		}
+
+		const uint32_t fg = _d2tk_cairo_cell_fg(&cells[i]);
+		const char *name = d2tk_body_grid_get_face(body, cells[i].attr);
+		cairo_font_face_t *face = _d2tk_cairo_font_face(backend, core, name);
+		FT_Face ft_face = NULL;
+
+		if(face)
+		{
+			cairo_set_font_face(ctx, face);
+			ft_face = cairo_ft_scaled_font_lock_face(cairo_get_scaled_font(ctx));
+		}
+
+		int nglyphs = 0;
+
+		for(uint32_t j = i; j < ncells; j++)
+		{
+			if(marks[j] || !cells[j].code
+				|| (_d2tk_cairo_cell_fg(&cells[j]) != fg)
+				|| (d2tk_body_grid_get_face(body, cells[j].attr) != name) )
+			{
+				continue;
+			}
+
+			marks[j] = 1;
+
+			if(ft_face)
+			{
+				cairo_glyph_t *glyph = &glyphs[nglyphs++];
+
+				glyph->index = FT_Get_Char_Index(ft_face, cells[j].code);
+				glyph->x = x0 + (j % ncols)*w;
+				glyph->y = y0 + (j / ncols + 1)*h;
+			}
+		}
+
+		if(ft_face)
+		{
+			cairo_ft_scaled_font_unlock_face(cairo_get_scaled_font(ctx));
+
+			_d2tk_cairo_color(ctx, fg);
+			cairo_show_glyphs(ctx, glyphs, nglyphs);
+		}
+	}
+
+	cairo_restore(ctx);
+}
+
 static inline void
 d2tk_cairo_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 	d2tk_coord_t xo, d2tk_coord_t yo, const d2tk_clip_t *clip, unsigned pass)
@@ -666,35 +967,12 @@ d2tk_cairo_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 		{
 			const d2tk_body_font_face_t *body = &com->body->font_face;
 
-			const uint64_t hash = d2tk_hash(body->face, strlen(body->face));
-			uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_FONT);
-			assert(sprite);
+			cairo_font_face_t *face = _d2tk_cairo_font_face(backend, core, body->face);
 
-			if(!*sprite)
+			if(face)
 			{
-				char ft_path [1024];
-				d2tk_core_get_font_path(core, backend->bundle_path, body->face,
-					sizeof(ft_path), ft_path);
-
-				FT_Face ft_face = NULL;
-				FT_New_Face(backend->library, ft_path, 0, &ft_face);
-				if(ft_face == NULL)
-				{
-					fprintf(stderr, "FT_New_Face failed on '%s'\n", ft_path);
-					break;
-				}
-
-				cairo_font_face_t *face = cairo_ft_font_face_create_for_ft_face(ft_face, 0);
-				const cairo_user_data_key_t key = { 0 };
-				cairo_font_face_set_user_data(face, &key, ft_face, _d2tk_cairo_free_font_face);
-
-				*sprite = (uintptr_t)face;
+				cairo_set_font_face(ctx, face);
 			}
-
-			cairo_font_face_t *face = (cairo_font_face_t *)*sprite;
-			assert(face);
-
-			cairo_set_font_face(ctx, face);
 		} break;
 		case D2TK_INSTR_FONT_SIZE:
 		{
@@ -749,7 +1027,10 @@ d2tk_cairo_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 		{
 			const d2tk_body_image_t *body = &com->body->image;
 
-			const uint64_t hash = d2tk_hash(body->path, strlen(body->path));
+			// thumbnail sized to power-of-two bucket, e.g. 0 for original size
+			const uint32_t bucket = d2tk_loader_bucket(body->w, body->h);
+			const uint64_t hash = d2tk_hash_foreach(body->path, strlen(body->path),
+				&bucket, sizeof(bucket), NULL);
 			uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_SURF);
 			assert(sprite);
 
@@ -758,52 +1039,66 @@ d2tk_cairo_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 				char *img_path = _absolute_path(backend, body->path);
 				assert(img_path);
 
-				struct stat st;
-				if(stat(img_path, &st) == 0)
-				{
-					int W, H, N;
-					uint8_t *pixels = NULL;
+				int W, H;
+				uint8_t *pixels = NULL;
 
-					stbi_set_unpremultiply_on_load(1);
-					stbi_convert_iphone_png_to_rgb(1);
-					pixels = stbi_load(img_path, &W, &H, &N, 4);
-
-					if(pixels)
+				if(backend->loader)
+				{
+					// decoded and converted off-thread, pixels are ours once ready
+					if(d2tk_loader_get(backend->loader, hash, img_path, bucket,
+						&pixels, &W, &H) != D2TK_LOADER_STATUS_READY)
 					{
-						// bitswap and premultiply pixel data
-						for(unsigned i = 0; i < W*H*sizeof(uint32_t); i += sizeof(uint32_t))
-						{
-							// get alpha channel
-							const uint8_t a = pixels[i+3];
+						pixels = NULL;
+					}
+				}
+				else
+				{
+					struct stat st;
+					if(stat(img_path, &st) == 0)
+					{
+						int N;
 
-							// premultiply with alpha channel
-							const uint8_t r = ( (uint16_t)pixels[i+0] * a ) >> 8;
-							const uint8_t g = ( (uint16_t)pixels[i+1] * a ) >> 8;
-							const uint8_t b = ( (uint16_t)pixels[i+2] * a ) >> 8;
+						stbi_set_unpremultiply_on_load(1);
+						stbi_convert_iphone_png_to_rgb(1);
+						pixels = stbi_load(img_path, &W, &H, &N, 4);
 
-							// merge and byteswap to correct endianness
-							uint32_t *pix = (uint32_t *)&pixels[i];
-							*pix = (a << 24) | (r << 16) | (g << 8) | b;
+						if(pixels)
+						{
+							_d2tk_cairo_img_convert(pixels, W, H);
 						}
+					}
+				}
 
-						cairo_surface_t *surf = cairo_image_surface_create_for_data(pixels,
-							CAIRO_FORMAT_ARGB32, W, H, W*sizeof(uint32_t));
+				if(pixels)
+				{
+					cairo_surface_t *surf = cairo_image_surface_create_for_data(pixels,
+						CAIRO_FORMAT_ARGB32, W, H, W*sizeof(uint32_t));
 
-						const cairo_user_data_key_t key = { 0 };
-						cairo_surface_set_user_data(surf, &key, pixels, _d2tk_cairo_img_free);
+					const cairo_user_data_key_t key = { 0 };
+					cairo_surface_set_user_data(surf, &key, pixels, _d2tk_cairo_img_free);
 
-						*sprite = (uintptr_t)surf;
-					}
+					*sprite = (uintptr_t)surf;
 				}
 
 				free(img_path);
 			}
 
 			cairo_surface_t *surf = (cairo_surface_t *)*sprite;
-			assert(surf);
 
-			_d2tk_cairo_surf_draw(ctx, surf, xo, yo, body->align,
-				&D2TK_RECT(body->x, body->y, body->w, body->h));
+			if(surf)
+			{
+				_d2tk_cairo_surf_draw(ctx, surf, xo, yo, body->align,
+					&D2TK_RECT(body->x, body->y, body->w, body->h));
+			}
+			else // draw placeholder while pending
+			{
+				cairo_save(ctx);
+				cairo_new_path(ctx);
+				cairo_rectangle(ctx, body->x + xo, body->y + yo, body->w, body->h);
+				cairo_set_source_rgba(ctx, 0.5, 0.5, 0.5, 0.125);
+				cairo_fill(ctx);
+				cairo_restore(ctx);
+			}
 		} break;
 		case D2TK_INSTR_BITMAP:
 		{
@@ -843,6 +1138,12 @@ d2tk_cairo_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 
 			cairo_set_line_width(ctx, body->width);
 		} break;
+		case D2TK_INSTR_GRID:
+		{
+			const d2tk_body_grid_t *body = &com->body->grid;
+
+			_d2tk_cairo_grid(backend, core, body, xo, yo);
+		} break;
 		default:
 		{
 			fprintf(stderr, "%s: unknown command (%i)\n", __func__, com->instr);
@@ -859,5 +1160,7 @@ const d2tk_core_driver_t d2tk_core_driver = {
 	.post = d2tk_cairo_post,
 	.end = d2tk_cairo_end,
 	.sprite_free = d2tk_cairo_sprite_free,
-	.text_extent = d2tk_cairo_text_extent
+	.text_extent = d2tk_cairo_text_extent,
+	.again = d2tk_cairo_again,
+	.damage = d2tk_cairo_damage
 };
@@ -52,8 +52,11 @@
 #endif
 
 #include "core_internal.h"
+#include "loader_internal.h"
+#include "font_internal.h"
 #include <d2tk/backend.h>
 #include <d2tk/hash.h>
+#include <utf8.h/utf8.h>
 
 #define D2TK_BACKEND_NANOVG_FBO_MAX 2
 
@@ -74,6 +77,17 @@ struct _d2tk_backend_nanovg_t {
 	d2tk_coord_t w;
 	d2tk_coord_t h;
 	int mask;
+	d2tk_loader_t *loader;
+	const d2tk_clip_t *damage;
+	unsigned ndamage;
+	d2tk_font_t **fonts;
+	unsigned nfonts;
+	uint8_t *marks;
+	size_t nmarks;
+	char *run;
+	size_t nrun;
+	NVGglyphPosition *pos;
+	size_t npos;
 };
 
 static void
@@ -81,6 +95,8 @@ d2tk_nanovg_free(void *data)
 {
 	d2tk_backend_nanovg_t *backend = data;
 
+	d2tk_loader_free(backend->loader);
+
 	for(unsigned f = 0; f < D2TK_BACKEND_NANOVG_FBO_MAX; f++)
 	{
 		if(backend->fbo[f])
@@ -102,6 +118,16 @@ d2tk_nanovg_free(void *data)
 		backend->ctx = NULL;
 	}
 
+	// font data must outlive the context
+	for(unsigned i = 0; i < backend->nfonts; i++)
+	{
+		d2tk_font_unref(backend->fonts[i]);
+	}
+	free(backend->fonts);
+
+	free(backend->marks);
+	free(backend->run);
+	free(backend->pos);
 	free(backend->bundle_path);
 	free(backend);
 }
@@ -139,9 +165,34 @@ d2tk_nanovg_new(const char *bundle_path)
 	backend->ctx = ctx;
 	backend->bundle_path = strdup(bundle_path);
 
+	// decode images off-thread, falls back to synchronous loading upon failure
+	backend->loader = d2tk_loader_new(NULL);
+	if(!backend->loader)
+	{
+		fprintf(stderr, "d2tk_loader_new failed\n");
+	}
+
 	return backend;
 }
 
+static bool
+d2tk_nanovg_again(void *data)
+{
+	d2tk_backend_nanovg_t *backend = data;
+
+	return backend->loader && d2tk_loader_get_ready(backend->loader);
+}
+
+static void
+d2tk_nanovg_damage(void *data, d2tk_core_t *core __attribute__((unused)),
+	const d2tk_clip_t *rects, unsigned nrects)
+{
+	d2tk_backend_nanovg_t *backend = data;
+
+	backend->damage = rects;
+	backend->ndamage = nrects;
+}
+
 static int
 d2tk_nanovg_context(void *data __attribute__((unused)),
 	void *pctx __attribute__((unused)))
@@ -225,8 +276,14 @@ d2tk_nanovg_pre(void *data, d2tk_core_t *core, d2tk_coord_t w, d2tk_coord_t h,
 
 		if(backend->mask)
 		{
-			nvgUpdateSubImage(ctx, backend->mask, (const uint8_t *)pixels,
-				rect.x, rect.y, rect.w, rect.h);
+			// only upload damaged rectangles
+			for(unsigned i = 0; i < backend->ndamage; i++)
+			{
+				const d2tk_clip_t *damage = &backend->damage[i];
+
+				nvgUpdateSubImage(ctx, backend->mask, (const uint8_t *)pixels,
+					damage->x0, damage->y0, damage->w, damage->h);
+			}
 		}
 		else
 		{
@@ -236,7 +293,12 @@ d2tk_nanovg_pre(void *data, d2tk_core_t *core, d2tk_coord_t w, d2tk_coord_t h,
 
 		const NVGpaint bg = nvgImagePattern(ctx, 0, 0, w, h, 0, backend->mask, 1.f);
 		nvgBeginPath(ctx);
-		nvgRect(ctx, rect.x, rect.y, rect.w, rect.h);
+		for(unsigned i = 0; i < backend->ndamage; i++)
+		{
+			const d2tk_clip_t *damage = &backend->damage[i];
+
+			nvgRect(ctx, damage->x0, damage->y0, damage->w, damage->h);
+		}
 		nvgStrokeWidth(ctx, 0);
 		nvgFillPaint(ctx, bg);
 		nvgFill(ctx);
@@ -459,6 +521,308 @@ _absolute_path(d2tk_backend_nanovg_t *backend, const char *rel)
 	return abs;
 }
 
+static inline int
+_d2tk_nanovg_font_face(d2tk_backend_nanovg_t *backend, d2tk_core_t *core,
+	const char *name)
+{
+	NVGcontext *ctx = backend->ctx;
+
+	const uint64_t hash = d2tk_hash(name, strlen(name));
+	uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_FONT);
+	assert(sprite);
+
+	if(!*sprite)
+	{
+		// font may still be known to context after its sprite has expired
+		int face = nvgFindFont(ctx, name);
+
+		if(face == -1)
+		{
+			char ft_path [1024];
+			if(d2tk_core_get_font_path(core, backend->bundle_path, name,
+				sizeof(ft_path), ft_path))
+			{
+				fprintf(stderr, "d2tk_core_get_font_path failed on '%s'\n", name);
+				return -1;
+			}
+
+			// font data is loaded once and shared among all instances
+			d2tk_font_t *font = d2tk_font_ref(ft_path);
+			if(!font)
+			{
+				fprintf(stderr, "d2tk_font_ref failed on '%s'\n", ft_path);
+				return -1;
+			}
+
+			d2tk_font_t **fonts = realloc(backend->fonts,
+				(backend->nfonts + 1) * sizeof(d2tk_font_t *));
+			if(!fonts)
+			{
+				d2tk_font_unref(font);
+				return -1;
+			}
+
+			backend->fonts = fonts;
+			backend->fonts[backend->nfonts++] = font;
+
+			size_t size;
+			const uint8_t *data = d2tk_font_data(font, &size);
+
+			// data is read-only and owned by font cache, not by nanovg
+			face = nvgCreateFontMem(ctx, name, (unsigned char *)data, size, 0);
+			if(face == -1)
+			{
+				fprintf(stderr, "nvgCreateFontMem failed on '%s'\n", ft_path);
+				return -1;
+			}
+		}
+
+		*sprite = (uintptr_t)face;
+	}
+
+	return *sprite;
+}
+
+static inline NVGcolor
+_d2tk_nanovg_color(uint32_t rgba)
+{
+	const uint8_t r = (rgba >> 24) & 0xff;
+	const uint8_t g = (rgba >> 16) & 0xff;
+	const uint8_t b = (rgba >>  8) & 0xff;
+	const uint8_t a = (rgba >>  0) & 0xff;
+
+	return nvgRGBA(r, g, b, a);
+}
+
+static inline uint32_t
+_d2tk_nanovg_cell_fg(const d2tk_cell_t *cell)
+{
+	return (cell->attr & D2TK_CELL_REVERSE) ? cell->bg : cell->fg;
+}
+
+static inline uint32_t
+_d2tk_nanovg_cell_bg(const d2tk_cell_t *cell)
+{
+	return (cell->attr & D2TK_CELL_REVERSE) ? cell->fg : cell->bg;
+}
+
+// draw a run of cells, restart it behind glyphs whose advance differs from
+// the cell pitch, e.g. from fallback fonts, symbols or wide characters
+static inline void
+_d2tk_nanovg_run(d2tk_backend_nanovg_t *backend, float x, float y, float w,
+	const char *run, const char *end, int nglyphs)
+{
+	NVGcontext *ctx = backend->ctx;
+	NVGglyphPosition *pos = backend->pos;
+	const int n = nvgTextGlyphPositions(ctx, x, y, run, end, pos, nglyphs);
+	const char *from = run;
+	float fx = x;
+
+	for(int k = 0; k + 1 < n; k++)
+	{
+		if(fabsf(pos[k + 1].x - pos[k].x - w) > 0.5f)
+		{
+			nvgText(ctx, fx, y, from, pos[k + 1].str);
+			from = pos[k + 1].str;
+			fx = x + (k + 1)*w;
+		}
+	}
+
+	nvgText(ctx, fx, y, from, end);
+}
+
+static inline void
+_d2tk_nanovg_grid(d2tk_backend_nanovg_t *backend, d2tk_core_t *core,
+	const d2tk_body_grid_t *body, d2tk_coord_t xo, d2tk_coord_t yo)
+{
+	NVGcontext *ctx = backend->ctx;
+	const d2tk_cell_t *cells = body->cells;
+	const uint32_t ncols = body->ncols;
+	const uint32_t ncells = body->ncols * body->nrows;
+
+	if(ncells == 0)
+	{
+		return;
+	}
+
+	// per-cell done flags and a run of at most one row of utf8 glyphs
+	if(ncells > backend->nmarks)
+	{
+		uint8_t *marks = realloc(backend->marks, ncells);
+		if(!marks)
+		{
+			return;
+		}
+
+		backend->marks = marks;
+		backend->nmarks = ncells;
+	}
+
+	if(4*ncols + 1 > backend->nrun)
+	{
+		char *run = realloc(backend->run, 4*ncols + 1);
+		if(!run)
+		{
+			return;
+		}
+
+		backend->run = run;
+		backend->nrun = 4*ncols + 1;
+	}
+
+	if(ncols > backend->npos)
+	{
+		NVGglyphPosition *pos = realloc(backend->pos,
+			ncols*sizeof(NVGglyphPosition));
+		if(!pos)
+		{
+			return;
+		}
+
+		backend->pos = pos;
+		backend->npos = ncols;
+	}
+
+	uint8_t *marks = backend->marks;
+	const d2tk_coord_t w = body->w / body->ncols;
+	const d2tk_coord_t h = body->h / body->nrows;
+	const d2tk_coord_t x0 = body->x + xo;
+	const d2tk_coord_t y0 = body->y + yo;
+
+	nvgSave(ctx);
+	nvgIntersectScissor(ctx, x0, y0, body->w, body->h);
+	nvgStrokeWidth(ctx, 0);
+
+	// one path and one fill per background color
+	memset(marks, 0x0, ncells);
+
+	for(uint32_t i = 0; i < ncells; i++)
+	{
+		const uint32_t bg = _d2tk_nanovg_cell_bg(&cells[i]);
+
+		if(marks[i] || !bg)
+		{
+			continue;
+		}
+
+		nvgBeginPath(ctx);
+
+		for(uint32_t j = i; j < ncells; )
+		{
+			if(_d2tk_nanovg_cell_bg(&cells[j]) != bg)
+			{
+				j++;
+				continue;
+			}
+
+			const uint32_t y = j / ncols;
+			const uint32_t x = j % ncols;
+			const uint32_t end = (y + 1) * ncols;
+			const uint32_t from = j;
+
+			while( (j < end) && (_d2tk_nanovg_cell_bg(&cells[j]) == bg) )
+			{
+				marks[j++] = 1;
+			}
+
+			nvgRect(ctx, x0 + x*w, y0 + y*h, (j - from)*w, h);
+		}
+
+		nvgFillColor(ctx, _d2tk_nanovg_color(bg));
+		nvgFill(ctx);
+	}
+
+	// one font setup per glyph style, one text call per run of it in a row
+	memset(marks, 0x0, ncells);
+
+	nvgFontSize(ctx, h);
+	nvgTextAlign(ctx, NVG_ALIGN_LEFT | NVG_ALIGN_BOTTOM);
+
+	for(uint32_t i = 0; i < ncells; i++)
+	{
+		if(marks[i] || !cells[i].code)
+		{
+			continue;
+		}
+
+		const uint32_t fg = _d2tk_nanovg_cell_fg(&cells[i]);
+		const char *face = d2tk_body_grid_get_face(body, cells[i].attr);
+		const int id = _d2tk_nanovg_font_face(backend, core, face);
+
+		if(id != -1)
+		{
+			nvgFontFaceId(ctx, id);
+			nvgFillColor(ctx, _d2tk_nanovg_color(fg));
+
+			// stretch glyph advance to cell pitch, runs break at other glyphs
+			nvgTextLetterSpacing(ctx, 0);
+			const float adv = nvgTextBounds(ctx, 0, 0, "M", NULL, NULL);
+			nvgTextLetterSpacing(ctx, w - adv);
+		}
+
+		for(uint32_t j = i; j < ncells; )
+		{
+			if(marks[j] || !cells[j].code
+				|| (_d2tk_nanovg_cell_fg(&cells[j]) != fg)
+				|| (d2tk_body_grid_get_face(body, cells[j].attr) != face) )
+			{
+				j++;
+				continue;
+			}
+
+			const uint32_t y = j / ncols;
+			const uint32_t x = j % ncols;
+			const uint32_t end = (y + 1) * ncols;
+			char *tail = backend->run;
+			uint32_t last = j;
+			int nglyphs = 0;
+
+			// blanks inside a run are spelled as spaces
+			for( ; j < end; j++)
+			{
+				if(!cells[j].code)
+				{
+					continue;
+				}
+
+				if(marks[j] || (_d2tk_nanovg_cell_fg(&cells[j]) != fg)
+					|| (d2tk_body_grid_get_face(body, cells[j].attr) != face) )
+				{
+					break;
+				}
+
+				for( ; last + 1 < j; last++)
+				{
+					*tail++ = ' ';
+					nglyphs++;
+				}
+
+				char *next = utf8catcodepoint(tail, cells[j].code, 4);
+				if(!next) // not encodable, keep the grid aligned
+				{
+					*tail = ' ';
+					next = tail + 1;
+				}
+
+				tail = next;
+				last = j;
+				marks[j] = 1;
+				nglyphs++;
+			}
+
+			*tail = '\0';
+
+			if(id != -1)
+			{
+				_d2tk_nanovg_run(backend, x0 + x*w, y0 + (y + 1)*h, w, backend->run,
+					tail, nglyphs);
+			}
+		}
+	}
+
+	nvgRestore(ctx);
+}
+
 static inline void
 d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 	d2tk_coord_t xo, d2tk_coord_t yo, const d2tk_clip_t *clip, unsigned pass)
@@ -697,27 +1061,12 @@ d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 		{
 			const d2tk_body_font_face_t *body = &com->body->font_face;
 
-			const uint64_t hash = d2tk_hash(body->face, strlen(body->face));
-			uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_FONT);
-			assert(sprite);
+			const int face = _d2tk_nanovg_font_face(backend, core, body->face);
 
-			if(!*sprite)
+			if(face != -1)
 			{
-				char ft_path [1024];
-				d2tk_core_get_font_path(core, backend->bundle_path, body->face,
-					sizeof(ft_path), ft_path);
-
-				const int face = nvgCreateFont(ctx, body->face, ft_path);
-				if(face == -1)
-				{
-					fprintf(stderr, "nvgCreateFont failed on '%s'\n", ft_path);
-					break;
-				}
-
-				*sprite = (uintptr_t)face;
+				nvgFontFaceId(ctx, face);
 			}
-
-			nvgFontFaceId(ctx, *sprite);
 		} break;
 		case D2TK_INSTR_FONT_SIZE:
 		{
@@ -772,7 +1121,10 @@ d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 		{
 			const d2tk_body_image_t *body = &com->body->image;
 
-			const uint64_t hash = d2tk_hash(body->path, strlen(body->path));
+			// thumbnail sized to power-of-two bucket, e.g. 0 for original size
+			const uint32_t bucket = d2tk_loader_bucket(body->w, body->h);
+			const uint64_t hash = d2tk_hash_foreach(body->path, strlen(body->path),
+				&bucket, sizeof(bucket), NULL);
 			uintptr_t *sprite = d2tk_core_get_sprite(core, hash, SPRITE_TYPE_IMG);
 			assert(sprite);
 
@@ -781,10 +1133,28 @@ d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 				char *img_path = _absolute_path(backend, body->path);
 				assert(img_path);
 
-				struct stat st;
-				if(stat(img_path, &st) == 0)
+				if(backend->loader)
 				{
-					*sprite = nvgCreateImage(ctx, img_path, NVG_IMAGE_GENERATE_MIPMAPS);
+					uint8_t *pixels = NULL;
+					int W, H;
+
+					// upload on GL thread as soon as decoded off-thread
+					if(d2tk_loader_get(backend->loader, hash, img_path, bucket,
+						&pixels, &W, &H) == D2TK_LOADER_STATUS_READY)
+					{
+						*sprite = nvgCreateImageRGBA(ctx, W, H, NVG_IMAGE_GENERATE_MIPMAPS,
+							pixels);
+
+						d2tk_loader_pixels_free(pixels);
+					}
+				}
+				else
+				{
+					struct stat st;
+					if(stat(img_path, &st) == 0)
+					{
+						*sprite = nvgCreateImage(ctx, img_path, NVG_IMAGE_GENERATE_MIPMAPS);
+					}
 				}
 
 				free(img_path);
@@ -797,6 +1167,15 @@ d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 				_d2tk_nanovg_surf_draw(ctx, img, xo, yo, body->align,
 						&D2TK_RECT(body->x, body->y, body->w, body->h));
 			}
+			else // draw placeholder while pending
+			{
+				nvgSave(ctx);
+				nvgBeginPath(ctx);
+				nvgRect(ctx, body->x + xo, body->y + yo, body->w, body->h);
+				nvgFillColor(ctx, nvgRGBA(0x80, 0x80, 0x80, 0x20));
+				nvgFill(ctx);
+				nvgRestore(ctx);
+			}
 		} break;
 		case D2TK_INSTR_BITMAP:
 		{
@@ -835,6 +1214,12 @@ d2tk_nanovg_process(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 
 			nvgStrokeWidth(ctx, body->width);
 		} break;
+		case D2TK_INSTR_GRID:
+		{
+			const d2tk_body_grid_t *body = &com->body->grid;
+
+			_d2tk_nanovg_grid(backend, core, body, xo, yo);
+		} break;
 		default:
 		{
 			fprintf(stderr, "%s: unknown command (%i)\n", __func__, com->instr);
@@ -851,5 +1236,7 @@ const d2tk_core_driver_t d2tk_core_driver = {
 	.post = d2tk_nanovg_post,
 	.end = d2tk_nanovg_end,
 	.sprite_free = d2tk_nanovg_sprite_free,
-	.text_extent = d2tk_nanovg_text_extent
+	.text_extent = d2tk_nanovg_text_extent,
+	.again = d2tk_nanovg_again,
+	.damage = d2tk_nanovg_damage
 };
@@ -18,8 +18,12 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <errno.h>
 #include <inttypes.h>
-#if !defined(_WIN32)
+#if defined(__linux__)
+#	include <unistd.h>
+#	include <sys/epoll.h>
+#elif !defined(_WIN32)
 #	include <poll.h>
 #endif
 
@@ -90,6 +94,102 @@ _d2tk_flip_clear_old(d2tk_flip_t *flip)
 	_d2tk_flip_set_old(flip, 0);
 }
 
+static int
+_d2tk_base_watch(d2tk_base_t *base, int fd)
+{
+#if defined(__linux__)
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.fd = fd
+	};
+
+	if(epoll_ctl(base->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+	{
+		// fd may be watched already, e.g. by another atom
+		if( (errno != EEXIST)
+			|| (epoll_ctl(base->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1) )
+		{
+			fprintf(stderr, "[%s] epoll_ctl failed '%s'\n", __func__,
+				strerror(errno));
+			return 1;
+		}
+	}
+#else
+	(void)base;
+	(void)fd;
+#endif
+
+	return 0;
+}
+
+static void
+_d2tk_base_unwatch(d2tk_base_t *base, int fd)
+{
+#if defined(__linux__)
+	if(epoll_ctl(base->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1)
+	{
+		// already removed by closing it
+	}
+#else
+	(void)base;
+	(void)fd;
+#endif
+}
+
+static void
+_d2tk_atom_unwatch(d2tk_base_t *base, d2tk_atom_t *atom)
+{
+	if(atom->fd > 0)
+	{
+		_d2tk_base_unwatch(base, atom->fd);
+		base->nwatch--;
+	}
+
+	atom->fd = 0;
+}
+
+static void
+_d2tk_atom_watch(d2tk_base_t *base, d2tk_atom_t *atom)
+{
+	const int fd = atom->event(D2TK_ATOM_EVENT_FD, atom->body);
+
+	// only touch the epoll set when the fd has changed
+	if(fd == atom->fd)
+	{
+		return;
+	}
+
+	_d2tk_atom_unwatch(base, atom);
+
+	if( (fd > 0) && (_d2tk_base_watch(base, fd) == 0) )
+	{
+		atom->fd = fd;
+		base->nwatch++;
+	}
+}
+
+void
+_d2tk_base_unwatch_atom(d2tk_base_t *base, d2tk_id_t id)
+{
+	for(unsigned i = 0, idx = (id + i*i) & _D2TK_MASK_ATOMS;
+		i < _D2TK_MAX_ATOM;
+		i++, idx = (id + i*i) & _D2TK_MASK_ATOMS)
+	{
+		d2tk_atom_t *atom = &base->atoms[idx];
+
+		if(atom->id == id)
+		{
+			_d2tk_atom_unwatch(base, atom);
+			return;
+		}
+
+		if(atom->id == 0)
+		{
+			return;
+		}
+	}
+}
+
 void *
 _d2tk_base_get_atom(d2tk_base_t *base, d2tk_id_t id, d2tk_atom_type_t type,
 	d2tk_atom_event_t event)
@@ -134,6 +234,10 @@ _d2tk_base_get_atom(d2tk_base_t *base, d2tk_id_t id, d2tk_atom_type_t type,
 				{
 					len = d2tk_atom_body_lineedit_sz;
 				} break;
+				case D2TK_ATOM_TEXTEDIT:
+				{
+					len = d2tk_atom_body_textedit_sz;
+				} break;
 #if D2TK_EVDEV
 				case D2TK_ATOM_VKB:
 				{
@@ -150,6 +254,8 @@ _d2tk_base_get_atom(d2tk_base_t *base, d2tk_id_t id, d2tk_atom_type_t type,
 				} break;
 			}
 
+			_d2tk_atom_unwatch(base, atom);
+
 			if(len == 0)
 			{
 				if(atom->event)
@@ -173,6 +279,11 @@ _d2tk_base_get_atom(d2tk_base_t *base, d2tk_id_t id, d2tk_atom_type_t type,
 			}
 		}
 
+		if(atom->event)
+		{
+			_d2tk_atom_watch(base, atom);
+		}
+
 		atom->ttl = 32; //FIXME
 		return atom->body;
 	}
@@ -783,6 +894,15 @@ d2tk_base_new(const d2tk_core_driver_t *driver, void *data)
 
 	atomic_init(&base->again, false);
 
+#if defined(__linux__)
+	base->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(base->epoll_fd == -1)
+	{
+		free(base);
+		return NULL;
+	}
+#endif
+
 	base->core = d2tk_core_new(driver, data);
 
 	return base;
@@ -795,8 +915,10 @@ d2tk_base_set_ttls(d2tk_base_t *base, uint32_t sprites, uint32_t memcaches)
 }
 
 static void
-_d2tk_atom_deinit(d2tk_atom_t *atom)
+_d2tk_atom_deinit(d2tk_base_t *base, d2tk_atom_t *atom)
 {
+	_d2tk_atom_unwatch(base, atom);
+
 	atom->id = 0;
 	atom->type = 0;
 	if(atom->event)
@@ -816,12 +938,24 @@ _d2tk_atom_gc(d2tk_base_t *base)
 	{
 		d2tk_atom_t *atom = &base->atoms[i];
 
-		if(!atom->id || (--atom->ttl > 0) )
+		if(!atom->id)
 		{
 			continue;
 		}
 
-		_d2tk_atom_deinit(atom);
+		if(--atom->ttl > 0)
+		{
+			// atoms may create their file descriptor while drawing, pick it up
+			// before the frontend goes to sleep
+			if(atom->event)
+			{
+				_d2tk_atom_watch(base, atom);
+			}
+
+			continue;
+		}
+
+		_d2tk_atom_deinit(base, atom);
 	}
 }
 
@@ -832,7 +966,7 @@ _d2tk_atom_free(d2tk_base_t *base)
 	{
 		d2tk_atom_t *atom = &base->atoms[i];
 
-		_d2tk_atom_deinit(atom);
+		_d2tk_atom_deinit(base, atom);
 	}
 }
 
@@ -841,6 +975,9 @@ d2tk_base_free(d2tk_base_t *base)
 {
 	_d2tk_atom_free(base);
 	d2tk_core_free(base->core);
+#if defined(__linux__)
+	close(base->epoll_fd);
+#endif
 	free(base);
 }
 
@@ -901,6 +1038,38 @@ d2tk_base_post(d2tk_base_t *base)
 	d2tk_core_post(base->core);
 }
 
+#if defined(__linux__)
+D2TK_API void
+d2tk_base_probe(d2tk_base_t *base)
+{
+	struct epoll_event ev;
+
+	if(base->nwatch == 0)
+	{
+		return;
+	}
+
+	// level-triggered, thus readiness is left for the widgets to consume
+	if(epoll_wait(base->epoll_fd, &ev, 1, 0) > 0)
+	{
+		d2tk_base_set_again(base);
+	}
+}
+
+D2TK_API int
+d2tk_base_get_file_descriptors(d2tk_base_t *base, int *fds, int numfds)
+{
+	if( (base->nwatch == 0) || (numfds < 1) )
+	{
+		return 0;
+	}
+
+	// epoll fd becomes readable whenever one of the watched fds does
+	fds[0] = base->epoll_fd;
+
+	return 1;
+}
+#else
 static int
 _d2tk_base_probe(int fd)
 {
@@ -951,10 +1120,19 @@ d2tk_base_probe(d2tk_base_t *base)
 			if(_d2tk_base_probe(fd))
 			{
 				d2tk_base_set_again(base);
-				break;
+				return;
 			}
 		}
 	}
+
+	for(unsigned i = 0; i < _D2TK_MAX_FD; i++)
+	{
+		if(_d2tk_base_probe(base->fds[i]))
+		{
+			d2tk_base_set_again(base);
+			return;
+		}
+	}
 }
 
 D2TK_API int
@@ -977,8 +1155,62 @@ d2tk_base_get_file_descriptors(d2tk_base_t *base, int *fds, int numfds)
 		}
 	}
 
+	for(unsigned i = 0; i < _D2TK_MAX_FD; i++)
+	{
+		const int fd = base->fds[i];
+
+		if( (fd > 0) && (idx < numfds) )
+		{
+			fds[idx++] = fd;
+		}
+	}
+
 	return idx;
 }
+#endif
+
+D2TK_API int
+d2tk_base_add_file_descriptor(d2tk_base_t *base, int fd)
+{
+	if(fd <= 0)
+	{
+		return 1;
+	}
+
+	for(unsigned i = 0; i < _D2TK_MAX_FD; i++)
+	{
+		if(base->fds[i] <= 0)
+		{
+			if(_d2tk_base_watch(base, fd) != 0)
+			{
+				return 1;
+			}
+
+			base->fds[i] = fd;
+			base->nwatch++;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+D2TK_API int
+d2tk_base_remove_file_descriptor(d2tk_base_t *base, int fd)
+{
+	for(unsigned i = 0; i < _D2TK_MAX_FD; i++)
+	{
+		if( (fd > 0) && (base->fds[i] == fd) )
+		{
+			base->fds[i] = 0;
+			_d2tk_base_unwatch(base, fd);
+			base->nwatch--;
+			return 0;
+		}
+	}
+
+	return 1;
+}
 
 D2TK_API void
 d2tk_base_clear_focus(d2tk_base_t *base)
@@ -995,7 +1227,9 @@ d2tk_base_set_again(d2tk_base_t *base)
 D2TK_API bool
 d2tk_base_get_again(d2tk_base_t *base)
 {
-	return atomic_exchange(&base->again, false);
+	const bool again = atomic_exchange(&base->again, false);
+
+	return d2tk_core_get_again(base->core) || again;
 }
 
 D2TK_API void
@@ -24,6 +24,8 @@
 #define _D2TK_MAX_ATOM 0x1000
 #define _D2TK_MASK_ATOMS (_D2TK_MAX_ATOM - 1)
 
+#define _D2TK_MAX_FD 8
+
 typedef enum _d2tk_atom_type_t {
 	D2TK_ATOM_NONE,
 	D2TK_ATOM_SCROLL,
@@ -33,6 +35,7 @@ typedef enum _d2tk_atom_type_t {
 	D2TK_ATOM_FLOW_ARC,
 	D2TK_ATOM_PTY,
 	D2TK_ATOM_LINEEDIT,
+	D2TK_ATOM_TEXTEDIT,
 #if D2TK_EVDEV
 	D2TK_ATOM_VKB,
 #endif
@@ -59,6 +62,7 @@ struct _d2tk_atom_t {
 	uint32_t ttl;
 	void *body;
 	d2tk_atom_event_t event;
+	int fd; // currently watched file descriptor
 };
 
 struct _d2tk_base_t {
@@ -118,6 +122,9 @@ struct _d2tk_base_t {
 	d2tk_core_t *core;
 
 	d2tk_atom_t atoms [_D2TK_MAX_ATOM];
+	int fds [_D2TK_MAX_FD];
+	int epoll_fd;
+	unsigned nwatch;
 };
 
 extern const size_t d2tk_atom_body_flow_sz;
@@ -125,6 +132,7 @@ extern const size_t d2tk_atom_body_pane_sz;
 extern const size_t d2tk_atom_body_scroll_sz;
 extern const size_t d2tk_atom_body_pty_sz;
 extern const size_t d2tk_atom_body_lineedit_sz;
+extern const size_t d2tk_atom_body_textedit_sz;
 #if D2TK_EVDEV
 extern const size_t d2tk_atom_body_vkb_sz;
 #endif
@@ -133,6 +141,9 @@ void *
 _d2tk_base_get_atom(d2tk_base_t *base, d2tk_id_t id, d2tk_atom_type_t type,
 	d2tk_atom_event_t event);
 
+void
+_d2tk_base_unwatch_atom(d2tk_base_t *base, d2tk_id_t id);
+
 d2tk_state_t
 _d2tk_base_is_active_hot_vertical_scroll(d2tk_base_t *base);
 
@@ -146,6 +157,9 @@ d2tk_state_t
 _d2tk_base_tooltip_draw(d2tk_base_t *base, ssize_t lbl_len, const char *lbl,
 	d2tk_coord_t h);
 
+const size_t *
+_d2tk_base_textedit_lines(d2tk_base_t *base, d2tk_id_t id, size_t *nlines);
+
 d2tk_pty_t *
 d2tk_pty_begin_state(d2tk_base_t *base, d2tk_id_t id, d2tk_state_t state,
 	d2tk_base_pty_cb_t cb, void *data, d2tk_coord_t height,
@@ -27,6 +27,8 @@
 #include <limits.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdatomic.h>
 
@@ -38,9 +40,6 @@
 #define DEFAULT_FG_LIGHT 0xdddddd7f
 #define DEFAULT_BG_LIGHT 0x2222227f
 
-#define NROWS_MAX 512
-#define NCOLS_MAX 512
-
 #define MAX(x, y) (x > y ? y : x)
 
 #define FONT_CODE_LIGHT   "FiraCode:light"
@@ -48,8 +47,13 @@
 #define FONT_CODE_MEDIUM  "FiraCode:medium"
 #define FONT_CODE_BOLD    "FiraCode:bold"
 
+#define RING_SZ   0x10000 // must be a power of two
+#define RING_MASK (RING_SZ - 1)
+#define SLICE_SZ  0x4000 // max bytes fed to libvterm per frame
+
 typedef struct _col_t col_t;
-typedef struct _cell_t cell_t;
+typedef struct _row_t row_t;
+typedef struct _reader_t reader_t;
 typedef struct _d2tk_atom_body_pty_t d2tk_atom_body_pty_t;
 typedef struct _d2tk_pty_t d2tk_pty_t;
 typedef struct _thread_data_t thread_data_t;
@@ -61,15 +65,23 @@ struct _col_t {
 	uint8_t b;
 };
 
-struct _cell_t {
-	char lbl [8];
-	size_t lbl_len;
-	bool bold;
-	bool italic;
-	bool reverse;
-	bool cursor;
-	uint32_t fg;
-	uint32_t bg;
+struct _row_t {
+	uint64_t hash;
+	int from; // first damaged column
+	int to; // one past last damaged column
+};
+
+// single-producer (reader thread), single-consumer (UI thread) ring
+struct _reader_t {
+	pthread_t thread;
+	atomic_bool running;
+	atomic_bool stalled; // ring was full, reader waits for wake_fd
+	atomic_size_t head; // written by reader thread only
+	atomic_size_t tail; // written by UI thread only
+	int fd; // pty master
+	int event_fd; // reader -> UI, bytes available
+	int wake_fd; // UI -> reader, space available or stop
+	uint8_t *buf;
 };
 
 struct _thread_data_t {
@@ -99,6 +111,8 @@ struct _d2tk_atom_body_pty_t {
 	thread_data_t thread_data;
 	bool is_threaded;
 
+	reader_t reader;
+
 	VTerm *vterm;
 	VTermScreen *screen;
 	VTermState *state;
@@ -108,12 +122,17 @@ struct _d2tk_atom_body_pty_t {
 
 	bool cursor_visible;
 	int cursor_shape;
+	VTermPos cursor;
 
 	col_t max_red;
 	col_t max_green;
 	col_t max_blue;
 
-	cell_t cells [NROWS_MAX][NCOLS_MAX];
+	d2tk_coord_t grid_ncols;
+	d2tk_coord_t grid_nrows;
+	uint64_t hash;
+	row_t *rows;
+	d2tk_cell_t *cells;
 };
 
 struct _d2tk_pty_t {
@@ -136,38 +155,256 @@ _term_light(d2tk_atom_body_pty_t *vpty)
 	return vpty->light;
 }
 
-static inline int
-_term_read(d2tk_atom_body_pty_t *vpty,
-	void (*cb)(const char *buf, size_t len, void *data), void *data)
+static inline void
+_reader_signal(int fd)
 {
-	char buf [4096];
-	int count = 0;
+	const uint64_t cnt = 1;
 
-	while(true)
+	if(write(fd, &cnt, sizeof(cnt)) == -1)
 	{
-		const ssize_t len = read(vpty->fd, buf, sizeof(buf));
+		// counter saturated, thus already signaled
+	}
+}
 
-		if(len == -1)
+static void *
+_reader_thread(void *data)
+{
+	reader_t *reader = data;
+
+	while(atomic_load(&reader->running))
+	{
+		const size_t head = atomic_load_explicit(&reader->head,
+			memory_order_relaxed);
+		size_t space = RING_SZ - (head - atomic_load_explicit(&reader->tail,
+			memory_order_acquire));
+
+		if(space == 0)
 		{
-			if(errno != EAGAIN)
+			atomic_store(&reader->stalled, true);
+
+			// re-check, UI may have drained in-between
+			space = RING_SZ - (head - atomic_load(&reader->tail));
+
+			if(space != 0)
 			{
-				//FIXME fprintf(stderr, "[%s] read failed '%s'\n", __func__, strerror(errno));
+				atomic_store(&reader->stalled, false);
 			}
+		}
+
+		struct pollfd fds [2] = {
+			[0] = {
+				.fd = reader->wake_fd,
+				.events = POLLIN
+			},
+			[1] = {
+				.fd = reader->fd,
+				.events = POLLIN
+			}
+		};
+
+		// do not poll pty master while full, child blocks on write instead
+		if(poll(fds, space ? 2 : 1, -1) == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "[%s] poll failed '%s'\n", __func__, strerror(errno));
 			break;
 		}
 
+		if(fds[0].revents & POLLIN)
+		{
+			uint64_t cnt;
+
+			if(read(reader->wake_fd, &cnt, sizeof(cnt)) == -1)
+			{
+				// spurious wakeup
+			}
+		}
+
+		if( (space == 0) || (fds[1].revents == 0) )
+		{
+			continue;
+		}
+
+		const size_t off = head & RING_MASK;
+		const size_t max = RING_SZ - off;
+		const ssize_t len = read(reader->fd, &reader->buf[off],
+			space < max ? space : max);
+
+		if(len == -1)
+		{
+			if( (errno == EAGAIN) || (errno == EINTR) )
+			{
+				continue;
+			}
+
+			break; // EIO, slave side has been closed
+		}
+
 		if(len == 0)
 		{
-			break;;
+			break;
+		}
+
+		atomic_store_explicit(&reader->head, head + len, memory_order_release);
+		_reader_signal(reader->event_fd);
+	}
+
+	// wake up UI for it to notice hang-up
+	_reader_signal(reader->event_fd);
+
+	return NULL;
+}
+
+static int
+_reader_init(reader_t *reader, int fd)
+{
+	reader->fd = fd;
+	reader->event_fd = -1;
+	reader->wake_fd = -1;
+	atomic_init(&reader->head, 0);
+	atomic_init(&reader->tail, 0);
+	atomic_init(&reader->stalled, false);
+	atomic_init(&reader->running, true);
+
+	reader->buf = malloc(RING_SZ);
+	if(!reader->buf)
+	{
+		return 1;
+	}
+
+	reader->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(reader->event_fd == -1)
+	{
+		return 1;
+	}
+
+	reader->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(reader->wake_fd == -1)
+	{
+		return 1;
+	}
+
+	if(pthread_create(&reader->thread, NULL, _reader_thread, reader) != 0)
+	{
+		reader->thread = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+_reader_deinit(reader_t *reader)
+{
+	if(reader->thread)
+	{
+		atomic_store(&reader->running, false);
+		_reader_signal(reader->wake_fd);
+
+		pthread_join(reader->thread, NULL);
+		reader->thread = 0;
+	}
+
+	if(reader->event_fd != -1)
+	{
+		close(reader->event_fd);
+		reader->event_fd = -1;
+	}
+
+	if(reader->wake_fd != -1)
+	{
+		close(reader->wake_fd);
+		reader->wake_fd = -1;
+	}
+
+	free(reader->buf);
+	reader->buf = NULL;
+}
+
+// fallback without reader thread, drain pty master on the UI thread
+static inline size_t
+_term_read_master(d2tk_atom_body_pty_t *vpty,
+	void (*cb)(const char *buf, size_t len, void *data), void *data,
+	size_t *rest)
+{
+	char buf [4096];
+	size_t count = 0;
+
+	*rest = 0;
+
+	while(count < SLICE_SZ)
+	{
+		const ssize_t len = read(vpty->fd, buf, sizeof(buf));
+
+		if(len <= 0)
+		{
+			return count; // EAGAIN, or EIO as slave side has been closed
 		}
 
 		cb(buf, len, data);
-		count += 1;
+		count += len;
 	}
 
+	*rest = 1; // there may be more, try again next frame
+
 	return count;
 }
 
+static inline size_t
+_term_read(d2tk_atom_body_pty_t *vpty,
+	void (*cb)(const char *buf, size_t len, void *data), void *data,
+	size_t *rest)
+{
+	reader_t *reader = &vpty->reader;
+	uint64_t cnt;
+
+	*rest = 0;
+
+	if(!reader->thread)
+	{
+		return vpty->fd
+			? _term_read_master(vpty, cb, data, rest)
+			: 0;
+	}
+
+	// clear notification before draining, thus no later signal gets lost
+	if(read(reader->event_fd, &cnt, sizeof(cnt)) == -1)
+	{
+		// nothing signaled
+	}
+
+	const size_t tail = atomic_load_explicit(&reader->tail,
+		memory_order_relaxed);
+	const size_t avail = atomic_load_explicit(&reader->head,
+		memory_order_acquire) - tail;
+	const size_t len = avail < SLICE_SZ ? avail : SLICE_SZ;
+
+	for(size_t done = 0; done < len; )
+	{
+		const size_t off = (tail + done) & RING_MASK;
+		const size_t max = RING_SZ - off;
+		const size_t sz = (len - done) < max ? (len - done) : max;
+
+		cb((const char *)&reader->buf[off], sz, data);
+		done += sz;
+	}
+
+	atomic_store_explicit(&reader->tail, tail + len, memory_order_release);
+
+	if( (len != 0) && atomic_exchange(&reader->stalled, false) )
+	{
+		_reader_signal(reader->wake_fd);
+	}
+
+	*rest = avail - len;
+
+	return len;
+}
+
 static inline void
 _term_clear(d2tk_atom_body_pty_t *vpty)
 {
@@ -261,6 +498,175 @@ _term_output(const char *buf, size_t len, void *data)
 	}
 }
 
+static inline d2tk_cell_t *
+_term_cell(d2tk_atom_body_pty_t *vpty, int row, int col)
+{
+	return &vpty->cells[row*vpty->grid_ncols + col];
+}
+
+static inline void
+_term_damage(d2tk_atom_body_pty_t *vpty, VTermRect rect)
+{
+	if(rect.start_row < 0)
+	{
+		rect.start_row = 0;
+	}
+	if(rect.end_row > vpty->grid_nrows)
+	{
+		rect.end_row = vpty->grid_nrows;
+	}
+	if(rect.start_col < 0)
+	{
+		rect.start_col = 0;
+	}
+	if(rect.end_col > vpty->grid_ncols)
+	{
+		rect.end_col = vpty->grid_ncols;
+	}
+
+	if(rect.start_col >= rect.end_col)
+	{
+		return;
+	}
+
+	for(int y = rect.start_row; y < rect.end_row; y++)
+	{
+		row_t *row = &vpty->rows[y];
+
+		if(row->from >= row->to)
+		{
+			row->from = rect.start_col;
+			row->to = rect.end_col;
+			continue;
+		}
+
+		if(rect.start_col < row->from)
+		{
+			row->from = rect.start_col;
+		}
+		if(rect.end_col > row->to)
+		{
+			row->to = rect.end_col;
+		}
+	}
+}
+
+static inline void
+_term_damage_all(d2tk_atom_body_pty_t *vpty)
+{
+	const VTermRect rect = {
+		.start_row = 0,
+		.end_row = vpty->grid_nrows,
+		.start_col = 0,
+		.end_col = vpty->grid_ncols
+	};
+
+	_term_damage(vpty, rect);
+}
+
+static inline int
+_term_grid_resize(d2tk_atom_body_pty_t *vpty, d2tk_coord_t nrows,
+	d2tk_coord_t ncols)
+{
+	if( (nrows == vpty->grid_nrows) && (ncols == vpty->grid_ncols) )
+	{
+		return 0;
+	}
+
+	free(vpty->rows);
+	free(vpty->cells);
+
+	vpty->rows = NULL;
+	vpty->cells = NULL;
+	vpty->grid_nrows = 0;
+	vpty->grid_ncols = 0;
+
+	if( (nrows <= 0) || (ncols <= 0) )
+	{
+		return 0;
+	}
+
+	vpty->rows = calloc(nrows, sizeof(row_t));
+	vpty->cells = calloc(nrows*ncols, sizeof(d2tk_cell_t));
+
+	if(!vpty->rows || !vpty->cells)
+	{
+		free(vpty->rows);
+		free(vpty->cells);
+
+		vpty->rows = NULL;
+		vpty->cells = NULL;
+
+		return 1;
+	}
+
+	vpty->grid_nrows = nrows;
+	vpty->grid_ncols = ncols;
+
+	_term_damage_all(vpty);
+
+	return 0;
+}
+
+static int
+_screen_damage(VTermRect rect, void *data)
+{
+	d2tk_atom_body_pty_t *vpty = data;
+
+	_term_damage(vpty, rect);
+
+	return 1;
+}
+
+static int
+_screen_moverect(VTermRect dst, VTermRect src, void *data)
+{
+	d2tk_atom_body_pty_t *vpty = data;
+	const int nrows = dst.end_row - dst.start_row;
+	const int ncols = dst.end_col - dst.start_col;
+
+	if( (dst.start_row < 0) || (src.start_row < 0)
+		|| (dst.end_row > vpty->grid_nrows) || (src.end_row > vpty->grid_nrows)
+		|| (dst.start_col < 0) || (src.start_col < 0)
+		|| (dst.end_col > vpty->grid_ncols) || (src.end_col > vpty->grid_ncols) )
+	{
+		_term_damage(vpty, dst);
+		return 1;
+	}
+
+	// whole rows keep their cached hash and pending damage while moving
+	const bool whole = (dst.start_col == 0) && (ncols == vpty->grid_ncols);
+	const bool down = dst.start_row > src.start_row;
+
+	for(int i = 0; i < nrows; i++)
+	{
+		const int j = down ? nrows - 1 - i : i;
+		const int ys = src.start_row + j;
+		const int yd = dst.start_row + j;
+
+		memmove(_term_cell(vpty, yd, dst.start_col),
+			_term_cell(vpty, ys, src.start_col), ncols * sizeof(d2tk_cell_t));
+
+		if(whole)
+		{
+			vpty->rows[yd] = vpty->rows[ys];
+		}
+		else
+		{
+			const VTermRect rect = {
+				.start_row = yd,
+				.end_row = yd + 1,
+				.start_col = dst.start_col,
+				.end_col = dst.end_col
+			};
+
+			_term_damage(vpty, rect);
+		}
+	}
+
+	return 1;
+}
+
 static int
 _screen_settermprop(VTermProp prop, VTermValue *val, void *data)
 {
@@ -316,6 +722,8 @@ _screen_resize(int nrows, int ncols, void *data)
 	vpty->nrows = nrows;
 	vpty->ncols = ncols;
 
+	_term_damage_all(vpty);
+
 	return 0;
 }
 
@@ -330,6 +738,8 @@ _screen_bell(void *data)
 }
 
 static const VTermScreenCallbacks screen_callbacks = {
+	.damage = _screen_damage,
+	.moverect = _screen_moverect,
 	.settermprop = _screen_settermprop,
 	.bell = _screen_bell,
   .resize = _screen_resize
@@ -478,10 +888,18 @@ _term_init(d2tk_atom_body_pty_t *vpty, d2tk_base_pty_cb_t cb, void *data,
 	d2tk_coord_t height, d2tk_coord_t ncols, d2tk_coord_t nrows)
 {
 	vpty->is_threaded = cb ? true : false;
+	vpty->reader.event_fd = -1;
+	vpty->reader.wake_fd = -1;
 	vpty->height = height;
 	vpty->nrows = nrows;
 	vpty->ncols = ncols;
 
+	if(_term_grid_resize(vpty, vpty->nrows, vpty->ncols) != 0)
+	{
+		fprintf(stderr, "[%s] grid allocation failed\n", __func__);
+		return 1;
+	}
+
 	struct termios termios = {
 		.c_iflag = ICRNL|IXON,
 		.c_oflag = OPOST|ONLCR
@@ -560,6 +978,13 @@ _term_init(d2tk_atom_body_pty_t *vpty, d2tk_base_pty_cb_t cb, void *data,
 
   fcntl(vpty->fd, F_SETFL, fcntl(vpty->fd, F_GETFL) | O_NONBLOCK);
 
+	if(_reader_init(&vpty->reader, vpty->fd) != 0)
+	{
+		fprintf(stderr, "[%s] reader thread failed to start, reading on UI thread\n",
+			__func__);
+		_reader_deinit(&vpty->reader);
+	}
+
 	vpty->vterm = vterm_new(vpty->nrows, vpty->ncols);
 	vterm_set_utf8(vpty->vterm, 1);
 	vterm_output_set_callback(vpty->vterm, _term_output, vpty);
@@ -568,6 +993,7 @@ _term_init(d2tk_atom_body_pty_t *vpty, d2tk_base_pty_cb_t cb, void *data,
 
 	vpty->screen = vterm_obtain_screen(vpty->vterm);
 	vterm_screen_set_callbacks(vpty->screen, &screen_callbacks, vpty);
+	vterm_screen_set_damage_merge(vpty->screen, VTERM_DAMAGE_SCROLL);
 	vterm_screen_reset(vpty->screen, 1);
 
 	return 0;
@@ -576,7 +1002,10 @@ _term_init(d2tk_atom_body_pty_t *vpty, d2tk_base_pty_cb_t cb, void *data,
 static int
 _term_fd(d2tk_atom_body_pty_t *vpty)
 {
-	return vpty->fd;
+	// without reader thread, get woken up by the pty master itself
+	return vpty->reader.thread
+		? vpty->reader.event_fd
+		: vpty->fd;
 }
 
 static int
@@ -663,10 +1092,17 @@ _term_deinit(d2tk_atom_body_pty_t *vpty)
 		return 1;
 	}
 
+	if(vpty->height == 0) // not initialized
+	{
+		return 0;
+	}
+
 	const int ret = vpty->is_threaded
 		? _term_deinit_thread(vpty)
 		: _term_deinit_fork(vpty);
 
+	_reader_deinit(&vpty->reader);
+
 	if(vpty->vterm)
 	{
 		vterm_free(vpty->vterm);
@@ -679,6 +1115,9 @@ _term_deinit(d2tk_atom_body_pty_t *vpty)
 		vpty->fd = 0;
 	}
 
+	free(vpty->rows);
+	free(vpty->cells);
+
 	memset(vpty, 0x0, sizeof(d2tk_atom_body_pty_t));
 
 	return ret;
@@ -803,118 +1242,149 @@ _term_set_colors(d2tk_atom_body_pty_t *vpty, uint32_t fg)
 }
 
 static inline void
-_term_update(d2tk_atom_body_pty_t *vpty)
+_term_update_cell(d2tk_atom_body_pty_t *vpty, VTermPos pos)
 {
-	VTermPos cursor;
-	VTermPos pos;
+	d2tk_cell_t *tar = _term_cell(vpty, pos.row, pos.col);
 
-	memset(&cursor, 0x0, sizeof(cursor));
-	vterm_state_get_cursorpos(vpty->state, &cursor);
+	memset(tar, 0x0, sizeof(d2tk_cell_t));
 
-	memset(vpty->cells, 0x0, sizeof(vpty->cells));
+	VTermScreenCell cell;
+	memset(&cell, 0x0, sizeof(cell));
+	vterm_screen_get_cell(vpty->screen, pos, &cell);
 
-	for(int y = 0; y < vpty->nrows; y++)
+	if( cell.chars[0] && (cell.width == 1) )
 	{
-		pos.row = y;
-
-		for(int x = 0; x < vpty->ncols; x++)
+		if(cell.chars[0] != ' ')
 		{
-			cell_t *tar = &vpty->cells[y][x];
+			tar->code = cell.chars[0];
+		}
+	}
 
-			pos.col = x;
+	if(cell.attrs.bold)
+	{
+		tar->attr |= D2TK_CELL_BOLD;
+	}
 
-			VTermScreenCell cell;
-			memset(&cell, 0x0, sizeof(cell));
-			vterm_screen_get_cell(vpty->screen, pos, &cell);
+	if(cell.attrs.italic)
+	{
+		tar->attr |= D2TK_CELL_ITALIC;
+	}
 
-			if( cell.chars[0] && (cell.width == 1) )
-			{
-				if(cell.chars[0] != ' ')
-				{
-					const char *tail = utf8catcodepoint(tar->lbl,
-						cell.chars[0], sizeof(tar->lbl));
+	if(cell.attrs.reverse)
+	{
+		tar->attr |= D2TK_CELL_REVERSE;
+	}
 
-					tar->lbl_len = tail - tar->lbl;
-				}
-			}
+	uint32_t fg_rgba = 0x0;
+	uint32_t bg_rgba = 0x0;
 
-			if(cell.attrs.bold)
-			{
-				tar->bold = true;
-			}
+	if(VTERM_COLOR_IS_RGB(&cell.fg))
+	{
+		const VTermColor tmp = cell.fg;
 
-			if(cell.attrs.italic)
-			{
-				tar->italic = true;
-			}
+		fg_rgba = (tmp.rgb.red << 24)
+			| (tmp.rgb.green << 16)
+			| (tmp.rgb.blue << 8)
+			| 0xff;
+	}
+	else if(VTERM_COLOR_IS_INDEXED(&cell.fg))
+	{
+		VTermColor tmp = cell.fg;
+		vterm_screen_convert_color_to_rgb(vpty->screen, &tmp);
 
-			uint32_t fg_rgba = 0x0;
-			uint32_t bg_rgba = 0x0;
+		fg_rgba = (tmp.rgb.red << 24)
+			| (tmp.rgb.green << 16)
+			| (tmp.rgb.blue << 8)
+			| 0xff;
+	}
+	else if(VTERM_COLOR_IS_DEFAULT_FG(&cell.fg))
+	{
+		fg_rgba = DEFAULT_FG;
+	}
+	else if(VTERM_COLOR_IS_DEFAULT_BG(&cell.fg))
+	{
+		fg_rgba = DEFAULT_BG;
+	}
 
-			if(VTERM_COLOR_IS_RGB(&cell.fg))
-			{
-				const VTermColor tmp = cell.fg;
+	if(VTERM_COLOR_IS_RGB(&cell.bg))
+	{
+		const VTermColor tmp = cell.bg;
 
-				fg_rgba = (tmp.rgb.red << 24)
-					| (tmp.rgb.green << 16)
-					| (tmp.rgb.blue << 8)
-					| 0xff;
-			}
-			else if(VTERM_COLOR_IS_INDEXED(&cell.fg))
-			{
-				VTermColor tmp = cell.fg;
-				vterm_screen_convert_color_to_rgb(vpty->screen, &tmp);
+		bg_rgba = (tmp.rgb.red << 24)
+			| (tmp.rgb.green << 16)
+			| (tmp.rgb.blue << 8)
+			| 0xff;
+	}
+	else if(VTERM_COLOR_IS_INDEXED(&cell.bg))
+	{
+		VTermColor tmp = cell.bg;
+		vterm_screen_convert_color_to_rgb(vpty->screen, &tmp);
 
-				fg_rgba = (tmp.rgb.red << 24)
-					| (tmp.rgb.green << 16)
-					| (tmp.rgb.blue << 8)
-					| 0xff;
-			}
-			else if(VTERM_COLOR_IS_DEFAULT_FG(&cell.fg))
-			{
-				fg_rgba = DEFAULT_FG;
-			}
-			else if(VTERM_COLOR_IS_DEFAULT_BG(&cell.fg))
-			{
-				fg_rgba = DEFAULT_BG;
-			}
+		bg_rgba = (tmp.rgb.red << 24)
+			| (tmp.rgb.green << 16)
+			| (tmp.rgb.blue << 8)
+			| 0xff;
+	}
+	else if(VTERM_COLOR_IS_DEFAULT_FG(&cell.bg))
+	{
+		bg_rgba = 0xffffffff;
+	}
+	else if(VTERM_COLOR_IS_DEFAULT_BG(&cell.bg))
+	{
+		bg_rgba = 0x000000ff;
+	}
 
-			if(VTERM_COLOR_IS_RGB(&cell.bg))
-			{
-				const VTermColor tmp = cell.bg;
+	tar->fg = fg_rgba;
+	tar->bg = bg_rgba;
+}
 
-				bg_rgba = (tmp.rgb.red << 24)
-					| (tmp.rgb.green << 16)
-					| (tmp.rgb.blue << 8)
-					| 0xff;
-			}
-			else if(VTERM_COLOR_IS_INDEXED(&cell.bg))
-			{
-				VTermColor tmp = cell.bg;
-				vterm_screen_convert_color_to_rgb(vpty->screen, &tmp);
+static inline void
+_term_update(d2tk_atom_body_pty_t *vpty)
+{
+	memset(&vpty->cursor, 0x0, sizeof(vpty->cursor));
+	vterm_state_get_cursorpos(vpty->state, &vpty->cursor);
 
-				bg_rgba = (tmp.rgb.red << 24)
-					| (tmp.rgb.green << 16)
-					| (tmp.rgb.blue << 8)
-					| 0xff;
-			}
-			else if(VTERM_COLOR_IS_DEFAULT_FG(&cell.bg))
-			{
-				bg_rgba = 0xffffffff;
-			}
-			else if(VTERM_COLOR_IS_DEFAULT_BG(&cell.bg))
-			{
-				bg_rgba = 0x000000ff;
-			}
+	for(int y = 0; y < vpty->grid_nrows; y++)
+	{
+		row_t *row = &vpty->rows[y];
 
-			tar->cursor = (y == cursor.row) && (x == cursor.col) && vpty->cursor_visible;
-			tar->reverse = cell.attrs.reverse;
-			tar->fg = fg_rgba;
-			tar->bg = bg_rgba;
+		if(row->from >= row->to)
+		{
+			continue;
+		}
 
-			_term_set_colors(vpty, fg_rgba);
+		for(int x = row->from; x < row->to; x++)
+		{
+			const VTermPos pos = {
+				.row = y,
+				.col = x
+			};
+
+			_term_update_cell(vpty, pos);
+		}
+
+		row->from = 0;
+		row->to = 0;
+
+		// rows repainted with identical content skip the color scan
+		const d2tk_cell_t *cells = _term_cell(vpty, y, 0);
+		const uint64_t hash = d2tk_hash(cells, vpty->grid_ncols * sizeof(d2tk_cell_t));
+
+		if(hash == row->hash)
+		{
+			continue;
+		}
+
+		row->hash = hash;
+
+		for(int x = 0; x < vpty->grid_ncols; x++)
+		{
+			_term_set_colors(vpty, cells[x].fg);
 		}
 	}
+
+	// damage spans are all clear, thus this only covers the row hashes
+	vpty->hash = d2tk_hash(vpty->rows, vpty->grid_nrows * sizeof(row_t));
 }
 
 static void
@@ -923,7 +1393,16 @@ _term_resize(d2tk_atom_body_pty_t *vpty, d2tk_coord_t ncols,
 {
 	if( (nrows != vpty->nrows) || (ncols != vpty->ncols) )
 	{
+		vterm_screen_flush_damage(vpty->screen);
+
+		if(_term_grid_resize(vpty, nrows, ncols) != 0)
+		{
+			fprintf(stderr, "[%s] grid allocation failed\n", __func__);
+		}
+
 		vterm_set_size(vpty->vterm, nrows, ncols);
+		vterm_screen_flush_damage(vpty->screen);
+		_term_update(vpty);
 	}
 }
 
@@ -936,12 +1415,21 @@ _term_input_cb(const char *buf, size_t len, void *data)
 }
 
 static inline void
-_term_input(d2tk_atom_body_pty_t *vpty)
+_term_input(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty)
 {
-	if(_term_read(vpty, _term_input_cb, vpty) )
+	size_t rest;
+
+	if(_term_read(vpty, _term_input_cb, vpty, &rest) )
 	{
+		vterm_screen_flush_damage(vpty->screen);
 		_term_update(vpty);
 	}
+
+	if(rest)
+	{
+		// feed remaining output in bounded slices over the next frames
+		d2tk_base_set_again(base);
+	}
 }
 
 static inline d2tk_state_t
@@ -1069,97 +1557,148 @@ _term_behave(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty,
 }
 
 static inline void
-_term_draw(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty,
-	const d2tk_rect_t *rect, bool focus)
+_term_draw_grid(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty,
+	const d2tk_rect_t *rect)
 {
-	D2TK_BASE_TABLE(rect, vpty->ncols, vpty->nrows, D2TK_FLAG_TABLE_REL, tab)
+	const d2tk_hash_dict_t dict [] = {
+		{ rect, sizeof(d2tk_rect_t) },
+		{ &vpty->cells, sizeof(d2tk_cell_t *) },
+		{ &vpty->grid_ncols, sizeof(d2tk_coord_t) },
+		{ &vpty->grid_nrows, sizeof(d2tk_coord_t) },
+		{ &vpty->hash, sizeof(uint64_t) },
+		{ NULL, 0 }
+	};
+	const uint64_t hash = d2tk_hash_dict(dict);
+
+	d2tk_core_t *core = base->core;
+
+	D2TK_CORE_WIDGET(core, hash, widget)
 	{
-		const int x = d2tk_table_get_index_x(tab);
-		const int y = d2tk_table_get_index_y(tab);
-		const d2tk_rect_t *trect = d2tk_table_get_rect(tab);
+		const size_t ref = d2tk_core_bbox_push(core, true, rect);
 
-		const d2tk_style_t *old_style = d2tk_base_get_style(base);
-		d2tk_style_t style = *old_style;
-		cell_t *cell = &vpty->cells[y][x];
+		d2tk_core_grid(core, rect, vpty->grid_ncols, vpty->grid_nrows,
+			vpty->cells, vpty->hash,
+			FONT_CODE_REGULAR, FONT_CODE_BOLD, FONT_CODE_LIGHT);
 
-		style.border_width = 0;
-		style.padding = 0;
-		style.rounding = 0;
+		d2tk_core_bbox_pop(core, ref);
+	}
+}
 
-		uint32_t fg = cell->fg;
-		uint32_t bg = cell->bg;
+static inline void
+_term_draw_cursor(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty,
+	const d2tk_rect_t *rect, bool focus)
+{
+	const d2tk_cell_t *cell = _term_cell(vpty, vpty->cursor.row,
+		vpty->cursor.col);
+
+	const d2tk_hash_dict_t dict [] = {
+		{ rect, sizeof(d2tk_rect_t) },
+		{ cell, sizeof(d2tk_cell_t) },
+		{ &vpty->cursor_shape, sizeof(int) },
+		{ &focus, sizeof(bool) },
+		{ NULL, 0 }
+	};
+	const uint64_t hash = d2tk_hash_dict(dict);
 
-		if(cell->cursor)
-		{
-			// draw box cursor
-			if(vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_BLOCK)
-			{
-				fg = focus ? DEFAULT_BG : DEFAULT_BG_LIGHT;
-				bg = focus ? DEFAULT_FG : DEFAULT_FG_LIGHT;
-			}
-		}
-		else if(cell->reverse)
+	d2tk_core_t *core = base->core;
+
+	D2TK_CORE_WIDGET(core, hash, widget)
+	{
+		d2tk_rect_t bnd = *rect;
+
+		// draw box cursor
+		if(vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_BLOCK)
 		{
-			const uint32_t tmp = fg;
+			const size_t ref = d2tk_core_bbox_push(core, true, &bnd);
 
-			fg = bg;
-			bg = tmp;
-		}
+			d2tk_core_begin_path(core);
+			d2tk_core_rect(core, &bnd);
+			d2tk_core_color(core, focus ? DEFAULT_FG : DEFAULT_FG_LIGHT);
+			d2tk_core_stroke_width(core, 0);
+			d2tk_core_fill(core);
 
-		style.text_fill_color[D2TK_TRIPLE_NONE] = bg;
-		style.text_stroke_color[D2TK_TRIPLE_NONE] = fg;
+			if(cell->code)
+			{
+				const char *face = (cell->attr & D2TK_CELL_BOLD)
+					? FONT_CODE_BOLD
+					: (cell->attr & D2TK_CELL_ITALIC)
+						? FONT_CODE_LIGHT
+						: FONT_CODE_REGULAR;
+				char lbl [8];
+				const char *tail = utf8catcodepoint(lbl, cell->code, sizeof(lbl));
+
+				d2tk_core_save(core);
+				d2tk_core_scissor(core, &bnd);
+				d2tk_core_font_size(core, bnd.h);
+				d2tk_core_font_face(core, strlen(face), face);
+				d2tk_core_color(core, focus ? DEFAULT_BG : DEFAULT_BG_LIGHT);
+				d2tk_core_text(core, &bnd, tail - lbl, lbl,
+					D2TK_ALIGN_LEFT | D2TK_ALIGN_BOTTOM);
+				d2tk_core_restore(core);
+			}
 
-		if(cell->bold)
-		{
-			style.font_face = FONT_CODE_BOLD;
-		}
-		else if(cell->italic)
-		{
-			style.font_face = FONT_CODE_LIGHT;
+			d2tk_core_bbox_pop(core, ref);
 		}
-		else
+		// draw underline or bar cursor overlay
+		else if( (vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_UNDERLINE)
+			|| (vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_BAR_LEFT) )
 		{
-			style.font_face = FONT_CODE_REGULAR;
-		}
+			char lbl = '_';
 
-		d2tk_base_set_style(base, &style);
+			if(vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_BAR_LEFT)
+			{
+				lbl = '|';
+				bnd.x -= bnd.w/2;
+			}
 
-		d2tk_base_label(base, cell->lbl_len, cell->lbl, 1.f, trect,
-			D2TK_ALIGN_LEFT | D2TK_ALIGN_BOTTOM);
+			const size_t ref = d2tk_core_bbox_push(core, true, &bnd);
 
-		d2tk_base_set_style(base, old_style);
+			d2tk_core_save(core);
+			d2tk_core_scissor(core, &bnd);
+			d2tk_core_font_size(core, bnd.h);
+			d2tk_core_font_face(core, strlen(FONT_CODE_BOLD), FONT_CODE_BOLD);
+			d2tk_core_color(core, focus ? DEFAULT_FG : DEFAULT_FG_LIGHT);
+			d2tk_core_text(core, &bnd, 1, &lbl, D2TK_ALIGN_LEFT | D2TK_ALIGN_TOP);
+			d2tk_core_restore(core);
 
-		if(cell->cursor)
-		{
-			style.font_face = FONT_CODE_BOLD;
-			style.text_fill_color[D2TK_TRIPLE_NONE] = 0x0;
-			style.text_stroke_color[D2TK_TRIPLE_NONE] = focus
-				? DEFAULT_FG
-				: DEFAULT_FG_LIGHT;
-			d2tk_base_set_style(base, &style);
-
-			// draw underline cursor overlay
-			if(vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_UNDERLINE)
-			{
-				static const char lbl [2] = "_";
+			d2tk_core_bbox_pop(core, ref);
+		}
+	}
+}
 
-				d2tk_base_label(base, sizeof(lbl), lbl, 1.f, trect,
-					D2TK_ALIGN_LEFT | D2TK_ALIGN_TOP);
-			}
-			// draw bar cursor overlay
-			else if(vpty->cursor_shape == VTERM_PROP_CURSORSHAPE_BAR_LEFT)
-			{
-				static const char lbl [2] = "|";
+static inline void
+_term_draw(d2tk_base_t *base, d2tk_atom_body_pty_t *vpty,
+	const d2tk_rect_t *rect, bool focus)
+{
+	if( (vpty->grid_nrows == 0) || (vpty->grid_ncols == 0) )
+	{
+		return;
+	}
 
-				d2tk_rect_t bnd = *trect;
-				bnd.x -= bnd.w/2;
+	// cell geometry as laid out by a relative table
+	const d2tk_coord_t w = rect->w / vpty->grid_ncols;
+	const d2tk_coord_t h = rect->h / vpty->grid_nrows;
+	const d2tk_rect_t grid = {
+		.x = rect->x,
+		.y = rect->y,
+		.w = w * vpty->grid_ncols,
+		.h = h * vpty->grid_nrows
+	};
 
-				d2tk_base_label(base, sizeof(lbl), lbl, 1.f, &bnd,
-					D2TK_ALIGN_LEFT | D2TK_ALIGN_TOP);
-			}
+	_term_draw_grid(base, vpty, &grid);
 
-			d2tk_base_set_style(base, old_style);
-		}
+	if(vpty->cursor_visible
+		&& (vpty->cursor.row >= 0) && (vpty->cursor.row < vpty->grid_nrows)
+		&& (vpty->cursor.col >= 0) && (vpty->cursor.col < vpty->grid_ncols) )
+	{
+		const d2tk_rect_t cell = {
+			.x = rect->x + vpty->cursor.col*w,
+			.y = rect->y + vpty->cursor.row*h,
+			.w = w,
+			.h = h
+		};
+
+		_term_draw_cursor(base, vpty, &cell, focus);
 	}
 }
 
@@ -1187,6 +1726,9 @@ d2tk_pty_begin_state(d2tk_base_t *base, d2tk_id_t id, d2tk_state_t state,
 	if(flags & D2TK_FLAG_PTY_REINIT)
 	{
 		_term_deinit(vpty);
+
+		// new fd may get the number of the closed one, thus watch it anew
+		_d2tk_base_unwatch_atom(base, id);
 	}
 
 	if(vpty->height == 0)
@@ -1211,7 +1753,7 @@ d2tk_pty_begin_state(d2tk_base_t *base, d2tk_id_t id, d2tk_state_t state,
 
 	pty->state = _term_behave(base, vpty, state, flags, rect);
 
-	_term_input(vpty);
+	_term_input(base, vpty);
 
 	_term_draw(base, vpty, rect, d2tk_state_is_focused(pty->state));
 
@@ -1262,6 +1804,22 @@ d2tk_pty_get_state(d2tk_pty_t *pty)
 	return pty->state;
 }
 
+D2TK_API int
+d2tk_pty_send(d2tk_pty_t *pty, const char *buf, size_t len)
+{
+	d2tk_atom_body_pty_t *vpty = pty->vpty;
+
+	if(vpty->kid == 0)
+	{
+		return 1;
+	}
+
+	// deliver as typed keys, e.g. for scripting the child
+	_term_output(buf, len, vpty);
+
+	return 0;
+}
+
 static inline uint32_t
 _col_to_uint32(const col_t *col)
 {
@@ -0,0 +1,908 @@
+/*
+ * Copyright (c) 2018-2019 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base_internal.h"
+
+#define DEFAULT_FG 0xddddddff
+#define DEFAULT_BG 0x222222ff
+#define DEFAULT_CURSOR 0xdddddd7f
+
+#define FONT_CODE_LIGHT   "FiraCode:light"
+#define FONT_CODE_REGULAR "FiraCode:regular"
+#define FONT_CODE_BOLD    "FiraCode:bold"
+
+#define GAP_MIN  0x400 // minimal gap to open up on growth
+#define SLACK    4 // zeroed bytes after buffers, as utf8codepoint may overread
+#define TAB_STOP 4
+#define SCROLL_LINES 3
+
+typedef struct _d2tk_atom_body_textedit_t d2tk_atom_body_textedit_t;
+
+struct _d2tk_atom_body_textedit_t {
+	char *buf; // gap buffer
+	size_t size; // allocated bytes without slack
+	size_t pre; // bytes before gap, equals cursor position
+	size_t post; // bytes after gap
+
+	size_t *lines; // start offset of each line
+	size_t nlines;
+	size_t maxlines;
+
+	char *scratch; // line straddling the gap
+	size_t nscratch;
+
+	char *text; // contiguous copy handed out on change
+	size_t ntext;
+
+	d2tk_cell_t *cells; // visible lines only
+	d2tk_coord_t ncols;
+	d2tk_coord_t nrows;
+
+	size_t row0; // first visible line
+	size_t col0; // first visible column
+	size_t goal; // column to return to on vertical motion
+	bool loaded;
+};
+
+const size_t d2tk_atom_body_textedit_sz = sizeof(d2tk_atom_body_textedit_t);
+
+static inline size_t
+_textedit_len(d2tk_atom_body_textedit_t *body)
+{
+	return body->pre + body->post;
+}
+
+static inline char
+_textedit_at(d2tk_atom_body_textedit_t *body, size_t pos)
+{
+	return pos < body->pre
+		? body->buf[pos]
+		: body->buf[body->size - body->post + pos - body->pre];
+}
+
+static inline bool
+_textedit_is_cont(char c)
+{
+	return (c & 0xc0) == 0x80;
+}
+
+static size_t
+_textedit_next(d2tk_atom_body_textedit_t *body, size_t pos)
+{
+	const size_t len = _textedit_len(body);
+
+	if(pos < len)
+	{
+		pos++;
+	}
+
+	while( (pos < len) && _textedit_is_cont(_textedit_at(body, pos)) )
+	{
+		pos++;
+	}
+
+	return pos;
+}
+
+static size_t
+_textedit_prev(d2tk_atom_body_textedit_t *body, size_t pos)
+{
+	if(pos > 0)
+	{
+		pos--;
+	}
+
+	while( (pos > 0) && _textedit_is_cont(_textedit_at(body, pos)) )
+	{
+		pos--;
+	}
+
+	return pos;
+}
+
+static int
+_textedit_reserve(d2tk_atom_body_textedit_t *body, size_t len)
+{
+	if(body->buf && (body->size - body->pre - body->post >= len) )
+	{
+		return 0;
+	}
+
+	const size_t min = body->pre + body->post + len + GAP_MIN;
+	const size_t size = (body->size * 2 > min) ? body->size * 2 : min;
+
+	char *buf = realloc(body->buf, size + SLACK);
+	if(!buf)
+	{
+		return 1;
+	}
+
+	// keep text after gap at the end
+	memmove(&buf[size - body->post], &buf[body->size - body->post], body->post);
+	memset(&buf[size], 0x0, SLACK);
+
+	body->buf = buf;
+	body->size = size;
+
+	return 0;
+}
+
+static void
+_textedit_move(d2tk_atom_body_textedit_t *body, size_t pos)
+{
+	if(pos < body->pre)
+	{
+		const size_t n = body->pre - pos;
+
+		memmove(&body->buf[body->size - body->post - n], &body->buf[pos], n);
+		body->pre -= n;
+		body->post += n;
+	}
+	else if(pos > body->pre)
+	{
+		const size_t n = pos - body->pre;
+
+		memmove(&body->buf[body->pre], &body->buf[body->size - body->post], n);
+		body->pre += n;
+		body->post -= n;
+	}
+}
+
+static size_t
+_textedit_line(d2tk_atom_body_textedit_t *body, size_t pos)
+{
+	size_t lo = 0;
+	size_t hi = body->nlines;
+
+	while(hi - lo > 1)
+	{
+		const size_t mid = (lo + hi) / 2;
+
+		if(body->lines[mid] <= pos)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static inline size_t
+_textedit_line_end(d2tk_atom_body_textedit_t *body, size_t l)
+{
+	return (l + 1 < body->nlines)
+		? body->lines[l + 1] - 1 // without newline
+		: _textedit_len(body);
+}
+
+static int
+_textedit_lines_insert(d2tk_atom_body_textedit_t *body, size_t pos,
+	const char *str, size_t len)
+{
+	size_t n = 0;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		if(str[i] == '\n')
+		{
+			n++;
+		}
+	}
+
+	if(body->nlines + n > body->maxlines)
+	{
+		const size_t maxlines = body->nlines + n + body->maxlines;
+		size_t *lines = realloc(body->lines, maxlines * sizeof(size_t));
+		if(!lines)
+		{
+			return 1;
+		}
+
+		body->lines = lines;
+		body->maxlines = maxlines;
+	}
+
+	const size_t l = _textedit_line(body, pos);
+
+	memmove(&body->lines[l + 1 + n], &body->lines[l + 1],
+		(body->nlines - l - 1) * sizeof(size_t));
+	body->nlines += n;
+
+	for(size_t i = l + 1 + n; i < body->nlines; i++)
+	{
+		body->lines[i] += len;
+	}
+
+	for(size_t i = 0, k = l + 1; i < len; i++)
+	{
+		if(str[i] == '\n')
+		{
+			body->lines[k++] = pos + i + 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+_textedit_lines_remove(d2tk_atom_body_textedit_t *body, size_t from, size_t to)
+{
+	const size_t l = _textedit_line(body, from);
+	size_t b = l + 1;
+
+	// lines starting within (from, to] lose their newline
+	while( (b < body->nlines) && (body->lines[b] <= to) )
+	{
+		b++;
+	}
+
+	memmove(&body->lines[l + 1], &body->lines[b],
+		(body->nlines - b) * sizeof(size_t));
+	body->nlines -= b - (l + 1);
+
+	for(size_t i = l + 1; i < body->nlines; i++)
+	{
+		body->lines[i] -= to - from;
+	}
+}
+
+static int
+_textedit_insert(d2tk_atom_body_textedit_t *body, const char *str, size_t len)
+{
+	if(  _textedit_reserve(body, len)
+		|| _textedit_lines_insert(body, body->pre, str, len) )
+	{
+		return 1;
+	}
+
+	memcpy(&body->buf[body->pre], str, len);
+	body->pre += len;
+
+	return 0;
+}
+
+static void
+_textedit_erase(d2tk_atom_body_textedit_t *body, size_t from, size_t to)
+{
+	_textedit_lines_remove(body, from, to);
+	_textedit_move(body, from);
+	body->post -= to - from;
+}
+
+static int
+_textedit_load(d2tk_atom_body_textedit_t *body, const char *text, size_t len)
+{
+	const size_t cursor = body->pre;
+
+	body->pre = 0;
+	body->post = 0;
+	body->nlines = 1;
+
+	if(!body->lines)
+	{
+		body->lines = calloc(1, sizeof(size_t));
+		if(!body->lines)
+		{
+			body->nlines = 0;
+			return 1;
+		}
+
+		body->maxlines = 1;
+	}
+
+	body->lines[0] = 0;
+
+	if(_textedit_insert(body, text, len))
+	{
+		return 1;
+	}
+
+	// keep cursor where it was, if possible
+	size_t pos = (cursor < len) ? cursor : len;
+
+	while( (pos > 0) && (pos < len) && _textedit_is_cont(text[pos]) )
+	{
+		pos--;
+	}
+
+	_textedit_move(body, pos);
+	body->loaded = true;
+
+	return 0;
+}
+
+static const char *
+_textedit_get(d2tk_atom_body_textedit_t *body, size_t l, size_t *len)
+{
+	const size_t start = body->lines[l];
+	const size_t end = _textedit_line_end(body, l);
+
+	*len = end - start;
+
+	if(end <= body->pre)
+	{
+		return &body->buf[start];
+	}
+
+	if(start >= body->pre)
+	{
+		return &body->buf[body->size - body->post + start - body->pre];
+	}
+
+	// line straddles gap
+	if(*len + SLACK > body->nscratch)
+	{
+		char *scratch = realloc(body->scratch, *len + SLACK);
+		if(!scratch)
+		{
+			*len = 0;
+			return "";
+		}
+
+		body->scratch = scratch;
+		body->nscratch = *len + SLACK;
+	}
+
+	const size_t n = body->pre - start;
+
+	memcpy(body->scratch, &body->buf[start], n);
+	memcpy(&body->scratch[n], &body->buf[body->size - body->post], *len - n);
+	memset(&body->scratch[*len], 0x0, SLACK);
+
+	return body->scratch;
+}
+
+static inline size_t
+_textedit_advance(size_t col, utf8_int32_t codepoint)
+{
+	return (codepoint == '\t')
+		? (col / TAB_STOP + 1) * TAB_STOP
+		: col + 1;
+}
+
+static size_t
+_textedit_col(d2tk_atom_body_textedit_t *body, size_t l, size_t pos)
+{
+	size_t len;
+	const char *str = _textedit_get(body, l, &len);
+	const char *end = &str[pos - body->lines[l]];
+	size_t col = 0;
+
+	for(const char *ptr = str; ptr < end; )
+	{
+		utf8_int32_t codepoint;
+
+		ptr = utf8codepoint(ptr, &codepoint);
+		col = _textedit_advance(col, codepoint);
+	}
+
+	return col;
+}
+
+static size_t
+_textedit_pos(d2tk_atom_body_textedit_t *body, size_t l, size_t col)
+{
+	size_t len;
+	const char *str = _textedit_get(body, l, &len);
+	const char *end = &str[len];
+	const char *ptr = str;
+	size_t c = 0;
+
+	while(ptr < end)
+	{
+		utf8_int32_t codepoint;
+		const char *next = utf8codepoint(ptr, &codepoint);
+
+		c = _textedit_advance(c, codepoint);
+
+		if( (c > col) || (next > end) )
+		{
+			break;
+		}
+
+		ptr = next;
+	}
+
+	return body->lines[l] + (ptr - str);
+}
+
+static const char *
+_textedit_text(d2tk_atom_body_textedit_t *body, size_t *len)
+{
+	*len = _textedit_len(body);
+
+	if(*len + 1 > body->ntext)
+	{
+		char *text = realloc(body->text, *len + 1);
+		if(!text)
+		{
+			*len = 0;
+			return "";
+		}
+
+		body->text = text;
+		body->ntext = *len + 1;
+	}
+
+	memcpy(body->text, body->buf, body->pre);
+	memcpy(&body->text[body->pre], &body->buf[body->size - body->post],
+		body->post);
+	body->text[*len] = '\0';
+
+	return body->text;
+}
+
+static int
+_textedit_grid_resize(d2tk_atom_body_textedit_t *body, d2tk_coord_t nrows,
+	d2tk_coord_t ncols)
+{
+	if( (nrows == body->nrows) && (ncols == body->ncols) )
+	{
+		return 0;
+	}
+
+	free(body->cells);
+	body->cells = calloc(nrows * ncols, sizeof(d2tk_cell_t));
+	if(!body->cells)
+	{
+		body->nrows = 0;
+		body->ncols = 0;
+		return 1;
+	}
+
+	body->nrows = nrows;
+	body->ncols = ncols;
+
+	return 0;
+}
+
+static void
+_textedit_free(d2tk_atom_body_textedit_t *body)
+{
+	free(body->buf);
+	free(body->lines);
+	free(body->scratch);
+	free(body->text);
+	free(body->cells);
+
+	memset(body, 0x0, sizeof(d2tk_atom_body_textedit_t));
+}
+
+static int
+_textedit_event(d2tk_atom_event_type_t event, void *data)
+{
+	d2tk_atom_body_textedit_t *body = data;
+
+	switch(event)
+	{
+		case D2TK_ATOM_EVENT_DEINIT:
+		{
+			_textedit_free(body);
+		} break;
+
+		case D2TK_ATOM_EVENT_FD:
+			// fall-through
+		case D2TK_ATOM_EVENT_NONE:
+			// fall-through
+		default:
+		{
+			// nothing to do
+		} break;
+	}
+
+	return 0;
+}
+
+static bool
+_textedit_keys(d2tk_base_t *base, d2tk_atom_body_textedit_t *body,
+	bool *changed)
+{
+	const size_t l = _textedit_line(body, body->pre);
+	bool moved = false;
+	bool vertical = false;
+	size_t pos = body->pre;
+
+	// CTRL + arrows move focus
+	if(!d2tk_base_get_modmask(base, D2TK_MODMASK_CTRL, false))
+	{
+		if(d2tk_base_get_keymask(base, D2TK_KEYMASK_LEFT, true))
+		{
+			pos = _textedit_prev(body, pos);
+			moved = true;
+		}
+		if(d2tk_base_get_keymask(base, D2TK_KEYMASK_RIGHT, true))
+		{
+			pos = _textedit_next(body, pos);
+			moved = true;
+		}
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_UP, true) && (l > 0) )
+	{
+		pos = _textedit_pos(body, l - 1, body->goal);
+		moved = vertical = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_DOWN, true)
+		&& (l + 1 < body->nlines) )
+	{
+		pos = _textedit_pos(body, l + 1, body->goal);
+		moved = vertical = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_PAGEUP, true))
+	{
+		const size_t dl = (l > (size_t)body->nrows) ? l - body->nrows : 0;
+
+		pos = _textedit_pos(body, dl, body->goal);
+		moved = vertical = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_PAGEDOWN, true))
+	{
+		const size_t dl = (l + body->nrows < body->nlines)
+			? l + body->nrows
+			: body->nlines - 1;
+
+		pos = _textedit_pos(body, dl, body->goal);
+		moved = vertical = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_HOME, true))
+	{
+		pos = body->lines[l];
+		moved = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_END, true))
+	{
+		pos = _textedit_line_end(body, l);
+		moved = true;
+	}
+
+	_textedit_move(body, pos);
+
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_BACKSPACE, true)
+		&& (body->pre > 0) )
+	{
+		_textedit_erase(body, _textedit_prev(body, body->pre), body->pre);
+		*changed = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_DEL, true)
+		&& (body->post > 0) )
+	{
+		_textedit_erase(body, body->pre, _textedit_next(body, body->pre));
+		*changed = true;
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_ENTER, true))
+	{
+		*changed |= !_textedit_insert(body, "\n", 1);
+	}
+	if(d2tk_base_get_keymask(base, D2TK_KEYMASK_TAB, true))
+	{
+		*changed |= !_textedit_insert(body, "\t", 1);
+	}
+
+	{
+		ssize_t len = 0;
+		const utf8_int32_t *utf8 = NULL;
+
+		d2tk_base_get_utf8(base, &len, &utf8);
+
+		for(ssize_t i = 0; i < len; i++)
+		{
+			char str [8];
+
+			// control keys are handled via key mask above
+			if( (utf8[i] < 0x20) || (utf8[i] == 0x7f) )
+			{
+				continue;
+			}
+
+			const char *end = utf8catcodepoint(str, utf8[i], sizeof(str));
+			if(end)
+			{
+				*changed |= !_textedit_insert(body, str, end - str);
+			}
+		}
+	}
+
+	if(!vertical && (moved || *changed) )
+	{
+		body->goal = _textedit_col(body, _textedit_line(body, body->pre),
+			body->pre);
+	}
+
+	return moved || *changed;
+}
+
+static void
+_textedit_mouse(d2tk_base_t *base, d2tk_atom_body_textedit_t *body,
+	d2tk_state_t state, const d2tk_rect_t *rect, d2tk_coord_t w,
+	d2tk_coord_t h)
+{
+	if(d2tk_state_is_hot(state))
+	{
+		int32_t dx, dy;
+
+		d2tk_base_get_mouse_scroll(base, &dx, &dy, true);
+
+		if(dy > 0)
+		{
+			body->row0 = (body->row0 > SCROLL_LINES)
+				? body->row0 - SCROLL_LINES
+				: 0;
+		}
+		else if(dy < 0)
+		{
+			body->row0 += SCROLL_LINES;
+
+			if(body->row0 >= body->nlines)
+			{
+				body->row0 = body->nlines - 1;
+			}
+		}
+	}
+
+	if(d2tk_state_is_down(state))
+	{
+		d2tk_coord_t mx, my;
+
+		d2tk_base_get_mouse_pos(base, &mx, &my);
+
+		size_t l = body->row0 + (my - rect->y) / h;
+		if(l >= body->nlines)
+		{
+			l = body->nlines - 1;
+		}
+
+		body->goal = body->col0 + (mx - rect->x) / w;
+		_textedit_move(body, _textedit_pos(body, l, body->goal));
+	}
+}
+
+static void
+_textedit_follow(d2tk_atom_body_textedit_t *body)
+{
+	const size_t l = _textedit_line(body, body->pre);
+	const size_t col = _textedit_col(body, l, body->pre);
+
+	if(l < body->row0)
+	{
+		body->row0 = l;
+	}
+	else if(l >= body->row0 + body->nrows)
+	{
+		body->row0 = l - body->nrows + 1;
+	}
+
+	if(col < body->col0)
+	{
+		body->col0 = col;
+	}
+	else if(col >= body->col0 + body->ncols)
+	{
+		body->col0 = col - body->ncols + 1;
+	}
+}
+
+static void
+_textedit_fill(d2tk_atom_body_textedit_t *body)
+{
+	static const d2tk_cell_t blank = {
+		.code = 0,
+		.attr = D2TK_CELL_NONE,
+		.fg = DEFAULT_FG,
+		.bg = DEFAULT_BG
+	};
+	const size_t col1 = body->col0 + body->ncols;
+
+	for(d2tk_coord_t r = 0; r < body->nrows; r++)
+	{
+		d2tk_cell_t *row = &body->cells[r * body->ncols];
+		const size_t l = body->row0 + r;
+
+		for(d2tk_coord_t c = 0; c < body->ncols; c++)
+		{
+			row[c] = blank;
+		}
+
+		if(l >= body->nlines)
+		{
+			continue;
+		}
+
+		size_t len;
+		const char *str = _textedit_get(body, l, &len);
+		const char *end = &str[len];
+		size_t col = 0;
+
+		for(const char *ptr = str; (ptr < end) && (col < col1); )
+		{
+			utf8_int32_t codepoint;
+
+			ptr = utf8codepoint(ptr, &codepoint);
+
+			if( (codepoint >= 0x20) && (col >= body->col0) )
+			{
+				row[col - body->col0].code = codepoint;
+			}
+
+			col = _textedit_advance(col, codepoint);
+		}
+	}
+}
+
+static void
+_textedit_draw_grid(d2tk_base_t *base, d2tk_atom_body_textedit_t *body,
+	const d2tk_rect_t *rect)
+{
+	const size_t ncells = body->nrows * body->ncols;
+	const uint64_t dhash = d2tk_hash(body->cells, ncells * sizeof(d2tk_cell_t));
+	const d2tk_hash_dict_t dict [] = {
+		{ rect, sizeof(d2tk_rect_t) },
+		{ &body->cells, sizeof(d2tk_cell_t *) },
+		{ &dhash, sizeof(uint64_t) },
+		{ NULL, 0 }
+	};
+	const uint64_t hash = d2tk_hash_dict(dict);
+
+	d2tk_core_t *core = base->core;
+
+	D2TK_CORE_WIDGET(core, hash, widget)
+	{
+		const size_t ref = d2tk_core_bbox_push(core, true, rect);
+
+		d2tk_core_grid(core, rect, body->ncols, body->nrows, body->cells, dhash,
+			FONT_CODE_REGULAR, FONT_CODE_BOLD, FONT_CODE_LIGHT);
+
+		d2tk_core_bbox_pop(core, ref);
+	}
+}
+
+static void
+_textedit_draw_cursor(d2tk_base_t *base, const d2tk_rect_t *rect)
+{
+	const d2tk_hash_dict_t dict [] = {
+		{ rect, sizeof(d2tk_rect_t) },
+		{ NULL, 0 }
+	};
+	const uint64_t hash = d2tk_hash_dict(dict);
+
+	d2tk_core_t *core = base->core;
+
+	D2TK_CORE_WIDGET(core, hash, widget)
+	{
+		const size_t ref = d2tk_core_bbox_push(core, true, rect);
+
+		d2tk_core_begin_path(core);
+		d2tk_core_rect(core, rect);
+		d2tk_core_color(core, DEFAULT_CURSOR);
+		d2tk_core_stroke_width(core, 0);
+		d2tk_core_fill(core);
+
+		d2tk_core_bbox_pop(core, ref);
+	}
+}
+
+// line index of given widget, e.g. for consistency checks in tests
+const size_t *
+_d2tk_base_textedit_lines(d2tk_base_t *base, d2tk_id_t id, size_t *nlines)
+{
+	d2tk_atom_body_textedit_t *body = _d2tk_base_get_atom(base, id,
+		D2TK_ATOM_TEXTEDIT, _textedit_event);
+
+	if(!body)
+	{
+		*nlines = 0;
+		return NULL;
+	}
+
+	*nlines = body->nlines;
+
+	return body->lines;
+}
+
+D2TK_API d2tk_state_t
+d2tk_base_textedit(d2tk_base_t *base, d2tk_id_t id, size_t *text_len,
+	const char **text, d2tk_coord_t height, const d2tk_rect_t *rect,
+	d2tk_flag_t flags)
+{
+	d2tk_atom_body_textedit_t *body = _d2tk_base_get_atom(base, id,
+		D2TK_ATOM_TEXTEDIT, _textedit_event);
+
+	// cell geometry as used by pty
+	const d2tk_coord_t w = height / 2;
+	const d2tk_coord_t h = height;
+
+	if(!body || (w == 0) || (h == 0) )
+	{
+		return D2TK_STATE_NONE;
+	}
+
+	const d2tk_coord_t ncols = rect->w / w;
+	const d2tk_coord_t nrows = rect->h / h;
+
+	if( (ncols == 0) || (nrows == 0)
+		|| _textedit_grid_resize(body, nrows, ncols) )
+	{
+		return D2TK_STATE_NONE;
+	}
+
+	if(!body->loaded || (flags & D2TK_FLAG_TEXTEDIT_RELOAD) )
+	{
+		if(_textedit_load(body, *text, strnlen(*text, *text_len)) != 0)
+		{
+			return D2TK_STATE_NONE;
+		}
+
+		_textedit_follow(body);
+	}
+
+	d2tk_state_t state = d2tk_base_is_active_hot(base, id, rect,
+		D2TK_FLAG_NONE);
+
+	const d2tk_rect_t grid = {
+		.x = rect->x,
+		.y = rect->y,
+		.w = w * ncols,
+		.h = h * nrows
+	};
+
+	_textedit_mouse(base, body, state, &grid, w, h);
+
+	if(d2tk_state_is_focused(state))
+	{
+		bool changed = false;
+
+		if(_textedit_keys(base, body, &changed))
+		{
+			_textedit_follow(body);
+		}
+
+		if(changed)
+		{
+			*text = _textedit_text(body, text_len);
+			state |= D2TK_STATE_CHANGED;
+		}
+	}
+
+	_textedit_fill(body);
+	_textedit_draw_grid(base, body, &grid);
+
+	if(d2tk_state_is_focused(state))
+	{
+		const size_t l = _textedit_line(body, body->pre);
+		const size_t col = _textedit_col(body, l, body->pre);
+
+		if(  (l >= body->row0) && (l < body->row0 + nrows)
+			&& (col >= body->col0) && (col < body->col0 + ncols) )
+		{
+			const d2tk_rect_t bar = {
+				.x = grid.x + (col - body->col0) * w,
+				.y = grid.y + (l - body->row0) * h,
+				.w = (w > 8) ? w / 4 : 2,
+				.h = h
+			};
+
+			_textedit_draw_cursor(base, &bar);
+		}
+	}
+
+	return state;
+}
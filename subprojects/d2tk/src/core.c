@@ -30,55 +30,85 @@
 #	include <arpa/inet.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#	include <immintrin.h>
+#	define D2TK_MASK_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define D2TK_MASK_NEON 1
+#endif
+
 #include "core_internal.h"
+#include "font_internal.h"
 #include <d2tk/hash.h>
 
-#if D2TK_FONTCONFIG
-#	include <fontconfig/fontconfig.h>
-#endif
 
-#define _D2TK_SPRITES_MAX			0x10000 //FIXME how big?
-#define _D2TK_SPRITES_MASK		(_D2TK_SPRITES_MAX - 1)
-#define _D2TK_SPRITES_TTL			0x100
+#define _D2TK_TABLE_MIN				0x40
+#define _D2TK_TABLE_TOMBSTONE	((d2tk_entry_t *)&_d2tk_table_tombstone)
+
+#define _D2TK_DAMAGE_MAX			8
+
+#define _D2TK_MEM_MIN					0x2000
+#define _D2TK_MEM_SHRINK			0x100 // frames between shrink attempts
 
-#define _D2TK_MEMCACHES_MAX		0x10000 //FIXME how big?
-#define _D2TK_MEMCACHES_MASK	(_D2TK_MEMCACHES_MAX - 1)
+#define _D2TK_SPRITES_TTL			0x100
 #define _D2TK_MEMCACHES_TTL		0x100
 
 typedef struct _d2tk_mem_t d2tk_mem_t;
 typedef struct _d2tk_bitmap_t d2tk_bitmap_t;
-typedef struct _d2tk_sprite_t d2tk_sprite_t;
-typedef struct _d2tk_memcache_t d2tk_memcache_t;
+typedef struct _d2tk_entry_t d2tk_entry_t;
+typedef struct _d2tk_table_t d2tk_table_t;
 typedef struct _d2tk_widget_body_t d2tk_widget_body_t;
+typedef struct _d2tk_diff_slot_t d2tk_diff_slot_t;
 
 struct _d2tk_mem_t {
 	size_t size;
 	size_t offset;
+	size_t peak; // high-water mark since last shrink attempt
+	unsigned frames;
 	uint8_t *buf;
 };
 
+typedef void (*d2tk_mask_fill_t)(uint32_t *dst, uint32_t val, size_t n);
+typedef bool (*d2tk_mask_any_t)(const uint32_t *src, size_t n);
+
 struct _d2tk_bitmap_t {
 	size_t size;
 	uint32_t *pixels;
-	uint32_t *template;
+	d2tk_mask_fill_t fill;
+	d2tk_mask_any_t any;
 	size_t nfills;
+	unsigned ndamage;
+	d2tk_clip_t damage [_D2TK_DAMAGE_MAX]; // merged damaged rectangles
+	bool exact [_D2TK_DAMAGE_MAX]; // damaged rectangle is completely filled
 	d2tk_coord_t x0;
 	d2tk_coord_t x1;
 	d2tk_coord_t y0;
 	d2tk_coord_t y1;
 };
 
-struct _d2tk_sprite_t {
+struct _d2tk_entry_t {
+	d2tk_entry_t *prev;
+	d2tk_entry_t *next;
 	uint64_t hash;
 	uintptr_t body;
 	uint32_t type;
 	uint32_t ttl;
+	uint32_t slot;
 };
 
-struct _d2tk_memcache_t {
-	uint64_t hash;
-	uintptr_t body;
-	uint32_t ttl;
+struct _d2tk_table_t {
+	d2tk_entry_t **slots;
+	uint32_t size;
+	uint32_t nused; // live entries plus tombstones
+	uint32_t nlive;
+	d2tk_entry_t *live; // list of live entries, walked by gc
+};
+
+struct _d2tk_diff_slot_t {
+	d2tk_com_t *com;
+	uint32_t idx;
+	bool used;
 };
 
 struct _d2tk_widget_body_t {
@@ -107,6 +137,7 @@ struct _d2tk_core_t {
 	bool curmem;
 
 	bool full_refresh;
+	bool reload_images;
 
 	d2tk_bitmap_t bitmap;
 
@@ -117,8 +148,14 @@ struct _d2tk_core_t {
 		uint32_t memcaches;
 	} ttl;
 
-	d2tk_sprite_t sprites [_D2TK_SPRITES_MAX];
-	d2tk_memcache_t memcaches [_D2TK_MEMCACHES_MAX];
+	d2tk_table_t sprites;
+	d2tk_table_t memcaches;
+
+	struct {
+		d2tk_diff_slot_t *slots; // all zero, except for the ones in use
+		uint32_t size; // high-water mark
+		uint32_t used; // nested diffs stack their tables
+	} diff;
 
 	ssize_t parent;
 };
@@ -158,86 +195,270 @@ d2tk_rect_shrink(d2tk_rect_t *dst, const d2tk_rect_t *src,
 	dst->h = src->h - brd;
 }
 
-uintptr_t *
-d2tk_core_get_sprite(d2tk_core_t *core, uint64_t hash, uint8_t type)
+static const uint8_t _d2tk_table_tombstone;
+
+static inline int
+_d2tk_table_init(d2tk_table_t *table, uint32_t size)
 {
-	for(unsigned i = 0; i < _D2TK_SPRITES_MAX; i++)
+	table->slots = calloc(size, sizeof(d2tk_entry_t *));
+	if(!table->slots)
 	{
-		const unsigned j = (hash + i*i) & _D2TK_SPRITES_MASK;
-		d2tk_sprite_t *sprite = &core->sprites[j];
+		return 1;
+	}
 
-		if(sprite->body) // sprite is already taken
+	table->size = size;
+	table->nused = 0;
+	table->nlive = 0;
+	table->live = NULL;
+
+	return 0;
+}
+
+static inline void
+_d2tk_table_deinit(d2tk_table_t *table)
+{
+	for(d2tk_entry_t *entry = table->live, *next; entry; entry = next)
+	{
+		next = entry->next;
+		free(entry);
+	}
+
+	free(table->slots);
+	table->slots = NULL;
+	table->size = 0;
+	table->nused = 0;
+	table->nlive = 0;
+	table->live = NULL;
+}
+
+static inline int
+_d2tk_table_rehash(d2tk_table_t *table, uint32_t size)
+{
+	d2tk_entry_t **slots = calloc(size, sizeof(d2tk_entry_t *));
+	if(!slots)
+	{
+		return 1;
+	}
+
+	const uint32_t mask = size - 1;
+
+	// only reinsert live entries, which drops all tombstones
+	for(d2tk_entry_t *entry = table->live; entry; entry = entry->next)
+	{
+		for(uint32_t i = 0; ; i++)
 		{
-			// is this the sprite we're looking for?
-			if( (sprite->hash == hash) && (sprite->type == type) )
+			const uint32_t j = (entry->hash + i) & mask;
+
+			if(!slots[j])
 			{
-				sprite->ttl = core->ttl.sprites;
-				sprite->type = type;
-				return &sprite->body;
+				slots[j] = entry;
+				entry->slot = j;
+				break;
 			}
-			else // not our sprite
+		}
+	}
+
+	free(table->slots);
+	table->slots = slots;
+	table->size = size;
+	table->nused = table->nlive;
+
+	return 0;
+}
+
+static inline d2tk_entry_t *
+_d2tk_table_get(d2tk_table_t *table, uint64_t hash, uint32_t type)
+{
+	const uint32_t mask = table->size - 1;
+	uint32_t free_slot = UINT32_MAX;
+
+	for(uint32_t i = 0; i < table->size; i++)
+	{
+		const uint32_t j = (hash + i) & mask;
+		d2tk_entry_t *entry = table->slots[j];
+
+		if(!entry) // end of probe sequence
+		{
+			if(free_slot == UINT32_MAX)
 			{
-				continue;
+				free_slot = j;
+			}
+
+			break;
+		}
+
+		if(entry == _D2TK_TABLE_TOMBSTONE)
+		{
+			if(free_slot == UINT32_MAX)
+			{
+				free_slot = j; // reuse first tombstone for insertion
 			}
+
+			continue;
+		}
+
+		if( (entry->hash == hash) && (entry->type == type) )
+		{
+			return entry;
+		}
+	}
+
+	// keep load factor (incl. tombstones) below 3/4
+	if( (free_slot == UINT32_MAX) || ( (table->nused + 1)*4 > table->size*3) )
+	{
+		const uint32_t size = (table->nlive + 1)*2 > table->size
+			? table->size << 1 // grow
+			: table->size; // purge tombstones
+
+		if(_d2tk_table_rehash(table, size))
+		{
+			return NULL;
 		}
 
-		// empty sprite, ready to be taken
-		sprite->hash = hash;
-		sprite->ttl = core->ttl.sprites;
-		sprite->type = type;
-		return &sprite->body;
+		return _d2tk_table_get(table, hash, type);
+	}
+
+	d2tk_entry_t *entry = calloc(1, sizeof(d2tk_entry_t));
+	if(!entry)
+	{
+		return NULL;
+	}
+
+	entry->hash = hash;
+	entry->type = type;
+	entry->slot = free_slot;
+
+	if(table->slots[free_slot] != _D2TK_TABLE_TOMBSTONE)
+	{
+		table->nused++;
+	}
+
+	table->slots[free_slot] = entry;
+	table->nlive++;
+
+	// prepend to live list
+	entry->next = table->live;
+	if(table->live)
+	{
+		table->live->prev = entry;
 	}
+	table->live = entry;
 
-	return NULL; // out of memory FIXME increase memory and remap existing sprites
+	return entry;
+}
+
+static inline void
+_d2tk_table_remove(d2tk_table_t *table, d2tk_entry_t *entry)
+{
+	table->slots[entry->slot] = _D2TK_TABLE_TOMBSTONE;
+	table->nlive--;
+
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		table->live = entry->next;
+	}
+
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+
+	free(entry);
+}
+
+static inline void
+_d2tk_table_shrink(d2tk_table_t *table)
+{
+	uint32_t size = table->size;
+
+	while( (size > _D2TK_TABLE_MIN) && (table->nlive*8 < size) )
+	{
+		size >>= 1;
+	}
+
+	if(size != table->size)
+	{
+		_d2tk_table_rehash(table, size); // keeps old table upon failure
+	}
+}
+
+uintptr_t *
+d2tk_core_get_sprite(d2tk_core_t *core, uint64_t hash, uint8_t type)
+{
+	d2tk_entry_t *sprite = _d2tk_table_get(&core->sprites, hash, type);
+
+	if(!sprite) // out-of-memory
+	{
+		return NULL;
+	}
+
+	sprite->ttl = core->ttl.sprites;
+
+	return &sprite->body;
+}
+
+static inline void
+_d2tk_sprite_free(d2tk_core_t *core, d2tk_entry_t *sprite)
+{
+	if(sprite->body)
+	{
+		core->driver->sprite_free(core->data, sprite->type, sprite->body);
+	}
+
+	_d2tk_table_remove(&core->sprites, sprite);
 }
 
 static inline void
 _d2tk_sprites_free(d2tk_core_t *core)
 {
-	for(unsigned i = 0; i < _D2TK_SPRITES_MAX; i++)
+	while(core->sprites.live)
 	{
-		d2tk_sprite_t *sprite = &core->sprites[i];
+		_d2tk_sprite_free(core, core->sprites.live);
+	}
 
-		if(!sprite->hash)
-		{
-			continue;
-		}
+	_d2tk_table_shrink(&core->sprites);
+}
 
-		if(sprite->body)
+static inline void
+_d2tk_sprites_drop(d2tk_core_t *core, uint64_t hash)
+{
+	for(d2tk_entry_t *sprite = core->sprites.live, *next; sprite; sprite = next)
+	{
+		next = sprite->next;
+
+		if(sprite->hash == hash)
 		{
-			core->driver->sprite_free(core->data, sprite->type, sprite->body);
-			sprite->type = 0;
-			sprite->body = 0;
+			_d2tk_sprite_free(core, sprite);
 		}
-
-		sprite->hash = 0;
 	}
 }
 
 static inline void
 _d2tk_sprites_gc(d2tk_core_t *core)
 {
-	for(unsigned i = 0; i < _D2TK_SPRITES_MAX; i++)
+	for(d2tk_entry_t *sprite = core->sprites.live, *next; sprite; sprite = next)
 	{
-		d2tk_sprite_t *sprite = &core->sprites[i];
+		next = sprite->next;
 
-		if(!sprite->hash || (--sprite->ttl > 0) )
+		if(--sprite->ttl > 0)
 		{
 			continue;
 		}
 
+#if D2TK_DEBUG
 		if(sprite->body)
 		{
-#if D2TK_DEBUG
 			fprintf(stderr, "\tgc sprites (%08"PRIx64")\n", sprite->hash);
-#endif
-			core->driver->sprite_free(core->data, sprite->type, sprite->body);
-			sprite->type = 0;
-			sprite->body = 0;
 		}
-
-		sprite->hash = 0;
+#endif
+		_d2tk_sprite_free(core, sprite);
 	}
+
+	_d2tk_table_shrink(&core->sprites);
 }
 
 static inline void
@@ -245,6 +466,8 @@ _d2tk_mem_init(d2tk_mem_t *mem, size_t size)
 {
 	mem->size = size;
 	mem->offset = 0;
+	mem->peak = 0;
+	mem->frames = 0;
 	mem->buf = malloc(mem->size);
 }
 
@@ -253,6 +476,8 @@ _d2tk_mem_deinit(d2tk_mem_t *mem)
 {
 	mem->size = 0;
 	mem->offset = 0;
+	mem->peak = 0;
+	mem->frames = 0;
 	free(mem->buf);
 	mem->buf = NULL;
 }
@@ -260,101 +485,235 @@ _d2tk_mem_deinit(d2tk_mem_t *mem)
 static inline void
 _d2tk_mem_reset(d2tk_mem_t *mem)
 {
+	// instructions are zeroed upon request, no need to clear whole buffer
 	mem->offset = 0;
-	memset(mem->buf, 0x0, mem->size);
 }
 
 static inline uintptr_t *
 _d2tk_core_get_memcache(d2tk_core_t *core, uint64_t hash)
 {
-	for(unsigned i = 0; i < _D2TK_MEMCACHES_MAX; i++)
+	d2tk_entry_t *memcache = _d2tk_table_get(&core->memcaches, hash, 0);
+
+	if(!memcache) // out-of-memory
 	{
-		const unsigned j = (hash + i*i) & _D2TK_MEMCACHES_MASK;
-		d2tk_memcache_t *memcache = &core->memcaches[j];
+		return NULL;
+	}
 
-		if(memcache->body) // memcache is already taken
-		{
-			// is this the memcache we're looking for?
-			if(memcache->hash == hash)
-			{
-				memcache->ttl = core->ttl.memcaches;
-				return &memcache->body;
-			}
-			else // not our memcache
-			{
-				continue;
-			}
-		}
+	memcache->ttl = core->ttl.memcaches;
 
-		// empty memcache, ready to be taken
-		memcache->hash = hash;
-		memcache->ttl = core->ttl.memcaches;
-		return &memcache->body;
-	}
+	return &memcache->body;
+}
+
+static inline void
+_d2tk_memcache_free(d2tk_core_t *core, d2tk_entry_t *memcache)
+{
+	d2tk_widget_body_t *body = (d2tk_widget_body_t *)memcache->body;
+
+	free(body);
 
-	return NULL; // out of memory FIXME increase memory and remap existing memcaches
+	_d2tk_table_remove(&core->memcaches, memcache);
 }
 
 static inline void
 _d2tk_memcaches_free(d2tk_core_t *core)
 {
-	for(unsigned i = 0; i < _D2TK_MEMCACHES_MAX; i++)
+	while(core->memcaches.live)
+	{
+		_d2tk_memcache_free(core, core->memcaches.live);
+	}
+
+	_d2tk_table_shrink(&core->memcaches);
+}
+
+static inline void
+_d2tk_memcaches_gc(d2tk_core_t *core)
+{
+	for(d2tk_entry_t *memcache = core->memcaches.live, *next; memcache;
+		memcache = next)
 	{
-		d2tk_memcache_t *memcache = &core->memcaches[i];
+		next = memcache->next;
 
-		if(!memcache->hash)
+		if(--memcache->ttl > 0)
 		{
 			continue;
 		}
 
+#if D2TK_DEBUG
 		if(memcache->body)
 		{
-			d2tk_widget_body_t *body = (d2tk_widget_body_t *)memcache->body;
+			fprintf(stderr, "\tgc memcaches (%08"PRIx64")\n", memcache->hash);
+		}
+#endif
+		_d2tk_memcache_free(core, memcache);
+	}
+
+	_d2tk_table_shrink(&core->memcaches);
+}
+
+static void
+_d2tk_mask_fill_scalar(uint32_t *dst, uint32_t val, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		dst[i] = val;
+	}
+}
 
-			free(body);
-			memcache->body = 0;
+static bool
+_d2tk_mask_any_scalar(const uint32_t *src, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		if(src[i])
+		{
+			return true;
 		}
+	}
+
+	return false;
+}
 
-		memcache->hash = 0;
+#if D2TK_MASK_X86
+__attribute__((target("sse2")))
+static void
+_d2tk_mask_fill_sse2(uint32_t *dst, uint32_t val, size_t n)
+{
+	const __m128i v = _mm_set1_epi32(val);
+	size_t i = 0;
+
+	for( ; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_si128((__m128i *)&dst[i], v);
 	}
+
+	_d2tk_mask_fill_scalar(&dst[i], val, n - i);
 }
 
-static inline void
-_d2tk_memcaches_gc(d2tk_core_t *core)
+__attribute__((target("sse2")))
+static bool
+_d2tk_mask_any_sse2(const uint32_t *src, size_t n)
 {
-	for(unsigned i = 0; i < _D2TK_MEMCACHES_MAX; i++)
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for( ; i + 16 <= n; i += 16)
 	{
-		d2tk_memcache_t *memcache = &core->memcaches[i];
+		const __m128i a = _mm_or_si128(
+			_mm_loadu_si128((const __m128i *)&src[i + 0]),
+			_mm_loadu_si128((const __m128i *)&src[i + 4]));
+		const __m128i b = _mm_or_si128(
+			_mm_loadu_si128((const __m128i *)&src[i + 8]),
+			_mm_loadu_si128((const __m128i *)&src[i + 12]));
 
-		if(!memcache->hash || (--memcache->ttl > 0) )
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(a, b), zero)) != 0xffff)
 		{
-			continue;
+			return true;
 		}
+	}
 
-		if(memcache->body)
+	return _d2tk_mask_any_scalar(&src[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void
+_d2tk_mask_fill_avx2(uint32_t *dst, uint32_t val, size_t n)
+{
+	const __m256i v = _mm256_set1_epi32(val);
+	size_t i = 0;
+
+	for( ; i + 8 <= n; i += 8)
+	{
+		_mm256_storeu_si256((__m256i *)&dst[i], v);
+	}
+
+	_d2tk_mask_fill_scalar(&dst[i], val, n - i);
+}
+
+__attribute__((target("avx2")))
+static bool
+_d2tk_mask_any_avx2(const uint32_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for( ; i + 32 <= n; i += 32)
+	{
+		const __m256i a = _mm256_or_si256(
+			_mm256_loadu_si256((const __m256i *)&src[i + 0]),
+			_mm256_loadu_si256((const __m256i *)&src[i + 8]));
+		const __m256i b = _mm256_or_si256(
+			_mm256_loadu_si256((const __m256i *)&src[i + 16]),
+			_mm256_loadu_si256((const __m256i *)&src[i + 24]));
+		const __m256i c = _mm256_or_si256(a, b);
+
+		if(!_mm256_testz_si256(c, c))
 		{
-#if D2TK_DEBUG
-			fprintf(stderr, "\tgc memcaches (%08"PRIx64")\n", memcache->hash);
+			return true;
+		}
+	}
+
+	return _d2tk_mask_any_scalar(&src[i], n - i);
+}
 #endif
-			d2tk_widget_body_t *body = (d2tk_widget_body_t *)memcache->body;
 
-			free(body);
-			memcache->body = 0;
-		}
+#if D2TK_MASK_NEON
+static void
+_d2tk_mask_fill_neon(uint32_t *dst, uint32_t val, size_t n)
+{
+	const uint32x4_t v = vdupq_n_u32(val);
+	size_t i = 0;
+
+	for( ; i + 4 <= n; i += 4)
+	{
+		vst1q_u32(&dst[i], v);
+	}
+
+	_d2tk_mask_fill_scalar(&dst[i], val, n - i);
+}
+
+static bool
+_d2tk_mask_any_neon(const uint32_t *src, size_t n)
+{
+	size_t i = 0;
 
-		memcache->hash = 0;
+	for( ; i + 16 <= n; i += 16)
+	{
+		const uint32x4_t a = vorrq_u32(vld1q_u32(&src[i + 0]), vld1q_u32(&src[i + 4]));
+		const uint32x4_t b = vorrq_u32(vld1q_u32(&src[i + 8]), vld1q_u32(&src[i + 12]));
+
+		if(vmaxvq_u32(vorrq_u32(a, b)))
+		{
+			return true;
+		}
 	}
+
+	return _d2tk_mask_any_scalar(&src[i], n - i);
 }
+#endif
 
 static inline void
-_d2tk_bitmap_template_refill(d2tk_core_t *core)
+_d2tk_bitmap_init(d2tk_bitmap_t *bitmap)
 {
-	d2tk_bitmap_t *bitmap = &core->bitmap;
+	// select mask kernels at runtime
+	bitmap->fill = _d2tk_mask_fill_scalar;
+	bitmap->any = _d2tk_mask_any_scalar;
 
-	for(d2tk_coord_t x = 0; x < core->w; x++)
+#if D2TK_MASK_X86
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx2"))
+	{
+		bitmap->fill = _d2tk_mask_fill_avx2;
+		bitmap->any = _d2tk_mask_any_avx2;
+	}
+	else if(__builtin_cpu_supports("sse2"))
 	{
-		bitmap->template[x] = core->bg_color;
+		bitmap->fill = _d2tk_mask_fill_sse2;
+		bitmap->any = _d2tk_mask_any_sse2;
 	}
+#elif D2TK_MASK_NEON
+	bitmap->fill = _d2tk_mask_fill_neon;
+	bitmap->any = _d2tk_mask_any_neon;
+#endif
 }
 
 static inline void
@@ -365,46 +724,191 @@ _d2tk_bitmap_resize(d2tk_core_t *core, d2tk_coord_t w, d2tk_coord_t h)
 	const size_t stride = w*sizeof(uint32_t);
 	bitmap->size = h*stride;
 	bitmap->pixels = realloc(bitmap->pixels, bitmap->size);
-	bitmap->template = realloc(bitmap->template, stride);
-	_d2tk_bitmap_template_refill(core);
 }
 
-static inline void
-_d2tk_bitmap_deinit(d2tk_bitmap_t *bitmap)
-{
-	free(bitmap->pixels);
-	bitmap->pixels = NULL;
-	free(bitmap->template);
-	bitmap->template = NULL;
-	bitmap->size = 0;
-	bitmap->nfills = 0;
-}
+static inline void
+_d2tk_bitmap_deinit(d2tk_bitmap_t *bitmap)
+{
+	free(bitmap->pixels);
+	bitmap->pixels = NULL;
+	bitmap->size = 0;
+	bitmap->nfills = 0;
+}
+
+static inline void
+_d2tk_bitmap_reset(d2tk_core_t *core)
+{
+	d2tk_bitmap_t *bitmap = &core->bitmap;
+
+	for(unsigned i = 0; i < bitmap->ndamage; i++)
+	{
+		const d2tk_clip_t *damage = &bitmap->damage[i];
+
+		// x1/y1 may be wrong after window shrink
+		const d2tk_coord_t x1 = damage->x1 < core->w
+			? damage->x1
+			: core->w;
+		const d2tk_coord_t y1 = damage->y1 < core->h
+			? damage->y1
+			: core->h;
+
+		if(x1 <= damage->x0)
+		{
+			continue;
+		}
+
+		const size_t n = x1 - damage->x0;
+
+		for(d2tk_coord_t y = damage->y0, Y = y*core->w; y < y1; y++, Y+=core->w)
+		{
+			bitmap->fill(&bitmap->pixels[Y + damage->x0], 0x0, n);
+		}
+	}
+
+	bitmap->nfills = 0;
+	bitmap->ndamage = 0;
+	bitmap->x0 = INT_MAX;
+	bitmap->x1 = INT_MIN;
+	bitmap->y0 = INT_MAX;
+	bitmap->y1 = INT_MIN;
+}
+
+static inline size_t
+_d2tk_clip_area(const d2tk_clip_t *clip)
+{
+	return (size_t)(clip->x1 - clip->x0) * (clip->y1 - clip->y0);
+}
+
+static inline void
+_d2tk_clip_union(d2tk_clip_t *dst, const d2tk_clip_t *src)
+{
+	if(src->x0 < dst->x0)
+	{
+		dst->x0 = src->x0;
+	}
+
+	if(src->x1 > dst->x1)
+	{
+		dst->x1 = src->x1;
+	}
+
+	if(src->y0 < dst->y0)
+	{
+		dst->y0 = src->y0;
+	}
+
+	if(src->y1 > dst->y1)
+	{
+		dst->y1 = src->y1;
+	}
+
+	dst->w = dst->x1 - dst->x0;
+	dst->h = dst->y1 - dst->y0;
+}
+
+static inline bool
+_d2tk_clip_intersect(const d2tk_clip_t *a, const d2tk_clip_t *b)
+{
+	return (a->x0 < b->x1) && (b->x0 < a->x1)
+		&& (a->y0 < b->y1) && (b->y0 < a->y1);
+}
+
+// whether the bounding box of two filled rectangles is completely filled, too
+static inline bool
+_d2tk_clip_exact(const d2tk_clip_t *a, bool exact_a, const d2tk_clip_t *b,
+	bool exact_b, const d2tk_clip_t *u)
+{
+	if(!exact_a || !exact_b)
+	{
+		return false;
+	}
+
+	d2tk_clip_t o;
+
+	o.x0 = a->x0 > b->x0 ? a->x0 : b->x0;
+	o.x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+	o.y0 = a->y0 > b->y0 ? a->y0 : b->y0;
+	o.y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+
+	const size_t overlap = ( (o.x1 > o.x0) && (o.y1 > o.y0) )
+		? _d2tk_clip_area(&o)
+		: 0;
+
+	return _d2tk_clip_area(u) + overlap == _d2tk_clip_area(a) + _d2tk_clip_area(b);
+}
+
+static inline void
+_d2tk_bitmap_damage(d2tk_bitmap_t *bitmap, const d2tk_clip_t *clip)
+{
+	d2tk_clip_t dst = *clip;
+	bool exact = true;
+
+	if( (dst.x1 <= dst.x0) || (dst.y1 <= dst.y0) )
+	{
+		return; // empty
+	}
+
+	dst.w = dst.x1 - dst.x0;
+	dst.h = dst.y1 - dst.y0;
+
+	for(unsigned i = 0; i < bitmap->ndamage; )
+	{
+		d2tk_clip_t *damage = &bitmap->damage[i];
+		d2tk_clip_t tmp = *damage;
+
+		_d2tk_clip_union(&tmp, &dst);
+
+		// merge with overlapping neighbours if that adds no extra area
+		if(_d2tk_clip_area(&tmp) <= _d2tk_clip_area(damage) + _d2tk_clip_area(&dst))
+		{
+			exact = _d2tk_clip_exact(damage, bitmap->exact[i], &dst, exact, &tmp);
+			dst = tmp;
+
+			--bitmap->ndamage;
+			*damage = bitmap->damage[bitmap->ndamage];
+			bitmap->exact[i] = bitmap->exact[bitmap->ndamage];
+			i = 0; // grown rectangle may now merge with earlier ones
+
+			continue;
+		}
+
+		i++;
+	}
+
+	if(bitmap->ndamage == _D2TK_DAMAGE_MAX)
+	{
+		// merge with the rectangle that grows the least
+		unsigned best = 0;
+		size_t best_cost = SIZE_MAX;
+
+		for(unsigned i = 0; i < bitmap->ndamage; i++)
+		{
+			d2tk_clip_t tmp = bitmap->damage[i];
+
+			_d2tk_clip_union(&tmp, &dst);
 
-static inline void
-_d2tk_bitmap_reset(d2tk_core_t *core)
-{
-	d2tk_bitmap_t *bitmap = &core->bitmap;
+			const size_t cost = _d2tk_clip_area(&tmp)
+				- _d2tk_clip_area(&bitmap->damage[i]);
 
-	// x1/y1 may be wrong after window shrink
-	const d2tk_coord_t x1 = bitmap->x1 < core->w
-		? bitmap->x1
-		: core->w;
-	const d2tk_coord_t y1 = bitmap->y1 < core->h
-		? bitmap->y1
-		: core->h;
+			if(cost < best_cost)
+			{
+				best = i;
+				best_cost = cost;
+			}
+		}
 
-	const size_t stride = (x1 - bitmap->x0)*sizeof(uint32_t);
+		d2tk_clip_t tmp = bitmap->damage[best];
 
-	for(d2tk_coord_t y = bitmap->y0, Y = y*core->w; y < y1; y++, Y+=core->w)
-	{
-		memset(&bitmap->pixels[Y + bitmap->x0], 0x0, stride);
+		_d2tk_clip_union(&tmp, &dst);
+		bitmap->exact[best] = _d2tk_clip_exact(&bitmap->damage[best],
+			bitmap->exact[best], &dst, exact, &tmp);
+		bitmap->damage[best] = tmp;
+
+		return;
 	}
 
-	bitmap->nfills = 0;
-	bitmap->x0 = INT_MAX;
-	bitmap->x1 = INT_MIN;
-	bitmap->y0 = INT_MAX;
-	bitmap->y1 = INT_MIN;
+	bitmap->exact[bitmap->ndamage] = exact;
+	bitmap->damage[bitmap->ndamage++] = dst;
 }
 
 static inline void
@@ -457,13 +961,15 @@ _d2tk_bitmap_fill(d2tk_core_t *core, const d2tk_clip_t *clip)
 	d2tk_clip_t dst;
 	_d2tk_clip_clip(core, &dst, clip);
 
-	const size_t stride = (dst.x1 - dst.x0)*sizeof(uint32_t);
+	const size_t n = dst.x1 - dst.x0;
 
 	for(d2tk_coord_t y = dst.y0, Y = y*core->w; y < dst.y1; y++, Y+=core->w)
 	{
-		memcpy(&bitmap->pixels[Y + dst.x0], bitmap->template, stride);
+		bitmap->fill(&bitmap->pixels[Y + dst.x0], core->bg_color, n);
 	}
 
+	_d2tk_bitmap_damage(bitmap, &dst);
+
 	// update area of interest
 	if(dst.x0 < bitmap->x0)
 	{
@@ -575,6 +1081,43 @@ _d2tk_bbox_mask(d2tk_core_t *core, d2tk_com_t *com)
 	body->dirty = true;
 }
 
+static void
+_d2tk_images_mask(d2tk_core_t *core, d2tk_com_t *com)
+{
+	D2TK_COM_FOREACH(com, bbox)
+	{
+		if(bbox->instr != D2TK_INSTR_BBOX)
+		{
+			continue;
+		}
+
+		d2tk_body_bbox_t *body = &bbox->body->bbox;
+
+		if(body->container)
+		{
+			_d2tk_images_mask(core, bbox);
+			continue;
+		}
+
+		D2TK_COM_FOREACH(bbox, com2)
+		{
+			if(com2->instr != D2TK_INSTR_IMAGE)
+			{
+				continue;
+			}
+
+			// drop pre-rendered sprite with stale placeholder
+			if(body->cached)
+			{
+				_d2tk_sprites_drop(core, body->hash);
+			}
+
+			_d2tk_bbox_mask(core, bbox);
+			break;
+		}
+	}
+}
+
 uint32_t *
 d2tk_core_get_pixels(d2tk_core_t *core, d2tk_rect_t *rect)
 {
@@ -592,16 +1135,40 @@ d2tk_core_get_pixels(d2tk_core_t *core, d2tk_rect_t *rect)
 static inline bool
 _d2tk_bitmap_query(d2tk_core_t *core, d2tk_body_bbox_t *body)
 {
-	const d2tk_clip_t *clip = &body->clip;
-
-	d2tk_clip_t dst;
-	_d2tk_clip_clip(core, &dst, clip);
+	const d2tk_bitmap_t *bitmap = &core->bitmap;
 
-	for(d2tk_coord_t y = dst.y0, Y = y*core->w; y < dst.y1; y++, Y+=core->w)
+	for(unsigned i = 0; i < bitmap->ndamage; i++)
 	{
-		for(d2tk_coord_t x = dst.x0; x < dst.x1; x++)
+		const d2tk_clip_t *damage = &bitmap->damage[i];
+
+		if(!_d2tk_clip_intersect(&body->clip, damage))
+		{
+			continue;
+		}
+
+		if(bitmap->exact[i]) // rectangle test suffices
+		{
+			body->dirty = true;
+			return true;
+		}
+
+		// merged rectangle may contain unfilled areas, check the mask
+		d2tk_clip_t dst;
+		_d2tk_clip_clip(core, &dst, &body->clip);
+
+		const d2tk_coord_t x0 = dst.x0 > damage->x0 ? dst.x0 : damage->x0;
+		const d2tk_coord_t x1 = dst.x1 < damage->x1 ? dst.x1 : damage->x1;
+		const d2tk_coord_t y0 = dst.y0 > damage->y0 ? dst.y0 : damage->y0;
+		const d2tk_coord_t y1 = dst.y1 < damage->y1 ? dst.y1 : damage->y1;
+
+		if(x1 <= x0)
 		{
-			if(core->bitmap.pixels[Y + x])
+			continue;
+		}
+
+		for(d2tk_coord_t y = y0, Y = y*core->w; y < y1; y++, Y+=core->w)
+		{
+			if(bitmap->any(&bitmap->pixels[Y + x0], x1 - x0))
 			{
 				body->dirty = true;
 				return true;
@@ -612,24 +1179,90 @@ _d2tk_bitmap_query(d2tk_core_t *core, d2tk_body_bbox_t *body)
 	return false;
 }
 
+// derive minimal rectangle covering intersections with damaged rectangles
+static inline void
+_d2tk_bitmap_clip(d2tk_core_t *core, d2tk_clip_t *dst, const d2tk_body_bbox_t *body)
+{
+	const d2tk_bitmap_t *bitmap = &core->bitmap;
+	const d2tk_clip_t *clip = &body->clip;
+
+	dst->x0 = INT_MAX;
+	dst->y0 = INT_MAX;
+	dst->x1 = INT_MIN;
+	dst->y1 = INT_MIN;
+
+	for(unsigned i = 0; i < bitmap->ndamage; i++)
+	{
+		const d2tk_clip_t *damage = &bitmap->damage[i];
+
+		if(!_d2tk_clip_intersect(clip, damage))
+		{
+			continue;
+		}
+
+		d2tk_clip_t tmp;
+
+		tmp.x0 = damage->x0 < clip->x0
+			? clip->x0
+			: damage->x0;
+		tmp.x1 = damage->x1 > clip->x1
+			? clip->x1
+			: damage->x1;
+		tmp.y0 = damage->y0 < clip->y0
+			? clip->y0
+			: damage->y0;
+		tmp.y1 = damage->y1 > clip->y1
+			? clip->y1
+			: damage->y1;
+
+		_d2tk_clip_union(dst, &tmp);
+	}
+
+	if(dst->x0 > dst->x1) // no intersection at all
+	{
+		dst->x0 = dst->x1 = clip->x0;
+		dst->y0 = dst->y1 = clip->y0;
+	}
+
+	dst->w = dst->x1 - dst->x0;
+	dst->h = dst->y1 - dst->y0;
+}
+
 static inline void
 _d2tk_mem_compact(d2tk_mem_t *mem)
 {
-	if(mem->offset == 0)
+	if(mem->offset > mem->peak)
+	{
+		mem->peak = mem->offset;
+	}
+
+	// retain high-water mark, only shrink once in a while
+	if(++mem->frames < _D2TK_MEM_SHRINK)
 	{
 		return;
 	}
 
-	for(size_t nsize = (mem->size >> 1);
-		mem->offset <= nsize;
-		nsize >>= 1)
+	size_t nsize = mem->size;
+
+	// keep at least twice the recent peak to avoid regrowing right away
+	while( (nsize > _D2TK_MEM_MIN) && (mem->peak*2 <= (nsize >> 1)) )
+	{
+		nsize >>= 1;
+	}
+
+	if(nsize != mem->size)
 	{
 		uint8_t *nbuf = realloc(mem->buf, nsize);
-		assert(nbuf);
 
-		mem->buf = nbuf;
-		mem->size = nsize;
+		if(nbuf) // keep larger buffer upon failure
+		{
+			mem->buf = nbuf;
+			mem->size = nsize;
+		}
 	}
+
+	mem->peak = 0;
+	mem->frames = 0;
 }
 
 static inline d2tk_com_t *
@@ -643,15 +1276,20 @@ _d2tk_mem_append_request(d2tk_mem_t *mem, size_t len)
 {
 	const size_t padlen = D2TK_PAD_SIZE(len);
 
-	for(size_t msize = mem->offset + padlen, nsize = (mem->size << 1);
-		mem->size < msize;
-		nsize <<= 1)
+	const size_t msize = mem->offset + padlen;
+
+	if(msize > mem->size)
 	{
+		size_t nsize = mem->size << 1;
+
+		while(nsize < msize)
+		{
+			nsize <<= 1;
+		}
+
 		uint8_t *nbuf = realloc(mem->buf, nsize);
 		assert(nbuf);
 
-		memset(&nbuf[mem->size], 0x0, mem->size);
-
 		mem->buf = nbuf;
 		mem->size = nsize;
 	}
@@ -676,6 +1314,7 @@ _d2tk_append_simple(d2tk_core_t *core, d2tk_instr_t type)
 
 	if(com)
 	{
+		memset(com, 0x0, D2TK_PAD_SIZE(len));
 		com->size = 0;
 		com->instr = type;
 
@@ -692,6 +1331,8 @@ _d2tk_append_request(d2tk_core_t *core, size_t size, d2tk_instr_t type)
 
 	if(com)
 	{
+		// padding is part of bbox hashes, thus needs to be zeroed
+		memset(com, 0x0, D2TK_PAD_SIZE(len));
 		com->size = size;
 		com->instr = type;
 
@@ -843,7 +1484,6 @@ void
 d2tk_core_set_bg_color(d2tk_core_t *core, uint32_t rgba)
 {
 	core->bg_color = htonl(rgba);
-	_d2tk_bitmap_template_refill(core);
 }
 
 uint32_t
@@ -1223,6 +1863,60 @@ d2tk_core_custom(d2tk_core_t *core, const d2tk_rect_t *rect, uint64_t dhash,
 	}
 }
 
+D2TK_API void
+d2tk_core_grid(d2tk_core_t *core, const d2tk_rect_t *rect, uint32_t ncols,
+	uint32_t nrows, const d2tk_cell_t *cells, uint64_t dhash,
+	const char *regular, const char *bold, const char *italic)
+{
+	const size_t regular_sz = strlen(regular) + 1;
+	const size_t bold_sz = strlen(bold) + 1;
+	const size_t italic_sz = strlen(italic) + 1;
+	const size_t len = sizeof(d2tk_body_grid_t) + regular_sz + bold_sz + italic_sz;
+	d2tk_body_t *body = _d2tk_append_request(core, len, D2TK_INSTR_GRID);
+
+	if(body)
+	{
+		body->grid.x = rect->x;
+		body->grid.y = rect->y;
+		body->grid.w = rect->w;
+		body->grid.h = rect->h;
+		body->grid.ncols = ncols;
+		body->grid.nrows = nrows;
+		body->grid.dhash = dhash;
+		body->grid.cells = cells;
+
+		char *faces = body->grid.faces;
+		memcpy(faces, regular, regular_sz);
+		faces += regular_sz;
+		memcpy(faces, bold, bold_sz);
+		faces += bold_sz;
+		memcpy(faces, italic, italic_sz);
+
+		body->grid.x -= core->ref.x;
+		body->grid.y -= core->ref.y;
+
+		_d2tk_append_advance(core, len);
+	}
+}
+
+const char *
+d2tk_body_grid_get_face(const d2tk_body_grid_t *body, uint32_t attr)
+{
+	const char *face = body->faces; // regular
+
+	if(attr & D2TK_CELL_BOLD)
+	{
+		face += strlen(face) + 1;
+	}
+	else if(attr & D2TK_CELL_ITALIC)
+	{
+		face += strlen(face) + 1;
+		face += strlen(face) + 1;
+	}
+
+	return face;
+}
+
 D2TK_API void
 d2tk_core_stroke_width(d2tk_core_t *core, d2tk_coord_t width)
 {
@@ -1292,53 +1986,184 @@ _d2tk_com_equal(const d2tk_com_t *curcom, const d2tk_com_t *oldcom)
 	return false;
 }
 
+static inline uint32_t
+_d2tk_diff_mix(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+// key over position, plus size and hash for leaf bboxes
+static inline uint32_t
+_d2tk_diff_key(const d2tk_com_t *com)
+{
+	const d2tk_body_bbox_t *bbox = &com->body->bbox;
+	uint64_t key = ((uint64_t)(uint32_t)bbox->clip.x0 << 32)
+		| (uint32_t)bbox->clip.y0;
+
+	if(!bbox->container)
+	{
+		key ^= _d2tk_diff_mix( ((uint64_t)com->size << 32) | bbox->hash);
+	}
+
+	return _d2tk_diff_mix(key);
+}
+
+static inline void
+_d2tk_diff_insert(d2tk_diff_slot_t *slots, uint32_t mask, uint32_t key,
+	d2tk_com_t *com, uint32_t idx)
+{
+	for(uint32_t i = key & mask; ; i = (i + 1) & mask)
+	{
+		d2tk_diff_slot_t *slot = &slots[i];
+
+		if(!slot->com)
+		{
+			slot->com = com;
+			slot->idx = idx;
+			slot->used = false;
+			return;
+		}
+	}
+}
+
+// duplicates are chained in stacking order, thus the first hit is the nearest
+static inline d2tk_diff_slot_t *
+_d2tk_diff_lookup(d2tk_diff_slot_t *slots, uint32_t mask, uint32_t key,
+	const d2tk_com_t *com, uint32_t last)
+{
+	for(uint32_t i = key & mask; slots[i].com; i = (i + 1) & mask)
+	{
+		d2tk_diff_slot_t *slot = &slots[i];
+
+		// skip matches before the last one, they would be out of order
+		if(slot->used || (slot->idx < last) )
+		{
+			continue;
+		}
+
+		if( (slot->com->body->bbox.container == com->body->bbox.container)
+			&& _d2tk_com_equal_container(slot->com, com) )
+		{
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+static inline int
+_d2tk_diff_reserve(d2tk_core_t *core, uint32_t nslots)
+{
+	if(nslots <= core->diff.size)
+	{
+		return 0;
+	}
+
+	uint32_t size = core->diff.size ? core->diff.size : 0x40;
+
+	while(size < nslots)
+	{
+		size <<= 1;
+	}
+
+	d2tk_diff_slot_t *slots = realloc(core->diff.slots,
+		size*sizeof(d2tk_diff_slot_t));
+
+	if(!slots)
+	{
+		return 1;
+	}
+
+	memset(&slots[core->diff.size], 0x0,
+		(size - core->diff.size)*sizeof(d2tk_diff_slot_t));
+
+	core->diff.slots = slots;
+	core->diff.size = size;
+
+	return 0;
+}
+
 static inline void
 _d2tk_diff(d2tk_core_t *core, d2tk_com_t *curcom_ref, d2tk_com_t *oldcom_ref)
 {
-	// look for (dis)appeared instructions
-	d2tk_com_t *tmpcom = _d2tk_com_begin(curcom_ref);
+	uint32_t ncur = 0;
+	uint32_t nold = 0;
+
+	D2TK_COM_FOREACH(curcom_ref, curcom)
+	{
+		if(curcom->instr == D2TK_INSTR_BBOX)
+		{
+			ncur++;
+		}
+	}
 
 	D2TK_COM_FOREACH(oldcom_ref, oldcom)
 	{
-		if(oldcom->instr != D2TK_INSTR_BBOX)
+		if(oldcom->instr == D2TK_INSTR_BBOX)
 		{
-			continue;
+			nold++;
 		}
+	}
+
+	// keep load factor below 1/2
+	uint32_t size = 0x10;
+	while(size < 2*(ncur > nold ? ncur : nold))
+	{
+		size <<= 1;
+	}
+
+	const uint32_t mask = size - 1;
+	const uint32_t base = core->diff.used;
+
+	if(_d2tk_diff_reserve(core, base + size)) // out-of-memory, redraw everything
+	{
+		_d2tk_bbox_mask(core, oldcom_ref);
+		_d2tk_bbox_mask(core, curcom_ref);
+		return;
+	}
+
+	core->diff.used = base + size;
+	d2tk_diff_slot_t *slots = &core->diff.slots[base];
 
-		bool match = false;
+	// index current bboxes by hash and position
+	{
+		uint32_t idx = 0;
 
-		D2TK_COM_FOREACH_FROM(curcom_ref, tmpcom, curcom)
+		D2TK_COM_FOREACH(curcom_ref, curcom)
 		{
 			if(curcom->instr != D2TK_INSTR_BBOX)
 			{
 				continue;
 			}
 
-			// check for matching size, instruction, hash and position
-			if(_d2tk_com_equal_container(curcom, oldcom))
+			_d2tk_diff_insert(slots, mask, _d2tk_diff_key(curcom), curcom, idx++);
+		}
+	}
+
+	// look for disappeared instructions
+	{
+		uint32_t last = 0;
+
+		D2TK_COM_FOREACH(oldcom_ref, oldcom)
+		{
+			if(oldcom->instr != D2TK_INSTR_BBOX)
 			{
-				for(d2tk_com_t *curcom2 = tmpcom;
-					curcom2 != curcom;
-					curcom2 = _d2tk_com_next(curcom2))
-				{
-					if(curcom2->instr != D2TK_INSTR_BBOX)
-					{
-						continue;
-					}
+				continue;
+			}
 
-#if D2TK_DEBUG
-					d2tk_body_bbox_t *curbbox2 = &curcom2->body->bbox;
-
-					fprintf(stderr,
-						"\t   appeared (%i %i %i %i %i %i 0x%08"PRIx32")\n",
-						curbbox2->clip.x0, curbbox2->clip.y0,
-						curbbox2->clip.x1, curbbox2->clip.y1,
-						curcom2->size, curcom2->instr,
-						curbbox2->hash);
-#endif
+			d2tk_diff_slot_t *slot = _d2tk_diff_lookup(slots, mask,
+				_d2tk_diff_key(oldcom), oldcom, last);
 
-					_d2tk_bbox_mask(core, curcom2);
-				}
+			if(slot)
+			{
+				d2tk_com_t *curcom = slot->com;
+
+				slot->used = true;
+				last = slot->idx;
 
 				if(curcom->body->bbox.container && oldcom->body->bbox.container)
 				{
@@ -1346,17 +2171,15 @@ _d2tk_diff(d2tk_core_t *core, d2tk_com_t *curcom_ref, d2tk_com_t *oldcom_ref)
 					fprintf(stderr, "\t   comparing nested containers\n");
 #endif
 					_d2tk_diff(core, curcom, oldcom);
-				}
 
-				match = true;
-				tmpcom = _d2tk_com_next(curcom);
+					// nested diff may have grown the index
+					slots = &core->diff.slots[base];
+				}
 
-				break;
+				continue;
 			}
-		}
 
-		if(!match)
-		{
+			// reordered bboxes need to be redrawn in their new stacking order
 #if D2TK_DEBUG
 			d2tk_body_bbox_t *oldbbox = &oldcom->body->bbox;
 
@@ -1372,13 +2195,18 @@ _d2tk_diff(d2tk_core_t *core, d2tk_com_t *curcom_ref, d2tk_com_t *oldcom_ref)
 		}
 	}
 
-	D2TK_COM_FOREACH_FROM(curcom_ref, tmpcom, curcom2)
+	// look for appeared instructions
+	for(uint32_t i = 0; i < size; i++)
 	{
-		if(curcom2->instr != D2TK_INSTR_BBOX)
+		d2tk_diff_slot_t *slot = &slots[i];
+
+		if(!slot->com || slot->used)
 		{
 			continue;
 		}
 
+		d2tk_com_t *curcom2 = slot->com;
+
 #if D2TK_DEBUG
 		d2tk_body_bbox_t *curbbox2 = &curcom2->body->bbox;
 
@@ -1392,6 +2220,10 @@ _d2tk_diff(d2tk_core_t *core, d2tk_com_t *curcom_ref, d2tk_com_t *oldcom_ref)
 
 		_d2tk_bbox_mask(core, curcom2);
 	}
+
+	// index is kept at its high-water mark, only clear what has been used
+	memset(slots, 0x0, size*sizeof(d2tk_diff_slot_t));
+	core->diff.used = base;
 }
 
 D2TK_API void
@@ -1427,9 +2259,20 @@ d2tk_core_post(d2tk_core_t *core)
 		_d2tk_diff(core, curcom, oldcom);
 	}
 
+	if(core->reload_images)
+	{
+		// asynchronously loaded images have become ready in the meantime
+		if(!core->full_refresh)
+		{
+			_d2tk_images_mask(core, curcom);
+		}
+
+		core->reload_images = false;
+	}
+
 	if(bitmap->nfills || core->full_refresh)
 	{
-		const d2tk_clip_t *aoi = NULL;
+		const bool partial = !core->full_refresh;
 
 		if(core->full_refresh)
 		{
@@ -1444,23 +2287,17 @@ d2tk_core_post(d2tk_core_t *core)
 
 			_d2tk_bitmap_fill(core, &tmp);
 		}
-		else
-		{
-			static d2tk_clip_t tmp;
 
-			tmp.x0 = bitmap->x0;
-			tmp.y0 = bitmap->y0;
-			tmp.x1 = bitmap->x1;
-			tmp.y1 = bitmap->y1;
-			tmp.w = bitmap->x1 - bitmap->x0;
-			tmp.h = bitmap->y1 - bitmap->y0;
+#if D2TK_DEBUG
+		fprintf(stderr, "\tnfills: %zu, ndamage: %u\n", bitmap->nfills,
+			bitmap->ndamage);
+#endif
 
-			aoi = &tmp;
+		if(core->driver->damage)
+		{
+			core->driver->damage(core->data, core, bitmap->damage, bitmap->ndamage);
 		}
 
-#if D2TK_DEBUG
-		fprintf(stderr, "\tnfills: %zu\n", bitmap->nfills);
-#endif
 		for(unsigned pass = 0; pass < 2; pass++)
 		{
 			core->driver->pre(core->data, core, core->w, core->h, pass);
@@ -1473,56 +2310,26 @@ d2tk_core_post(d2tk_core_t *core)
 
 				if(pass == 0)
 				{
-					if(aoi && !body->dirty)
+					if(partial && !body->dirty && !_d2tk_bitmap_query(core, body))
 					{
-						if(  ( (body->clip.x0 >= aoi->x1) || (aoi->x0 >= body->clip.x1) )
-							|| ( (body->clip.y0 >= aoi->y1) || (aoi->y0 >= body->clip.y1) ) )
-						{
-							continue; // not in area-of-interest
-						}
-
-						if(!_d2tk_bitmap_query(core, body))
-						{
-							continue;
-						}
+						continue; // not in any damaged rectangle
 					}
 				}
 				else if(pass == 1)
 				{
-					if(aoi && !body->dirty)
+					if(partial && !body->dirty)
 					{
-						continue; // not in area-of-interest
+						continue; // not in any damaged rectangle
 					}
 				}
 
 				const d2tk_clip_t *clip = NULL;
 
-				if(aoi)
+				if(partial)
 				{
 					static d2tk_clip_t tmp;
 
-					// derive minimal intersecting rectangle
-					tmp.x0 = aoi->x0 < body->clip.x0
-						? body->clip.x0
-						: aoi->x0;
-					tmp.x1 = aoi->x1 > body->clip.x1
-						? body->clip.x1
-						: aoi->x1;
-					tmp.y0 = aoi->y0 < body->clip.y0
-						? body->clip.y0
-						: aoi->y0;
-					tmp.y1 = aoi->y1 > body->clip.y1
-						? body->clip.y1
-						: aoi->y1;
-					tmp.w = tmp.x1 - tmp.x0;
-					tmp.h = tmp.y1 - tmp.y0;
-
-#if 0 // seems not to be needed
-					if(pass == 0)
-					{
-						_d2tk_bitmap_fill(core, &tmp);
-					}
-#endif
+					_d2tk_bitmap_clip(core, &tmp, body);
 
 					clip = &tmp;
 				}
@@ -1569,8 +2376,19 @@ d2tk_core_new(const d2tk_core_driver_t *driver, void *data)
 	core->driver = driver;
 	core->data = data;
 
-	_d2tk_mem_init(&core->mem[0], 8192);
-	_d2tk_mem_init(&core->mem[1], 8192);
+	_d2tk_bitmap_init(&core->bitmap);
+
+	if(  _d2tk_table_init(&core->sprites, _D2TK_TABLE_MIN)
+		|| _d2tk_table_init(&core->memcaches, _D2TK_TABLE_MIN) )
+	{
+		_d2tk_table_deinit(&core->sprites);
+		_d2tk_table_deinit(&core->memcaches);
+		free(core);
+		return NULL;
+	}
+
+	_d2tk_mem_init(&core->mem[0], _D2TK_MEM_MIN);
+	_d2tk_mem_init(&core->mem[1], _D2TK_MEM_MIN);
 
 	{
 		core->curmem = 0;
@@ -1613,6 +2431,9 @@ d2tk_core_free(d2tk_core_t *core)
 	_d2tk_bitmap_deinit(&core->bitmap);
 	_d2tk_sprites_free(core);
 	_d2tk_memcaches_free(core);
+	_d2tk_table_deinit(&core->sprites);
+	_d2tk_table_deinit(&core->memcaches);
+	free(core->diff.slots);
 
 	free(core);
 }
@@ -1646,50 +2467,24 @@ d2tk_core_set_full_refresh(d2tk_core_t *core)
 	core->full_refresh = true;
 }
 
-int
-d2tk_core_get_font_path(d2tk_core_t *core, const char *bundle_path,
-	const char *rel_path, size_t abs_len, char *abs_path)
+D2TK_API bool
+d2tk_core_get_again(d2tk_core_t *core)
 {
-	int ret = 1;
-
-#if D2TK_FONTCONFIG
-	(void)core;
-	(void)bundle_path;
-	FcChar8 pattern [PATH_MAX];
-
-	snprintf((char *)pattern, sizeof(pattern), "%s:fontformat=TrueType", rel_path);
-
-	FcConfig *config = FcInitLoadConfigAndFonts();
-	FcPattern *pat = FcNameParse(pattern);
-	FcConfigSubstitute(config, pat, FcMatchPattern);
-	FcDefaultSubstitute(pat);
-
-	//FcPatternPrint(pat);
-
-	FcResult result;
-	FcPattern *font = FcFontMatch(config, pat, &result);
-	if(font)
+	if(core->driver->again && core->driver->again(core->data))
 	{
-		FcChar8 *file = NULL;
-		if(FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch)
-		{
-			snprintf(abs_path, abs_len, "%s", file);
-			ret = 0;
-		}
-
-		FcPatternDestroy(font);
+		core->reload_images = true;
+		return true;
 	}
 
-	FcPatternDestroy(pat);
-
-	FcConfigDestroy(config);
-#else
-	(void)core;
-	snprintf(abs_path, abs_len, "%s%s.ttf", bundle_path, rel_path);
-	ret = 0;
-#endif
+	return false;
+}
 
-	return ret;
+int
+d2tk_core_get_font_path(d2tk_core_t *core __attribute__((unused)),
+	const char *bundle_path, const char *rel_path, size_t abs_len, char *abs_path)
+{
+	// resolved paths are cached process-wide
+	return d2tk_font_path(bundle_path, rel_path, abs_len, abs_path);
 }
 
 D2TK_API int
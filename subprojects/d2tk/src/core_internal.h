@@ -44,6 +44,9 @@ typedef void (*d2tk_core_process_t)(void *data, d2tk_core_t *core,
 typedef void (*d2tk_core_sprite_free_t)(void *data, uint8_t type, uintptr_t body);
 typedef int (*d2tk_core_text_extent_t)(void *data, size_t len, const char *buf,
 	d2tk_coord_t h);
+typedef bool (*d2tk_core_again_t)(void *data);
+typedef void (*d2tk_core_damage_t)(void *data, d2tk_core_t *core,
+	const d2tk_clip_t *rects, unsigned nrects);
 
 typedef struct _d2tk_body_move_to_t d2tk_body_move_to_t;
 typedef struct _d2tk_body_line_to_t d2tk_body_line_to_t;
@@ -62,6 +65,7 @@ typedef struct _d2tk_body_image_t d2tk_body_image_t;
 typedef struct _d2tk_body_bitmap_surf_t d2tk_body_bitmap_surf_t;
 typedef struct _d2tk_body_bitmap_t d2tk_body_bitmap_t;
 typedef struct _d2tk_body_custom_t d2tk_body_custom_t;
+typedef struct _d2tk_body_grid_t d2tk_body_grid_t;
 typedef struct _d2tk_body_stroke_width_t d2tk_body_stroke_width_t;
 typedef struct _d2tk_body_bbox_t d2tk_body_bbox_t;
 typedef union _d2tk_body_t d2tk_body_t;
@@ -85,6 +89,8 @@ struct _d2tk_core_driver_t {
 	d2tk_core_end_t end;
 	d2tk_core_sprite_free_t sprite_free;
 	d2tk_core_text_extent_t text_extent;
+	d2tk_core_again_t again;
+	d2tk_core_damage_t damage;
 };
 
 struct _d2tk_body_move_to_t {
@@ -203,6 +209,18 @@ struct _d2tk_body_custom_t {
 	d2tk_core_custom_t custom;
 };
 
+struct _d2tk_body_grid_t {
+	d2tk_coord_t x;
+	d2tk_coord_t y;
+	d2tk_coord_t w;
+	d2tk_coord_t h;
+	uint32_t ncols;
+	uint32_t nrows;
+	uint64_t dhash;
+	const d2tk_cell_t *cells;
+	char faces [1]; // regular, bold and italic face, each zero-terminated
+};
+
 struct _d2tk_body_stroke_width_t {
 	d2tk_coord_t width;
 };
@@ -231,6 +249,7 @@ union _d2tk_body_t {
 	d2tk_body_text_t text;
 	d2tk_body_image_t image;
 	d2tk_body_custom_t custom;
+	d2tk_body_grid_t grid;
 	d2tk_body_bitmap_t bitmap;
 	d2tk_body_stroke_width_t stroke_width;
 	d2tk_body_bbox_t bbox;
@@ -261,7 +280,8 @@ typedef enum _d2tk_instr_t {
 	D2TK_INSTR_IMAGE,
 	D2TK_INSTR_BITMAP,
 	D2TK_INSTR_CUSTOM,
-	D2TK_INSTR_STROKE_WIDTH
+	D2TK_INSTR_STROKE_WIDTH,
+	D2TK_INSTR_GRID
 } d2tk_instr_t;
 
 struct _d2tk_com_t {
@@ -304,6 +324,9 @@ int
 d2tk_core_get_font_path(d2tk_core_t *core, const char *bundle_path,
 	const char *rel_path, size_t abs_len, char *abs_path);
 
+const char *
+d2tk_body_grid_get_face(const d2tk_body_grid_t *body, uint32_t attr);
+
 #ifdef __cplusplus
 }
 #endif
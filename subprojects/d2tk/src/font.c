@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2018-2019 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#	include <sys/mman.h>
+#endif
+
+#include <d2tk/config.h>
+
+#if D2TK_FONTCONFIG
+#	include <fontconfig/fontconfig.h>
+#endif
+
+#include "font_internal.h"
+
+typedef struct _d2tk_font_path_t d2tk_font_path_t;
+
+struct _d2tk_font_path_t {
+	d2tk_font_path_t *next;
+	char *path;
+	char key [];
+};
+
+struct _d2tk_font_t {
+	d2tk_font_t *next;
+	uint32_t refs;
+	size_t size;
+	uint8_t *data;
+	char path [];
+};
+
+// process-wide caches shared by all backend instances
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static d2tk_font_path_t *_paths = NULL;
+static d2tk_font_t *_fonts = NULL;
+#if D2TK_FONTCONFIG
+static FcConfig *_config = NULL;
+#endif
+
+static char *
+_d2tk_font_resolve(const char *bundle_path, const char *face)
+{
+	char *path = NULL;
+
+#if D2TK_FONTCONFIG
+	(void)bundle_path;
+	FcChar8 pattern [PATH_MAX];
+
+	snprintf((char *)pattern, sizeof(pattern), "%s:fontformat=TrueType", face);
+
+	// scan font database only once per process
+	if(!_config)
+	{
+		_config = FcInitLoadConfigAndFonts();
+
+		if(!_config)
+		{
+			return NULL;
+		}
+	}
+
+	FcPattern *pat = FcNameParse(pattern);
+	if(!pat)
+	{
+		return NULL;
+	}
+
+	FcConfigSubstitute(_config, pat, FcMatchPattern);
+	FcDefaultSubstitute(pat);
+
+	FcResult result;
+	FcPattern *font = FcFontMatch(_config, pat, &result);
+	if(font)
+	{
+		FcChar8 *file = NULL;
+		if(FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch)
+		{
+			path = strdup((const char *)file);
+		}
+
+		FcPatternDestroy(font);
+	}
+
+	FcPatternDestroy(pat);
+#else
+	if(asprintf(&path, "%s%s.ttf", bundle_path, face) == -1)
+	{
+		path = NULL;
+	}
+#endif
+
+	return path;
+}
+
+// with the last font gone, so is the last backend instance
+static void
+_d2tk_font_paths_free(void)
+{
+	while(_paths)
+	{
+		d2tk_font_path_t *entry = _paths;
+
+		_paths = entry->next;
+		free(entry->path);
+		free(entry);
+	}
+
+#if D2TK_FONTCONFIG
+	if(_config)
+	{
+		FcConfigDestroy(_config);
+		_config = NULL;
+	}
+#endif
+}
+
+int
+d2tk_font_path(const char *bundle_path, const char *face, size_t len,
+	char *path)
+{
+	char key [PATH_MAX];
+	int ret = 1;
+
+	snprintf(key, sizeof(key), "%s\n%s", bundle_path ? bundle_path : "", face);
+
+	pthread_mutex_lock(&_lock);
+
+	d2tk_font_path_t *entry;
+	for(entry = _paths; entry; entry = entry->next)
+	{
+		if(!strcmp(entry->key, key))
+		{
+			break;
+		}
+	}
+
+	if(!entry)
+	{
+		char *resolved = _d2tk_font_resolve(bundle_path, face);
+
+		if(resolved)
+		{
+			const size_t key_len = strlen(key) + 1;
+
+			entry = malloc(sizeof(d2tk_font_path_t) + key_len);
+			if(entry)
+			{
+				memcpy(entry->key, key, key_len);
+				entry->path = resolved;
+				entry->next = _paths;
+				_paths = entry;
+			}
+			else
+			{
+				free(resolved);
+			}
+		}
+	}
+
+	if(entry)
+	{
+		snprintf(path, len, "%s", entry->path);
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&_lock);
+
+	return ret;
+}
+
+static int
+_d2tk_font_load(d2tk_font_t *font)
+{
+	const int fd = open(font->path, O_RDONLY);
+	if(fd == -1)
+	{
+		return 1;
+	}
+
+	struct stat st;
+	if( (fstat(fd, &st) == -1) || (st.st_size <= 0) )
+	{
+		close(fd);
+		return 1;
+	}
+
+	font->size = st.st_size;
+
+#if defined(_WIN32)
+	font->data = malloc(font->size);
+	if(!font->data)
+	{
+		close(fd);
+		return 1;
+	}
+
+	for(size_t offset = 0; offset < font->size; )
+	{
+		const ssize_t n = read(fd, &font->data[offset], font->size - offset);
+
+		if(n <= 0)
+		{
+			free(font->data);
+			font->data = NULL;
+			close(fd);
+			return 1;
+		}
+
+		offset += n;
+	}
+#else
+	void *data = mmap(NULL, font->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(data == MAP_FAILED)
+	{
+		close(fd);
+		return 1;
+	}
+
+	font->data = data;
+#endif
+
+	close(fd);
+
+	return 0;
+}
+
+static void
+_d2tk_font_unload(d2tk_font_t *font)
+{
+#if defined(_WIN32)
+	free(font->data);
+#else
+	munmap(font->data, font->size);
+#endif
+	font->data = NULL;
+	font->size = 0;
+}
+
+d2tk_font_t *
+d2tk_font_ref(const char *path)
+{
+	pthread_mutex_lock(&_lock);
+
+	d2tk_font_t *font;
+	for(font = _fonts; font; font = font->next)
+	{
+		if(!strcmp(font->path, path))
+		{
+			font->refs++;
+			break;
+		}
+	}
+
+	if(!font)
+	{
+		const size_t path_len = strlen(path) + 1;
+
+		font = calloc(1, sizeof(d2tk_font_t) + path_len);
+		if(font)
+		{
+			memcpy(font->path, path, path_len);
+
+			if(_d2tk_font_load(font))
+			{
+				free(font);
+				font = NULL;
+			}
+			else
+			{
+				font->refs = 1;
+				font->next = _fonts;
+				_fonts = font;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&_lock);
+
+	return font;
+}
+
+void
+d2tk_font_unref(d2tk_font_t *font)
+{
+	if(!font)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&_lock);
+
+	if(--font->refs == 0)
+	{
+		for(d2tk_font_t **ptr = &_fonts; *ptr; ptr = &(*ptr)->next)
+		{
+			if(*ptr == font)
+			{
+				*ptr = font->next;
+				break;
+			}
+		}
+
+		_d2tk_font_unload(font);
+		free(font);
+
+		if(!_fonts)
+		{
+			_d2tk_font_paths_free();
+		}
+	}
+
+	pthread_mutex_unlock(&_lock);
+}
+
+const uint8_t *
+d2tk_font_data(const d2tk_font_t *font, size_t *size)
+{
+	if(size)
+	{
+		*size = font->size;
+	}
+
+	return font->data;
+}
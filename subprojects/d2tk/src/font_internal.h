@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018-2019 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _D2TK_FONT_INTERNAL_H
+#define _D2TK_FONT_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _d2tk_font_t d2tk_font_t;
+
+int
+d2tk_font_path(const char *bundle_path, const char *face, size_t len,
+	char *path);
+
+d2tk_font_t *
+d2tk_font_ref(const char *path);
+
+void
+d2tk_font_unref(d2tk_font_t *font);
+
+const uint8_t *
+d2tk_font_data(const d2tk_font_t *font, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _D2TK_FONT_INTERNAL_H
@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2018-2019 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include "stb_image.h"
+#pragma GCC diagnostic pop
+
+#include <d2tk/hash.h>
+#include "loader_internal.h"
+
+#define D2TK_LOADER_BUCKET_MIN 0x10
+#define D2TK_LOADER_THUMB_MAGIC "d2tkthb1"
+
+typedef enum _d2tk_job_state_t {
+	D2TK_JOB_STATE_QUEUED = 0,
+	D2TK_JOB_STATE_BUSY,
+	D2TK_JOB_STATE_DONE,
+	D2TK_JOB_STATE_FAILED
+} d2tk_job_state_t;
+
+typedef struct _d2tk_job_t d2tk_job_t;
+typedef struct _d2tk_thumb_t d2tk_thumb_t;
+
+struct _d2tk_job_t {
+	d2tk_job_t *next;
+	uint64_t hash;
+	uint32_t bucket;
+	d2tk_job_state_t state;
+	uint8_t *pixels;
+	int w;
+	int h;
+	int64_t size; // of source when decoded, -1 if missing
+	int64_t mtime;
+	char path [];
+};
+
+struct _d2tk_loader_t {
+	d2tk_loader_convert_t convert;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool done;
+	atomic_bool ready;
+	d2tk_job_t *jobs;
+};
+
+struct _d2tk_thumb_t {
+	char magic [8];
+	uint64_t size;
+	int64_t mtime;
+	uint32_t w;
+	uint32_t h;
+};
+
+static d2tk_job_t *
+_d2tk_loader_next(d2tk_loader_t *loader)
+{
+	for(d2tk_job_t *job = loader->jobs; job; job = job->next)
+	{
+		if(job->state == D2TK_JOB_STATE_QUEUED)
+		{
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+static char *
+_d2tk_thumb_path(const char *path, uint32_t bucket)
+{
+	const char *cache = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char *thumb_path = NULL;
+	int ret;
+
+	// keyed by the hash of the absolute path, which may not exist anymore
+	char *abs_path = realpath(path, NULL);
+	const char *key = abs_path ? abs_path : path;
+	const uint64_t hash = d2tk_hash(key, strlen(key));
+
+	free(abs_path);
+
+	// freedesktop-like layout, e.g. ~/.cache/d2tk/thumbnails/256/<hash>.thumb
+	if(cache && (cache[0] == '/'))
+	{
+		ret = asprintf(&thumb_path, "%s/d2tk/thumbnails/%"PRIu32"/%016"PRIx64".thumb",
+			cache, bucket, hash);
+	}
+	else if(home && (home[0] == '/'))
+	{
+		ret = asprintf(&thumb_path, "%s/.cache/d2tk/thumbnails/%"PRIu32"/%016"PRIx64".thumb",
+			home, bucket, hash);
+	}
+	else
+	{
+		return NULL;
+	}
+
+	if(ret == -1)
+	{
+		return NULL;
+	}
+
+	return thumb_path;
+}
+
+static int
+_d2tk_thumb_mkdir(char *thumb_path)
+{
+	// create missing parent directories, private as per freedesktop spec
+	for(char *sep = strchr(thumb_path + 1, '/'); sep; sep = strchr(sep + 1, '/'))
+	{
+		*sep = '\0';
+		const int ret = mkdir(thumb_path, 0700);
+		*sep = '/';
+
+		if( (ret == -1) && (errno != EEXIST) )
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static uint8_t *
+_d2tk_thumb_read(const char *thumb_path, const struct stat *st, int *w, int *h)
+{
+	const int fd = open(thumb_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd == -1)
+	{
+		return NULL;
+	}
+
+	// only trust own thumbnails
+	struct stat thumb_st;
+	if(  (fstat(fd, &thumb_st) != 0) || !S_ISREG(thumb_st.st_mode)
+		|| (thumb_st.st_uid != getuid()) )
+	{
+		close(fd);
+		return NULL;
+	}
+
+	FILE *f = fdopen(fd, "rb");
+	if(!f)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	d2tk_thumb_t thumb;
+	uint8_t *pixels = NULL;
+
+	// only valid as long as the original has not changed
+	if( (fread(&thumb, sizeof(thumb), 1, f) == 1)
+		&& !memcmp(thumb.magic, D2TK_LOADER_THUMB_MAGIC, sizeof(thumb.magic))
+		&& (thumb.size == (uint64_t)st->st_size)
+		&& (thumb.mtime == (int64_t)st->st_mtime)
+		&& thumb.w && thumb.h
+		&& (thumb.w <= 2*D2TK_LOADER_BUCKET_MAX)
+		&& (thumb.h <= 2*D2TK_LOADER_BUCKET_MAX) )
+	{
+		const size_t sz = thumb.w*thumb.h*sizeof(uint32_t);
+
+		pixels = malloc(sz);
+		if(pixels && (fread(pixels, sz, 1, f) == 1) )
+		{
+			*w = thumb.w;
+			*h = thumb.h;
+		}
+		else
+		{
+			free(pixels);
+			pixels = NULL;
+		}
+	}
+
+	fclose(f);
+
+	return pixels;
+}
+
+static void
+_d2tk_thumb_write(char *thumb_path, const struct stat *st,
+	const uint8_t *pixels, int w, int h)
+{
+	if(_d2tk_thumb_mkdir(thumb_path) != 0)
+	{
+		return;
+	}
+
+	char *tmp_path = NULL;
+	if(asprintf(&tmp_path, "%s.XXXXXX", thumb_path) == -1)
+	{
+		return;
+	}
+
+	// write to temporary file and rename atomically to not expose partial ones
+	const int fd = mkstemp(tmp_path);
+	if(fd == -1)
+	{
+		free(tmp_path);
+		return; // e.g. read-only cache, simply do not persist
+	}
+
+	FILE *f = fdopen(fd, "wb");
+	if(!f)
+	{
+		close(fd);
+		unlink(tmp_path);
+		free(tmp_path);
+		return;
+	}
+
+	d2tk_thumb_t thumb = {
+		.size = st->st_size,
+		.mtime = st->st_mtime,
+		.w = w,
+		.h = h
+	};
+	memcpy(thumb.magic, D2TK_LOADER_THUMB_MAGIC, sizeof(thumb.magic));
+
+	const size_t sz = w*h*sizeof(uint32_t);
+	const bool written = (fwrite(&thumb, sizeof(thumb), 1, f) == 1)
+		&& (fwrite(pixels, sz, 1, f) == 1);
+
+	if( (fclose(f) != 0) || !written || (rename(tmp_path, thumb_path) != 0) )
+	{
+		unlink(tmp_path);
+	}
+
+	free(tmp_path);
+}
+
+static uint8_t *
+_d2tk_loader_downscale(const uint8_t *src, int W, int H, int w, int h)
+{
+	uint8_t *dst = malloc(w*h*sizeof(uint32_t));
+	if(!dst)
+	{
+		return NULL;
+	}
+
+	// area averaging with alpha weighting to not bleed transparent colors
+	for(int y = 0; y < h; y++)
+	{
+		const int y0 = (int64_t)y*H / h;
+		const int y1 = (int64_t)(y + 1)*H / h;
+
+		for(int x = 0; x < w; x++)
+		{
+			const int x0 = (int64_t)x*W / w;
+			const int x1 = (int64_t)(x + 1)*W / w;
+			uint64_t rgb [3] = { 0, 0, 0 };
+			uint64_t a = 0;
+
+			for(int Y = y0; Y < y1; Y++)
+			{
+				const uint8_t *pix = &src[(Y*W + x0)*sizeof(uint32_t)];
+
+				for(int X = x0; X < x1; X++, pix += sizeof(uint32_t))
+				{
+					rgb[0] += pix[0] * pix[3];
+					rgb[1] += pix[1] * pix[3];
+					rgb[2] += pix[2] * pix[3];
+					a += pix[3];
+				}
+			}
+
+			const uint64_t n = (y1 - y0)*(x1 - x0);
+			uint8_t *pix = &dst[(y*w + x)*sizeof(uint32_t)];
+
+			for(unsigned c = 0; c < 3; c++)
+			{
+				pix[c] = a ? (rgb[c] + a/2) / a : 0;
+			}
+			pix[3] = (a + n/2) / n;
+		}
+	}
+
+	return dst;
+}
+
+static void
+_d2tk_loader_stamp(const char *path, int64_t *size, int64_t *mtime)
+{
+	struct stat st;
+
+	if(stat(path, &st) != 0)
+	{
+		*size = -1;
+		*mtime = 0;
+		return;
+	}
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+}
+
+static uint8_t *
+_d2tk_loader_load(const char *path, uint32_t bucket, int *w, int *h)
+{
+	struct stat st;
+	if(stat(path, &st) != 0)
+	{
+		return NULL;
+	}
+
+	char *thumb_path = bucket ? _d2tk_thumb_path(path, bucket) : NULL;
+
+	if(thumb_path)
+	{
+		uint8_t *pixels = _d2tk_thumb_read(thumb_path, &st, w, h);
+
+		if(pixels)
+		{
+			free(thumb_path);
+			return pixels;
+		}
+	}
+
+	int W, H, N;
+	uint8_t *pixels = stbi_load(path, &W, &H, &N, 4);
+
+	// downscale to fit into bucket if needed and persist it
+	if(pixels && thumb_path && ( ((uint32_t)W > bucket) || ((uint32_t)H > bucket) ) )
+	{
+		const float scale = (float)bucket / (W > H ? W : H);
+		const int tw = W*scale > 1.f ? W*scale + 0.5f : 1;
+		const int th = H*scale > 1.f ? H*scale + 0.5f : 1;
+
+		uint8_t *thumb = _d2tk_loader_downscale(pixels, W, H, tw, th);
+
+		if(thumb)
+		{
+			_d2tk_thumb_write(thumb_path, &st, thumb, tw, th);
+
+			stbi_image_free(pixels);
+			pixels = thumb;
+			W = tw;
+			H = th;
+		}
+	}
+
+	free(thumb_path);
+
+	if(pixels)
+	{
+		*w = W;
+		*h = H;
+	}
+
+	return pixels;
+}
+
+static void *
+_d2tk_loader_thread(void *data)
+{
+	d2tk_loader_t *loader = data;
+
+	pthread_mutex_lock(&loader->lock);
+
+	while(!loader->done)
+	{
+		d2tk_job_t *job = _d2tk_loader_next(loader);
+
+		if(!job)
+		{
+			pthread_cond_wait(&loader->cond, &loader->lock);
+			continue;
+		}
+
+		// job is not touched by anyone else while busy, decode unlocked
+		job->state = D2TK_JOB_STATE_BUSY;
+		pthread_mutex_unlock(&loader->lock);
+
+		// stamp source before decoding, thus later changes trigger a retry
+		_d2tk_loader_stamp(job->path, &job->size, &job->mtime);
+
+		int W, H;
+		uint8_t *pixels = _d2tk_loader_load(job->path, job->bucket, &W, &H);
+
+		if(pixels && loader->convert)
+		{
+			loader->convert(pixels, W, H);
+		}
+
+		pthread_mutex_lock(&loader->lock);
+
+		if(pixels)
+		{
+			job->pixels = pixels;
+			job->w = W;
+			job->h = H;
+			job->state = D2TK_JOB_STATE_DONE;
+
+			atomic_store(&loader->ready, true);
+		}
+		else
+		{
+			job->state = D2TK_JOB_STATE_FAILED;
+		}
+	}
+
+	pthread_mutex_unlock(&loader->lock);
+
+	return NULL;
+}
+
+d2tk_loader_t *
+d2tk_loader_new(d2tk_loader_convert_t convert)
+{
+	d2tk_loader_t *loader = calloc(1, sizeof(d2tk_loader_t));
+	if(!loader)
+	{
+		return NULL;
+	}
+
+	loader->convert = convert;
+	atomic_init(&loader->ready, false);
+
+	// global stb_image settings, set once before any decoding starts
+	stbi_set_unpremultiply_on_load(1);
+	stbi_convert_iphone_png_to_rgb(1);
+
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->cond, NULL);
+
+	if(pthread_create(&loader->thread, NULL, _d2tk_loader_thread, loader) != 0)
+	{
+		pthread_cond_destroy(&loader->cond);
+		pthread_mutex_destroy(&loader->lock);
+		free(loader);
+
+		return NULL;
+	}
+
+	return loader;
+}
+
+void
+d2tk_loader_free(d2tk_loader_t *loader)
+{
+	if(!loader)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&loader->lock);
+	loader->done = true;
+	pthread_cond_signal(&loader->cond);
+	pthread_mutex_unlock(&loader->lock);
+
+	pthread_join(loader->thread, NULL);
+
+	for(d2tk_job_t *job = loader->jobs, *next; job; job = next)
+	{
+		next = job->next;
+
+		if(job->pixels)
+		{
+			stbi_image_free(job->pixels);
+		}
+
+		free(job);
+	}
+
+	pthread_cond_destroy(&loader->cond);
+	pthread_mutex_destroy(&loader->lock);
+	free(loader);
+}
+
+d2tk_loader_status_t
+d2tk_loader_get(d2tk_loader_t *loader, uint64_t hash, const char *path,
+	uint32_t bucket, uint8_t **pixels, int *w, int *h)
+{
+	d2tk_loader_status_t status = D2TK_LOADER_STATUS_PENDING;
+
+	pthread_mutex_lock(&loader->lock);
+
+	d2tk_job_t **ref = &loader->jobs;
+	for( ; *ref; ref = &(*ref)->next)
+	{
+		if((*ref)->hash == hash)
+		{
+			break;
+		}
+	}
+
+	d2tk_job_t *job = *ref;
+
+	if(!job) // not yet known, queue for decoding
+	{
+		const size_t path_len = strlen(path) + 1;
+
+		job = calloc(1, sizeof(d2tk_job_t) + path_len);
+		if(job)
+		{
+			job->hash = hash;
+			job->bucket = bucket;
+			job->state = D2TK_JOB_STATE_QUEUED;
+			memcpy(job->path, path, path_len);
+
+			*ref = job;
+			pthread_cond_signal(&loader->cond);
+		}
+		else
+		{
+			status = D2TK_LOADER_STATUS_FAILED;
+		}
+	}
+	else if(job->state == D2TK_JOB_STATE_DONE) // hand over pixels to caller
+	{
+		*pixels = job->pixels;
+		*w = job->w;
+		*h = job->h;
+
+		*ref = job->next;
+		free(job);
+
+		status = D2TK_LOADER_STATUS_READY;
+	}
+	else if(job->state == D2TK_JOB_STATE_FAILED) // retry once source has changed
+	{
+		int64_t size;
+		int64_t mtime;
+
+		_d2tk_loader_stamp(job->path, &size, &mtime);
+
+		if( (size != job->size) || (mtime != job->mtime) )
+		{
+			job->state = D2TK_JOB_STATE_QUEUED;
+			pthread_cond_signal(&loader->cond);
+		}
+		else
+		{
+			status = D2TK_LOADER_STATUS_FAILED;
+		}
+	}
+
+	pthread_mutex_unlock(&loader->lock);
+
+	return status;
+}
+
+bool
+d2tk_loader_get_ready(d2tk_loader_t *loader)
+{
+	return atomic_exchange(&loader->ready, false);
+}
+
+uint32_t
+d2tk_loader_bucket(int w, int h)
+{
+	uint32_t bucket = D2TK_LOADER_BUCKET_MIN;
+	const int dim = w > h ? w : h;
+
+	// round up to next power of two, above maximum, load original size
+	while( (bucket < (uint32_t)dim) && (bucket <= D2TK_LOADER_BUCKET_MAX) )
+	{
+		bucket <<= 1;
+	}
+
+	return bucket > D2TK_LOADER_BUCKET_MAX ? 0 : bucket;
+}
+
+void
+d2tk_loader_pixels_free(uint8_t *pixels)
+{
+	stbi_image_free(pixels);
+}
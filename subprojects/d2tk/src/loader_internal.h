@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2018-2019 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _D2TK_LOADER_INTERNAL_H
+#define _D2TK_LOADER_INTERNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define D2TK_LOADER_BUCKET_MAX 0x1000
+
+typedef struct _d2tk_loader_t d2tk_loader_t;
+
+typedef enum _d2tk_loader_status_t {
+	D2TK_LOADER_STATUS_PENDING = 0,
+	D2TK_LOADER_STATUS_READY,
+	D2TK_LOADER_STATUS_FAILED
+} d2tk_loader_status_t;
+
+typedef void (*d2tk_loader_convert_t)(uint8_t *pixels, int w, int h);
+
+d2tk_loader_t *
+d2tk_loader_new(d2tk_loader_convert_t convert);
+
+void
+d2tk_loader_free(d2tk_loader_t *loader);
+
+d2tk_loader_status_t
+d2tk_loader_get(d2tk_loader_t *loader, uint64_t hash, const char *path,
+	uint32_t bucket, uint8_t **pixels, int *w, int *h);
+
+uint32_t
+d2tk_loader_bucket(int w, int h);
+
+bool
+d2tk_loader_get_ready(d2tk_loader_t *loader);
+
+void
+d2tk_loader_pixels_free(uint8_t *pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _D2TK_LOADER_INTERNAL_H
@@ -20,10 +20,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <poll.h>
 
 #include <d2tk/base.h>
 #include <d2tk/hash.h>
 #include "mock.h"
+#include "src/base_internal.h"
 
 #define N 4
 static void
@@ -859,6 +861,66 @@ _test_state_dump()
 		".1..............") == 0);
 }
 
+static void
+_test_file_descriptors()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	int pfd [2];
+	assert(pipe(pfd) == 0);
+
+	int fds [4];
+	assert(d2tk_base_get_file_descriptors(base, fds, 4) == 0);
+
+	assert(d2tk_base_add_file_descriptor(base, pfd[0]) == 0);
+	assert(d2tk_base_get_file_descriptors(base, fds, 4) == 1);
+#if defined(__linux__)
+	// aggregated into a single epoll fd
+	assert(fds[0] != pfd[0]);
+#else
+	assert(fds[0] == pfd[0]);
+#endif
+
+	struct pollfd pollfd = {
+		.fd = fds[0],
+		.events = POLLIN
+	};
+	assert(poll(&pollfd, 1, 0) == 0);
+
+	// not readable yet
+	d2tk_base_probe(base);
+	assert(d2tk_base_get_again(base) == false);
+
+	// readable
+	assert(write(pfd[1], "x", 1) == 1);
+	d2tk_base_probe(base);
+	assert(d2tk_base_get_again(base) == true);
+	assert(poll(&pollfd, 1, 0) == 1);
+
+	assert(d2tk_base_remove_file_descriptor(base, pfd[0]) == 0);
+	assert(d2tk_base_remove_file_descriptor(base, pfd[0]) == 1);
+	assert(d2tk_base_get_file_descriptors(base, fds, 4) == 0);
+
+	d2tk_base_probe(base);
+	assert(d2tk_base_get_again(base) == false);
+
+	close(pfd[0]);
+	close(pfd[1]);
+
+#if defined(__linux__)
+	// closed fd cannot be watched, thus is not counted
+	assert(d2tk_base_add_file_descriptor(base, pfd[0]) == 1);
+	assert(d2tk_base_get_file_descriptors(base, fds, 4) == 0);
+#endif
+
+	d2tk_base_free(base);
+}
+
 static void
 _test_table_rel()
 {
@@ -2159,6 +2221,299 @@ _test_text_field()
 	d2tk_base_free(base);
 }
 
+static void
+_test_textedit()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	const d2tk_rect_t rect = D2TK_RECT(0, 0, DIM_W, DIM_H);
+	assert(base);
+
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_END, true);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_BACKSPACE, true);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_ENTER, true);
+	d2tk_base_append_utf8(base, 0x00e4); // a umlaut
+
+	const char *txt = "ab\ncd";
+	size_t len = strlen(txt);
+	const d2tk_state_t state = d2tk_base_textedit(base, D2TK_ID, &len, &txt,
+		16, &rect, D2TK_FLAG_NONE);
+	assert(d2tk_state_is_changed(state));
+	assert(d2tk_state_is_focused(state));
+	assert(len == 7);
+	assert(!strcmp(txt, "a\n\xc3\xa4\ncd"));
+
+	d2tk_base_free(base);
+}
+
+// line index must match a full recount of the text after each edit
+static void
+_assert_textedit_lines(d2tk_base_t *base, d2tk_id_t id, const char *txt,
+	size_t len)
+{
+	size_t nlines = 0;
+	const size_t *lines = _d2tk_base_textedit_lines(base, id, &nlines);
+	size_t l = 0;
+
+	assert(lines);
+	assert(strlen(txt) == len);
+	assert(lines[l++] == 0);
+
+	for(size_t i = 0; i < len; i++)
+	{
+		if(txt[i] == '\n')
+		{
+			assert(l < nlines);
+			assert(lines[l++] == i + 1);
+		}
+	}
+
+	assert(l == nlines);
+}
+
+static d2tk_state_t
+_textedit_frame(d2tk_base_t *base, d2tk_id_t id, size_t *len,
+	const char **txt, d2tk_flag_t flags)
+{
+	const d2tk_rect_t rect = D2TK_RECT(0, 0, DIM_W, DIM_H);
+
+	d2tk_base_pre(base, NULL);
+	const d2tk_state_t state = d2tk_base_textedit(base, id, len, txt,
+		16, &rect, flags);
+	d2tk_base_post(base);
+	assert(d2tk_state_is_focused(state));
+	_assert_textedit_lines(base, id, *txt, *len);
+
+	return state;
+}
+
+static void
+_test_textedit_remove_lines()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	d2tk_base_set_dimensions(base, DIM_W, DIM_H);
+	const d2tk_id_t id = D2TK_ID;
+
+	const char *txt = "ab\n\ncd\nef\n";
+	size_t len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	// join lines backwards from start of 'cd'
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_DOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_DOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	for(unsigned i = 0; i < 3; i++)
+	{
+		d2tk_base_set_keymask(base, D2TK_KEYMASK_BACKSPACE, true);
+		assert(d2tk_state_is_changed(_textedit_frame(base, id, &len, &txt,
+			D2TK_FLAG_NONE)));
+	}
+	assert(!strcmp(txt, "acd\nef\n"));
+
+	// join lines forwards from end of 'acd', down to trailing empty line
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_END, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	for(unsigned i = 0; i < 4; i++)
+	{
+		d2tk_base_set_keymask(base, D2TK_KEYMASK_DEL, true);
+		assert(d2tk_state_is_changed(_textedit_frame(base, id, &len, &txt,
+			D2TK_FLAG_NONE)));
+	}
+	assert(!strcmp(txt, "acd"));
+
+	d2tk_base_free(base);
+}
+
+static void
+_test_textedit_insert_lines()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	d2tk_base_set_dimensions(base, DIM_W, DIM_H);
+	const d2tk_id_t id = D2TK_ID;
+
+	const char *txt = "ab\ncd\nef";
+	size_t len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	// split 'cd' into several lines
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_DOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_RIGHT, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	for(unsigned i = 0; i < 3; i++)
+	{
+		d2tk_base_set_keymask(base, D2TK_KEYMASK_ENTER, true);
+		d2tk_base_append_utf8(base, 'x');
+		d2tk_base_append_utf8(base, 'y');
+		assert(d2tk_state_is_changed(_textedit_frame(base, id, &len, &txt,
+			D2TK_FLAG_NONE)));
+	}
+	assert(!strcmp(txt, "ab\nc\nxy\nxy\nxyd\nef"));
+
+	// reload multi-line text in place of a single line
+	txt = "0\n1\n2\n3\n";
+	len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_TEXTEDIT_RELOAD);
+
+	d2tk_base_free(base);
+}
+
+static void
+_test_textedit_grow()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	d2tk_base_set_dimensions(base, DIM_W, DIM_H);
+	const d2tk_id_t id = D2TK_ID;
+
+	char ref [0x1000];
+	const char *tail = "ab\ncd\nef\n";
+	const char *txt = tail;
+	size_t len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	// insert beyond initial gap with text after the cursor
+	size_t off = 0;
+
+	for(unsigned i = 0; i < 0x100; i++)
+	{
+		d2tk_base_append_utf8(base, 0x00e4); // a umlaut
+		d2tk_base_append_utf8(base, 'x');
+		d2tk_base_set_keymask(base, D2TK_KEYMASK_ENTER, true);
+		assert(d2tk_state_is_changed(_textedit_frame(base, id, &len, &txt,
+			D2TK_FLAG_NONE)));
+
+		// newline is inserted before the characters
+		off += snprintf(&ref[off], sizeof(ref) - off, "\n\xc3\xa4x");
+	}
+
+	snprintf(&ref[off], sizeof(ref) - off, "%s", tail);
+	assert(len > 0x400);
+	assert(!strcmp(txt, ref));
+
+	d2tk_base_free(base);
+}
+
+static void
+_test_textedit_reload_utf8()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	d2tk_base_set_dimensions(base, DIM_W, DIM_H);
+	const d2tk_id_t id = D2TK_ID;
+
+	const char *txt = "abcd\nef";
+	size_t len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_RIGHT, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_RIGHT, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	// cursor at offset 2 ends up on continuation byte of a umlaut
+	txt = "a\xc3\xa4\nb\nc";
+	len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_TEXTEDIT_RELOAD);
+
+	d2tk_base_append_utf8(base, 'x');
+	assert(d2tk_state_is_changed(_textedit_frame(base, id, &len, &txt,
+		D2TK_FLAG_NONE)));
+	assert(!strcmp(txt, "ax\xc3\xa4\nb\nc"));
+
+	d2tk_base_free(base);
+}
+
+static void
+_test_textedit_page()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	d2tk_base_t *base = d2tk_base_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(base);
+
+	d2tk_base_set_dimensions(base, DIM_W, DIM_H);
+	const d2tk_id_t id = D2TK_ID;
+
+	const char *txt = "ab\ncd\nef";
+	size_t len = strlen(txt);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+
+	// page up on first line
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEUP, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_append_utf8(base, 'x');
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	assert(!strcmp(txt, "xab\ncd\nef"));
+
+	// page down clamps to last line, keeps goal column
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEDOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_append_utf8(base, 'y');
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	assert(!strcmp(txt, "xab\ncd\neyf"));
+
+	// page down on last line
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEDOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_append_utf8(base, 'z');
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	assert(!strcmp(txt, "xab\ncd\neyzf"));
+
+	// page up clamps to first line, column to its end
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEUP, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_ENTER, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	assert(!strcmp(txt, "xab\n\ncd\neyzf"));
+
+	// page down onto trailing empty line
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEDOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_END, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_ENTER, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_set_keymask(base, D2TK_KEYMASK_PAGEDOWN, true);
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	d2tk_base_append_utf8(base, 'w');
+	_textedit_frame(base, id, &len, &txt, D2TK_FLAG_NONE);
+	assert(!strcmp(txt, "xab\n\ncd\neyzf\nw"));
+
+	d2tk_base_free(base);
+}
+
 static void
 _test_label()
 {
@@ -2513,6 +2868,7 @@ main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
 	_test_key_bwd_focus();
 	_test_get_set();
 	_test_state_dump();
+	_test_file_descriptors();
 	_test_table_rel();
 	_test_table_rel_empty();
 	_test_table_abs();
@@ -2556,6 +2912,12 @@ main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
 	_test_combo_mouse_down_inc();
 	_test_combo_mouse_down_equ();
 	_test_text_field();
+	_test_textedit();
+	_test_textedit_remove_lines();
+	_test_textedit_insert_lines();
+	_test_textedit_grow();
+	_test_textedit_reload_utf8();
+	_test_textedit_page();
 	_test_label();
 	_test_label_null();
 	_test_label_filled();
@@ -1140,6 +1140,54 @@ _test_image()
 	d2tk_core_free(core);
 }
 
+static unsigned image_again_num = 0;
+
+static void
+_check_image_again(const d2tk_com_t *com, const d2tk_clip_t *clip)
+{
+	_check_image(com, clip);
+
+	image_again_num += 1;
+}
+
+static void
+_test_image_again()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_image_again
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver_again, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	for(unsigned i = 0; i < 3; i++)
+	{
+		// pretend an asynchronously loaded image has become ready
+		if(i == 2)
+		{
+			assert(d2tk_core_get_again(core) == true);
+		}
+
+		d2tk_core_pre(core, NULL);
+		const ssize_t ref = d2tk_core_bbox_push(core, true,
+			&D2TK_RECT(CLIP_X, CLIP_Y, CLIP_W, CLIP_H));
+		assert(ref >= 0);
+
+		d2tk_core_image(core, &D2TK_RECT(IMAGE_X, IMAGE_Y, IMAGE_W, IMAGE_H),
+			strlen(IMAGE_PATH), IMAGE_PATH, IMAGE_ALIGN);
+
+		d2tk_core_bbox_pop(core, ref);
+		d2tk_core_post(core);
+
+		// unchanged frame is only reprocessed after image became ready
+		assert(image_again_num == (i == 0 ? 1 : i));
+	}
+
+	d2tk_core_free(core);
+}
+
 #undef IMAGE_X
 #undef IMAGE_Y
 #undef IMAGE_W
@@ -1147,6 +1195,324 @@ _test_image()
 #undef IMAGE_PATH
 #undef IMAGE_ALIGN
 
+#define SPRITES_NUM 0x20000 // beyond former fixed table size
+
+static void
+_test_sprites()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = NULL
+	};
+
+	uintptr_t **sprites = calloc(SPRITES_NUM, sizeof(uintptr_t *));
+	assert(sprites);
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+	d2tk_core_set_ttls(core, 2, 2);
+
+	// consume initial full refresh
+	d2tk_core_pre(core, NULL);
+	d2tk_core_post(core);
+
+	for(uint64_t i = 0; i < SPRITES_NUM; i++)
+	{
+		uintptr_t *sprite = d2tk_core_get_sprite(core, i, 1);
+		assert(sprite);
+		assert(*sprite == 0);
+
+		uint32_t *dummy = malloc(sizeof(uint32_t));
+		assert(dummy);
+		*dummy = 1234;
+
+		*sprite = (uintptr_t)dummy;
+		sprites[i] = sprite;
+	}
+
+	// entries stay put while the table grows
+	for(uint64_t i = 0; i < SPRITES_NUM; i++)
+	{
+		assert(d2tk_core_get_sprite(core, i, 1) == sprites[i]);
+	}
+
+	// unused sprites are freed once their ttl has expired
+	for(unsigned i = 0; i < 2; i++)
+	{
+		d2tk_core_pre(core, NULL);
+		d2tk_core_post(core);
+	}
+
+	uintptr_t *sprite = d2tk_core_get_sprite(core, 0, 1);
+	assert(sprite);
+	assert(*sprite == 0);
+
+	d2tk_core_free(core);
+	free(sprites);
+}
+
+#undef SPRITES_NUM
+
+#define SCROLL_ROWS 40
+#define SCROLL_H 10
+
+static unsigned scroll_drawn = 0;
+
+static void
+_check_scroll(const d2tk_com_t *com, const d2tk_clip_t *clip __attribute__((unused)))
+{
+	assert(com->instr == D2TK_INSTR_RECT);
+
+	scroll_drawn += 1;
+}
+
+static void
+_test_scroll()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_scroll
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	for(unsigned i = 0; i < 3; i++)
+	{
+		scroll_drawn = 0;
+
+		d2tk_core_pre(core, NULL);
+
+		// scroll all rows down by one in second frame, keep them in third
+		for(unsigned j = 0; j < SCROLL_ROWS; j++)
+		{
+			const d2tk_coord_t y = ((i ? 1 : 0) + j)*SCROLL_H;
+			const ssize_t ref = d2tk_core_bbox_push(core, true,
+				&D2TK_RECT(0, y, DIM_W, SCROLL_H));
+			assert(ref >= 0);
+
+			d2tk_core_rect(core, &D2TK_RECT(0, y, j + 1, SCROLL_H));
+
+			d2tk_core_bbox_pop(core, ref);
+		}
+
+		d2tk_core_post(core);
+
+		if(i < 2)
+		{
+			// all rows have moved, the vacated top row is merely cleared
+			assert(scroll_drawn == SCROLL_ROWS);
+		}
+		else
+		{
+			assert(scroll_drawn == 0);
+		}
+	}
+
+	d2tk_core_free(core);
+}
+
+#undef SCROLL_ROWS
+#undef SCROLL_H
+
+#define DAMAGE_W 20
+#define DAMAGE_H 20
+
+static unsigned damage_num = 0;
+
+static void
+_check_damage(const d2tk_com_t *com, const d2tk_clip_t *clip)
+{
+	assert(com->instr == D2TK_INSTR_RECT);
+	assert(clip->w == DAMAGE_W);
+	assert(clip->h == DAMAGE_H);
+
+	damage_num += 1;
+}
+
+static void
+_test_damage()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_damage
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	static const d2tk_coord_t pos [3][2] = {
+		{ 0, 0 }, // top-left
+		{ (DIM_W - DAMAGE_W)/2, (DIM_H - DAMAGE_H)/2 }, // center
+		{ DIM_W - 2*DAMAGE_W, DIM_H - 2*DAMAGE_H } // bottom-right
+	};
+
+	for(unsigned i = 0; i < 2; i++)
+	{
+		damage_num = 0;
+		ctx.ndamage = 0;
+
+		d2tk_core_pre(core, NULL);
+
+		for(unsigned j = 0; j < 3; j++)
+		{
+			const d2tk_rect_t rect = D2TK_RECT(pos[j][0], pos[j][1],
+				DAMAGE_W, DAMAGE_H);
+			const ssize_t ref = d2tk_core_bbox_push(core, true, &rect);
+			assert(ref >= 0);
+
+			// only change corner bboxes in second frame
+			const d2tk_coord_t w = (i == 1) && (j != 1)
+				? DAMAGE_W/2
+				: DAMAGE_W;
+
+			d2tk_core_rect(core, &D2TK_RECT(rect.x, rect.y, w, rect.h));
+
+			d2tk_core_bbox_pop(core, ref);
+		}
+
+		d2tk_core_post(core);
+
+		if(i == 0)
+		{
+			assert(ctx.ndamage == 1); // full refresh
+			assert(damage_num == 3);
+		}
+		else
+		{
+			assert(ctx.ndamage == 2); // not merged into a single bounding box
+			assert(damage_num == 2); // center bbox is not redrawn
+		}
+	}
+
+	d2tk_core_free(core);
+}
+
+static void
+_check_damage_slack(const d2tk_com_t *com,
+	const d2tk_clip_t *clip __attribute__((unused)))
+{
+	assert(com->instr == D2TK_INSTR_RECT);
+
+	damage_num += 1;
+}
+
+static void
+_test_damage_slack()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_damage_slack
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	// overlapping rectangles get merged, small one lies in the unfilled corner
+	static const d2tk_rect_t rects [3] = {
+		{ 0, 0, DAMAGE_W, DAMAGE_H },
+		{ 4, DAMAGE_H/2, DAMAGE_W, DAMAGE_H },
+		{ DAMAGE_W + 1, 1, 2, 2 }
+	};
+
+	for(unsigned i = 0; i < 2; i++)
+	{
+		damage_num = 0;
+		ctx.ndamage = 0;
+
+		d2tk_core_pre(core, NULL);
+
+		for(unsigned j = 0; j < 3; j++)
+		{
+			const d2tk_rect_t *rect = &rects[j];
+			const ssize_t ref = d2tk_core_bbox_push(core, true, rect);
+			assert(ref >= 0);
+
+			// only change overlapping bboxes in second frame
+			const d2tk_coord_t w = (i == 1) && (j != 2)
+				? rect->w/2
+				: rect->w;
+
+			d2tk_core_rect(core, &D2TK_RECT(rect->x, rect->y, w, rect->h));
+
+			d2tk_core_bbox_pop(core, ref);
+		}
+
+		d2tk_core_post(core);
+
+		if(i == 0)
+		{
+			assert(damage_num == 3);
+		}
+		else
+		{
+			assert(ctx.ndamage == 1); // merged
+			assert(damage_num == 2); // small bbox is not redrawn
+		}
+	}
+
+	d2tk_core_free(core);
+}
+
+#undef DAMAGE_W
+#undef DAMAGE_H
+
+static unsigned stale_num = 0;
+
+static void
+_check_stale(const d2tk_com_t *com __attribute__((unused)),
+	const d2tk_clip_t *clip __attribute__((unused)))
+{
+	stale_num += 1;
+}
+
+static void
+_test_stale()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_stale
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver_lazy, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	for(unsigned i = 0; i < 5; i++)
+	{
+		stale_num = 0;
+
+		d2tk_core_pre(core, NULL);
+
+		// first frames grow instruction buffers, leaving stale bytes behind
+		const unsigned n = i < 2 ? 0x1000 : 1;
+
+		for(unsigned j = 0; j < n; j++)
+		{
+			const ssize_t ref = d2tk_core_bbox_push(core, true,
+				&D2TK_RECT(CLIP_X, CLIP_Y, CLIP_W, CLIP_H));
+			assert(ref >= 0);
+
+			d2tk_core_font_face(core, 1 + j % 8, "Sans Bold Italic");
+
+			d2tk_core_bbox_pop(core, ref);
+		}
+
+		d2tk_core_post(core);
+
+		if(i == 4)
+		{
+			assert(stale_num == 0); // identical frame is not redrawn
+		}
+	}
+
+	d2tk_core_free(core);
+}
+
 #define BITMAP_X 10
 #define BITMAP_Y 20
 #define BITMAP_W 30
@@ -1314,6 +1680,93 @@ _test_custom()
 #undef CUSTOM_SIZE
 #undef CUSTOM_DATA
 
+#define GRID_X 10
+#define GRID_Y 20
+#define GRID_W 32
+#define GRID_H 16
+#define GRID_NCOLS 4
+#define GRID_NROWS 2
+#define GRID_REGULAR "FiraCode:regular"
+#define GRID_BOLD "FiraCode:bold"
+#define GRID_ITALIC "FiraCode:light"
+static const d2tk_cell_t _cells [GRID_NCOLS*GRID_NROWS] = {
+	[0] = { .code = 'a', .attr = D2TK_CELL_NONE, .fg = 0xffffffff },
+	[1] = { .code = 'b', .attr = D2TK_CELL_BOLD, .fg = 0xffffffff },
+	[2] = { .code = 'c', .attr = D2TK_CELL_ITALIC, .fg = 0xffffffff },
+	[3] = { .code = 'd', .attr = D2TK_CELL_BOLD | D2TK_CELL_ITALIC },
+	[5] = { .attr = D2TK_CELL_REVERSE, .bg = 0xff0000ff }
+};
+
+static void
+_check_grid(const d2tk_com_t *com, const d2tk_clip_t *clip)
+{
+	assert(clip->x0 == CLIP_X);
+	assert(clip->y0 == CLIP_Y);
+	assert(clip->x1 == CLIP_X + CLIP_W);
+	assert(clip->y1 == CLIP_Y + CLIP_H);
+	assert(clip->w == CLIP_W);
+	assert(clip->h == CLIP_H);
+
+	const uint64_t dhash = d2tk_hash(_cells, sizeof(_cells));
+	const d2tk_body_grid_t *body = &com->body->grid;
+
+	assert(com->size == sizeof(d2tk_body_grid_t) + sizeof(GRID_REGULAR)
+		+ sizeof(GRID_BOLD) + sizeof(GRID_ITALIC));
+	assert(com->instr == D2TK_INSTR_GRID);
+	assert(body->x == GRID_X - CLIP_X);
+	assert(body->y == GRID_Y - CLIP_Y);
+	assert(body->w == GRID_W);
+	assert(body->h == GRID_H);
+	assert(body->ncols == GRID_NCOLS);
+	assert(body->nrows == GRID_NROWS);
+	assert(body->dhash == dhash);
+	assert(body->cells == _cells);
+
+	assert(!strcmp(d2tk_body_grid_get_face(body, _cells[0].attr), GRID_REGULAR));
+	assert(!strcmp(d2tk_body_grid_get_face(body, _cells[1].attr), GRID_BOLD));
+	assert(!strcmp(d2tk_body_grid_get_face(body, _cells[2].attr), GRID_ITALIC));
+	assert(!strcmp(d2tk_body_grid_get_face(body, _cells[3].attr), GRID_BOLD));
+	assert(!strcmp(d2tk_body_grid_get_face(body, _cells[5].attr), GRID_REGULAR));
+}
+
+static void
+_test_grid()
+{
+	d2tk_mock_ctx_t ctx = {
+		.check = _check_grid
+	};
+
+	d2tk_core_t *core = d2tk_core_new(&d2tk_mock_driver, &ctx);
+	assert(core);
+
+	d2tk_core_set_dimensions(core, DIM_W, DIM_H);
+
+	d2tk_core_pre(core, NULL);
+	const ssize_t ref = d2tk_core_bbox_push(core, true,
+		&D2TK_RECT(CLIP_X, CLIP_Y, CLIP_W, CLIP_H));
+	assert(ref >= 0);
+
+	const uint64_t dhash = d2tk_hash(_cells, sizeof(_cells));
+
+	d2tk_core_grid(core, &D2TK_RECT(GRID_X, GRID_Y, GRID_W, GRID_H),
+		GRID_NCOLS, GRID_NROWS, _cells, dhash,
+		GRID_REGULAR, GRID_BOLD, GRID_ITALIC);
+
+	d2tk_core_bbox_pop(core, ref);
+	d2tk_core_post(core);
+	d2tk_core_free(core);
+}
+
+#undef GRID_X
+#undef GRID_Y
+#undef GRID_W
+#undef GRID_H
+#undef GRID_NCOLS
+#undef GRID_NROWS
+#undef GRID_REGULAR
+#undef GRID_BOLD
+#undef GRID_ITALIC
+
 #define STROKE_WIDTH 2
 
 static void
@@ -1456,8 +1909,15 @@ main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
 	_test_font_face();
 	_test_text();
 	_test_image();
+	_test_image_again();
+	_test_sprites();
+	_test_scroll();
+	_test_damage();
+	_test_damage_slack();
+	_test_stale();
 	_test_bitmap();
 	_test_custom();
+	_test_grid();
 	_test_stroke_width();
 
 	_test_triple();
@@ -232,6 +232,38 @@ _d2tk_mock_process_lazy(void *data, d2tk_core_t *core, const d2tk_com_t *com,
 	assert(num > 0);
 }
 
+static inline bool
+_d2tk_mock_again(void *data)
+{
+	d2tk_mock_ctx_t *ctx = data;
+	assert(ctx);
+
+	return true;
+}
+
+static inline void
+_d2tk_mock_damage(void *data, d2tk_core_t *core, const d2tk_clip_t *rects,
+	unsigned nrects)
+{
+	d2tk_mock_ctx_t *ctx = data;
+	assert(ctx);
+
+	assert(core);
+	assert(rects);
+
+	for(unsigned i = 0; i < nrects; i++)
+	{
+		const d2tk_clip_t *rect = &rects[i];
+
+		assert( (rect->x0 >= 0) && (rect->x1 <= DIM_W) && (rect->x0 < rect->x1) );
+		assert( (rect->y0 >= 0) && (rect->y1 <= DIM_H) && (rect->y0 < rect->y1) );
+		assert(rect->w == rect->x1 - rect->x0);
+		assert(rect->h == rect->y1 - rect->y0);
+	}
+
+	ctx->ndamage = nrects;
+}
+
 const d2tk_core_driver_t d2tk_mock_driver = {
 	.new = NULL,
 	.free = NULL,
@@ -262,5 +294,18 @@ const d2tk_core_driver_t d2tk_mock_driver_lazy = {
 	.process = _d2tk_mock_process_lazy,
 	.post = _d2tk_mock_post,
 	.end = _d2tk_mock_end,
-	.sprite_free = _d2tk_mock_sprite_free
+	.sprite_free = _d2tk_mock_sprite_free,
+	.damage = _d2tk_mock_damage
+};
+
+const d2tk_core_driver_t d2tk_mock_driver_again = {
+	.new = NULL,
+	.free = NULL,
+	.context = _d2tk_mock_context,
+	.pre = _d2tk_mock_pre,
+	.process = _d2tk_mock_process_triple,
+	.post = _d2tk_mock_post,
+	.end = _d2tk_mock_end,
+	.sprite_free = _d2tk_mock_sprite_free,
+	.again = _d2tk_mock_again
 };
@@ -36,10 +36,12 @@ typedef struct _d2tk_mock_ctx_t d2tk_mock_ctx_t;
 
 struct _d2tk_mock_ctx_t {
 	d2tk_check_t check;
+	unsigned ndamage;
 };
 
 extern const d2tk_core_driver_t d2tk_mock_driver;
 extern const d2tk_core_driver_t d2tk_mock_driver_triple;
 extern const d2tk_core_driver_t d2tk_mock_driver_lazy;
+extern const d2tk_core_driver_t d2tk_mock_driver_again;
 
 #endif // _D2TK_MOCK_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <assert.h>
+
+#include <notes_chunks.h>
+
+#define TEXT_MAX 0x100000
+#define NSPLICES 2000
+
+typedef void (*test_t)(void);
+
+static uint8_t text [TEXT_MAX];
+static uint8_t copy [TEXT_MAX];
+
+static uint32_t
+_rand(uint32_t max)
+{
+	return max ? (uint32_t)rand() % max : 0;
+}
+
+static void
+_fill(uint8_t *dst, uint32_t len)
+{
+	static const char alphabet [] = "abcdefgh \n";
+
+	for(uint32_t i = 0; i < len; i++)
+	{
+		dst[i] = alphabet[_rand(sizeof(alphabet) - 1)];
+	}
+}
+
+static void
+_assert_contiguous(const chunks_t *chunks, uint32_t len)
+{
+	uint32_t offset = 0;
+
+	for(uint32_t i = 0; i < chunks->nchunks; i++)
+	{
+		assert(chunks->chunk[i].offset == offset);
+		assert(chunks->chunk[i].size > 0);
+		offset += chunks->chunk[i].size;
+	}
+
+	assert(offset == len);
+}
+
+static void
+_test_empty(void)
+{
+	chunks_t chunks;
+
+	_chunks_init(&chunks);
+
+	const uint64_t root = _chunks_reset(&chunks, text, 0);
+	_assert_contiguous(&chunks, 0);
+
+	// insert into and delete from empty text
+	_fill(text, 100);
+	assert(_chunks_update(&chunks, text, 100, 0, 0, 100) != root);
+	_assert_contiguous(&chunks, 100);
+	assert(_chunks_update(&chunks, text, 0, 0, 100, 0) == root);
+	_assert_contiguous(&chunks, 0);
+
+	_chunks_deinit(&chunks);
+}
+
+// incrementally updated root must match a full rebuild after random splices
+static void
+_test_splice(void)
+{
+	chunks_t incr;
+	chunks_t full;
+	uint32_t len = 200000;
+
+	_chunks_init(&incr);
+	_chunks_init(&full);
+
+	_fill(text, len);
+	_chunks_reset(&incr, text, len);
+
+	for(unsigned i = 0; i < NSPLICES; i++)
+	{
+		// mostly small edits, some big ones spanning many chunks
+		const uint32_t offset = _rand(len + 1);
+		uint32_t length = _rand(4) ? _rand(50) : _rand(20000);
+		uint32_t size = _rand(4) ? _rand(50) : _rand(20000);
+
+		if(offset + length > len)
+		{
+			length = len - offset;
+		}
+
+		if(len - length + size > TEXT_MAX)
+		{
+			size = 0;
+		}
+
+		memmove(&text[offset + size], &text[offset + length], len - offset - length);
+		_fill(&text[offset], size);
+		len = len - length + size;
+
+		const uint64_t root = _chunks_update(&incr, text, len, offset, length, size);
+
+		memcpy(copy, text, len);
+		assert(_chunks_reset(&full, copy, len) == root);
+		assert(incr.nchunks == full.nchunks);
+
+		for(uint32_t j = 0; j < incr.nchunks; j++)
+		{
+			assert(incr.chunk[j].offset == full.chunk[j].offset);
+			assert(incr.chunk[j].size == full.chunk[j].size);
+			assert(incr.chunk[j].hash == full.chunk[j].hash);
+		}
+
+		_assert_contiguous(&incr, len);
+	}
+
+	_chunks_deinit(&incr);
+	_chunks_deinit(&full);
+}
+
+static const test_t tests [] = {
+	_test_empty,
+	_test_splice,
+	NULL
+};
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	srand(0x5eed);
+
+	for(const test_t *test = tests; *test; test++)
+	{
+		(*test)();
+	}
+
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2020 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <notes_md.h>
+
+#define TEXT_MAX 0x4000
+#define NSPLICES 5000
+
+typedef void (*test_t)(void);
+
+static char text [TEXT_MAX];
+
+static uint32_t
+_rand(uint32_t max)
+{
+	return max ? (uint32_t)rand() % max : 0;
+}
+
+static const md_row_t *
+_row(const md_t *md, uint32_t r, const char **txt)
+{
+	const md_block_t *block = &md->block[_md_find(md, r)];
+
+	assert(r >= block->row0);
+	assert(r < block->row0 + block->nrows);
+
+	*txt = block->text;
+	return &block->row[r - block->row0];
+}
+
+static void
+_assert_row(const md_t *md, uint32_t r, md_kind_t kind, uint8_t level,
+	const char *str, const char *url)
+{
+	const char *txt = NULL;
+	const md_row_t *row = _row(md, r, &txt);
+
+	assert(row->kind == kind);
+	assert(row->level == level);
+	assert(row->size == strlen(str));
+	assert(!memcmp(&txt[row->offset], str, row->size));
+	assert(row->url_size == (url ? strlen(url) : 0));
+	assert(!url || !memcmp(&txt[row->url_offset], url, row->url_size));
+}
+
+static void
+_test_rows(void)
+{
+	static const char doc [] =
+		"# Title #\n"
+		"###### six\n"
+		"####### seven\n"
+		"- one\n"
+		"  * two\n"
+		"3. three\n"
+		"> quote\n"
+		"---\n"
+		"**bold** `code`\r\n"
+		"\n"
+		"last";
+	md_t md;
+
+	_md_init(&md);
+
+	assert(_md_update(&md, doc, sizeof(doc) - 1) == 2);
+	assert(md.nrows == 11);
+
+	_assert_row(&md, 0, MD_HEADING, 1, "Title", NULL);
+	_assert_row(&md, 1, MD_HEADING, 6, "six", NULL);
+	_assert_row(&md, 2, MD_TEXT, 0, "####### seven", NULL);
+	_assert_row(&md, 3, MD_ITEM, 0, "\xe2\x80\xa2 one", NULL);
+	_assert_row(&md, 4, MD_ITEM, 1, "\xe2\x80\xa2 two", NULL);
+	_assert_row(&md, 5, MD_ITEM, 0, "3. three", NULL);
+	_assert_row(&md, 6, MD_QUOTE, 0, "quote", NULL);
+	_assert_row(&md, 7, MD_RULE, 0, "", NULL);
+	_assert_row(&md, 8, MD_TEXT, 0, "bold code", NULL);
+	_assert_row(&md, 9, MD_TEXT, 0, "", NULL);
+	_assert_row(&md, 10, MD_TEXT, 0, "last", NULL);
+
+	// unchanged text reparses nothing
+	assert(_md_update(&md, doc, sizeof(doc) - 1) == 0);
+
+	_md_deinit(&md);
+}
+
+static void
+_test_links(void)
+{
+	static const char doc [] =
+		"see [label](http://a.org) and <https://b.org>\n"
+		"![alt](img.png)\n"
+		"<no link> [x] [y]z\n"
+		"- <c:d>\n"
+		"* [](e:f)";
+	md_t md;
+
+	_md_init(&md);
+
+	assert(_md_update(&md, doc, sizeof(doc) - 1) == 1);
+	assert(md.nrows == 5);
+
+	_assert_row(&md, 0, MD_TEXT, 0, "see label and https://b.org", "http://a.org");
+	_assert_row(&md, 1, MD_TEXT, 0, "alt", "img.png");
+	_assert_row(&md, 2, MD_TEXT, 0, "<no link> [x] [y]z", NULL);
+	_assert_row(&md, 3, MD_ITEM, 0, "\xe2\x80\xa2 c:d", "c:d");
+	_assert_row(&md, 4, MD_ITEM, 0, "\xe2\x80\xa2 ", "e:f");
+
+	_md_deinit(&md);
+}
+
+// long fenced code is split into several blocks, all rows stay code
+static void
+_test_fence(void)
+{
+	const unsigned nlines = MD_BLOCK_LINES + MD_BLOCK_LINES / 2;
+	size_t len = 0;
+	md_t md;
+
+	_md_init(&md);
+
+	len += snprintf(&text[len], TEXT_MAX - len, "text\n```c\n");
+	for(unsigned i = 0; i < nlines; i++)
+	{
+		// blank lines do not end code blocks
+		if(i % 10)
+		{
+			len += snprintf(&text[len], TEXT_MAX - len, "l%02u", i);
+		}
+		text[len++] = '\n';
+	}
+	len += snprintf(&text[len], TEXT_MAX - len, "```\n# after");
+
+	assert(_md_update(&md, text, len) == 4);
+	assert(md.nblocks == 4);
+	assert(md.nrows == nlines + 4);
+
+	_assert_row(&md, 0, MD_TEXT, 0, "text", NULL);
+	_assert_row(&md, 1, MD_CODE, 0, "", NULL);
+
+	for(unsigned i = 0; i < nlines; i++)
+	{
+		char str [8] = "";
+
+		if(i % 10)
+		{
+			snprintf(str, sizeof(str), "l%02u", i);
+		}
+
+		_assert_row(&md, i + 2, MD_CODE, 0, str, NULL);
+	}
+
+	_assert_row(&md, nlines + 2, MD_CODE, 0, "", NULL);
+	_assert_row(&md, nlines + 3, MD_HEADING, 1, "after", NULL);
+
+	// an edit in the last part of the fence only reparses that block
+	char *pos = strstr(text, "l41");
+	assert(pos);
+	pos[1] = 'X';
+	assert(_md_update(&md, text, len) == 1);
+	_assert_row(&md, 43, MD_CODE, 0, "lX1", NULL);
+
+	_md_deinit(&md);
+}
+
+static void
+_assert_equal(const md_t *incr, const md_t *full)
+{
+	assert(incr->nblocks == full->nblocks);
+	assert(incr->nrows == full->nrows);
+
+	for(uint32_t b = 0; b < full->nblocks; b++)
+	{
+		const md_block_t *x = &incr->block[b];
+		const md_block_t *y = &full->block[b];
+
+		assert(x->hash == y->hash);
+		assert(x->row0 == y->row0);
+		assert(x->nrows == y->nrows);
+
+		for(uint32_t r = 0; r < y->nrows; r++)
+		{
+			const md_row_t *u = &x->row[r];
+			const md_row_t *v = &y->row[r];
+
+			assert(u->kind == v->kind);
+			assert(u->level == v->level);
+			assert(u->size == v->size);
+			assert(!memcmp(&x->text[u->offset], &y->text[v->offset], v->size));
+			assert(u->url_size == v->url_size);
+			assert(!memcmp(&x->text[u->url_offset], &y->text[v->url_offset],
+				v->url_size));
+		}
+	}
+}
+
+// incrementally updated blocks must match a full reparse after random splices
+static void
+_test_update(void)
+{
+	static const char *tokens [] = {
+		"a", " ", "\n", "\n\n", "\r", "\t", "#", "- ", "* ", "1. ", "> ", "---",
+		"```", "`", "**", "[", "](", ")", "<", ">", ":", "\xc3\xa4"
+	};
+	const uint32_t ntokens = sizeof(tokens) / sizeof(*tokens);
+	size_t len = 0;
+	md_t incr;
+
+	_md_init(&incr);
+
+	for(unsigned i = 0; i < NSPLICES; i++)
+	{
+		const size_t offset = _rand(len + 1);
+
+		if(_rand(3) == 0) // delete
+		{
+			size_t length = _rand(16);
+
+			if(offset + length > len)
+			{
+				length = len - offset;
+			}
+
+			memmove(&text[offset], &text[offset + length], len - offset - length);
+			len -= length;
+		}
+		else // insert
+		{
+			const char *tok = tokens[_rand(ntokens)];
+			const size_t size = strlen(tok);
+
+			if(len + size <= TEXT_MAX)
+			{
+				memmove(&text[offset + size], &text[offset], len - offset);
+				memcpy(&text[offset], tok, size);
+				len += size;
+			}
+		}
+
+		assert(_md_update(&incr, text, len) >= 0);
+
+		// each source line maps to one row
+		size_t nrows = (len > 0) && (text[len - 1] != '\n');
+		for(size_t j = 0; j < len; j++)
+		{
+			nrows += (text[j] == '\n');
+		}
+		assert(incr.nrows == nrows);
+
+		md_t full;
+
+		_md_init(&full);
+		assert(_md_update(&full, text, len) >= 0);
+		_assert_equal(&incr, &full);
+		_md_deinit(&full);
+	}
+
+	_md_deinit(&incr);
+}
+
+static const test_t tests [] = {
+	_test_rows,
+	_test_links,
+	_test_fence,
+	_test_update,
+	NULL
+};
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	srand(0x5eed);
+
+	for(const test_t *test = tests; *test; test++)
+	{
+		(*test)();
+	}
+
+	return 0;
+}